@@ -0,0 +1,589 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "delta.h"
+#include "fmap.h"
+#include "crc.h"
+#include "debug.h"
+
+#define DELTA_PATH_MAX 512
+
+static inline uint32_t get32(const uint8_t * cp)
+{
+	return cp[0] | (cp[1] << 8) | (cp[2] << 16) | ((uint32_t)cp[3] << 24);
+}
+
+static inline void put32(uint8_t * cp, uint32_t val)
+{
+	cp[0] = val;
+	cp[1] = val >> 8;
+	cp[2] = val >> 16;
+	cp[3] = val >> 24;
+}
+
+static inline uint32_t image_crc32(const void * buf, size_t len)
+{
+	return ~crc32(~0UL, buf, len);
+}
+
+/* ---------------------------------------------------------------------------
+ * Patch encoder
+ * ---------------------------------------------------------------------------
+ */
+
+struct delta_out {
+	uint8_t * buf;
+	size_t len;
+	size_t size;
+	/* last copy operation, extended while the blocks are consecutive */
+	uint8_t * copy;
+};
+
+static uint8_t * delta_out_reserve(struct delta_out * out, size_t len)
+{
+	uint8_t * cp;
+
+	if (out->len + len > out->size) {
+		size_t size = out->size * 2;
+		uint8_t * buf;
+
+		while (size < out->len + len)
+			size *= 2;
+
+		if ((buf = realloc(out->buf, size)) == NULL)
+			return NULL;
+
+		if (out->copy != NULL)
+			out->copy = buf + (out->copy - out->buf);
+		out->buf = buf;
+		out->size = size;
+	}
+
+	cp = out->buf + out->len;
+	out->len += len;
+
+	return cp;
+}
+
+static int delta_out_data(struct delta_out * out,
+						  const uint8_t * data, size_t len)
+{
+	uint8_t * cp;
+
+	if (len == 0)
+		return 0;
+
+	if ((cp = delta_out_reserve(out, 5 + len)) == NULL)
+		return -1;
+
+	cp[0] = 'D';
+	put32(&cp[1], len);
+	memcpy(&cp[5], data, len);
+	out->copy = NULL;
+
+	return 0;
+}
+
+static int delta_out_copy(struct delta_out * out, uint32_t blk)
+{
+	uint8_t * cp;
+
+	if ((cp = out->copy) != NULL) {
+		uint32_t cnt = get32(&cp[5]);
+
+		if (get32(&cp[1]) + cnt == blk) {
+			put32(&cp[5], cnt + 1);
+			return 0;
+		}
+	}
+
+	if ((cp = delta_out_reserve(out, 9)) == NULL)
+		return -1;
+
+	cp[0] = 'C';
+	put32(&cp[1], blk);
+	put32(&cp[5], 1);
+	out->copy = cp;
+
+	return 0;
+}
+
+/* rsync's weak checksum, it can be rolled one byte at a time */
+static inline uint32_t weak_sum(uint32_t a, uint32_t b)
+{
+	return (a & 0xffff) | (b << 16);
+}
+
+int delta_encode(const void * base, size_t base_size,
+				 const void * img, size_t size, uint8_t ** patch)
+{
+	const uint8_t * src = (const uint8_t *)img;
+	const uint8_t * ref = (const uint8_t *)base;
+	const size_t blk_size = DELTA_BLK_SIZE;
+	struct delta_out out;
+	unsigned int nblk = base_size / blk_size;
+	unsigned int hsize;
+	int32_t * head = NULL;
+	int32_t * next = NULL;
+	uint32_t * sum = NULL;
+	uint32_t expect = UINT32_MAX;
+	size_t lit = 0;
+	size_t pos = 0;
+	uint32_t a = 0;
+	uint32_t b = 0;
+	unsigned int i;
+	uint8_t * cp;
+
+	if ((base == NULL) || (img == NULL) || (patch == NULL) ||
+		(base_size > INT32_MAX) || (size > INT32_MAX))
+		return -1;
+
+	out.size = 4096;
+	out.len = 0;
+	out.copy = NULL;
+	if ((out.buf = malloc(out.size)) == NULL)
+		return -1;
+
+	/* Index the whole blocks of the base image by their weak sum */
+	for (hsize = 256; hsize < nblk; hsize *= 2);
+
+	head = malloc(hsize * sizeof(int32_t));
+	next = malloc((nblk + 1) * sizeof(int32_t));
+	sum = malloc((nblk + 1) * sizeof(uint32_t));
+	if ((head == NULL) || (next == NULL) || (sum == NULL))
+		goto error;
+
+	for (i = 0; i < hsize; ++i)
+		head[i] = -1;
+
+	/* Insert in reverse, so that chains start with the lowest block */
+	for (i = nblk; i-- > 0; ) {
+		const uint8_t * p = ref + (size_t)i * blk_size;
+		unsigned int h;
+		size_t k;
+
+		a = 0;
+		b = 0;
+		for (k = 0; k < blk_size; ++k) {
+			a += p[k];
+			b += a;
+		}
+		sum[i] = weak_sum(a, b);
+		h = sum[i] & (hsize - 1);
+		next[i] = head[h];
+		head[h] = i;
+	}
+
+	cp = delta_out_reserve(&out, DELTA_HDR_LEN);
+	put32(&cp[0], DELTA_MAGIC);
+	put32(&cp[4], blk_size);
+	put32(&cp[8], base_size);
+	put32(&cp[12], image_crc32(base, base_size));
+	put32(&cp[16], size);
+	put32(&cp[20], image_crc32(img, size));
+
+	if ((nblk > 0) && (size >= blk_size)) {
+		size_t k;
+
+		a = 0;
+		b = 0;
+		for (k = 0; k < blk_size; ++k) {
+			a += src[k];
+			b += a;
+		}
+	}
+
+	while ((nblk > 0) && (pos + blk_size <= size)) {
+		uint32_t s = weak_sum(a, b);
+		int32_t j = -1;
+
+		/* Unchanged regions continue with the next base block, try
+		   it before the hash chain. */
+		if ((expect < nblk) && (sum[expect] == s) &&
+			(memcmp(ref + (size_t)expect * blk_size,
+					src + pos, blk_size) == 0)) {
+			j = expect;
+		} else {
+			for (j = head[s & (hsize - 1)]; j >= 0; j = next[j]) {
+				if ((sum[j] == s) &&
+					(memcmp(ref + (size_t)j * blk_size,
+							src + pos, blk_size) == 0))
+					break;
+			}
+		}
+
+		if (j >= 0) {
+			if ((delta_out_data(&out, src + lit, pos - lit) < 0) ||
+				(delta_out_copy(&out, j) < 0))
+				goto error;
+
+			pos += blk_size;
+			lit = pos;
+			expect = j + 1;
+
+			if (pos + blk_size <= size) {
+				size_t k;
+
+				a = 0;
+				b = 0;
+				for (k = 0; k < blk_size; ++k) {
+					a += src[pos + k];
+					b += a;
+				}
+			}
+			continue;
+		}
+
+		/* roll the window one byte */
+		if (pos + blk_size < size) {
+			a += src[pos + blk_size] - src[pos];
+			b += a - blk_size * src[pos];
+		}
+		pos++;
+	}
+
+	if ((delta_out_data(&out, src + lit, size - lit) < 0) ||
+		((cp = delta_out_reserve(&out, 1)) == NULL))
+		goto error;
+	*cp = 'E';
+
+	free(sum);
+	free(next);
+	free(head);
+
+	*patch = out.buf;
+
+	return out.len;
+
+error:
+	DBG(DBG_WARNING, "out of memory!");
+	free(sum);
+	free(next);
+	free(head);
+	free(out.buf);
+
+	return -1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Patch decoder, this is what the targets run
+ * ---------------------------------------------------------------------------
+ */
+
+int delta_apply(const void * base, size_t base_size,
+				const void * patch, size_t len, void * out, size_t max)
+{
+	const uint8_t * cp = (const uint8_t *)patch;
+	const uint8_t * end = cp + len;
+	uint8_t * dst = (uint8_t *)out;
+	size_t blk_size;
+	size_t size;
+	size_t pos = 0;
+
+	if ((patch == NULL) || (len < DELTA_HDR_LEN + 1) ||
+		(get32(&cp[0]) != DELTA_MAGIC))
+		return -1;
+
+	blk_size = get32(&cp[4]);
+	size = get32(&cp[16]);
+
+	if ((get32(&cp[8]) != base_size) ||
+		(get32(&cp[12]) != image_crc32(base, base_size))) {
+		DBG(DBG_WARNING, "the patch doesn't apply to this image!");
+		return -1;
+	}
+
+	if (size > max)
+		return -1;
+
+	cp += DELTA_HDR_LEN;
+
+	while (cp < end) {
+		size_t off;
+		size_t n;
+
+		switch (*cp) {
+		case 'C':
+			if (end - cp < 9)
+				return -1;
+			off = (size_t)get32(&cp[1]) * blk_size;
+			n = (size_t)get32(&cp[5]) * blk_size;
+			if ((off > base_size) || (n > base_size - off) ||
+				(n > size - pos))
+				return -1;
+			memcpy(dst + pos, (const uint8_t *)base + off, n);
+			pos += n;
+			cp += 9;
+			break;
+
+		case 'D':
+			if (end - cp < 5)
+				return -1;
+			n = get32(&cp[1]);
+			if ((n > (size_t)(end - cp) - 5) || (n > size - pos))
+				return -1;
+			memcpy(dst + pos, &cp[5], n);
+			pos += n;
+			cp += 5 + n;
+			break;
+
+		case 'E':
+			if ((pos != size) ||
+				(get32(&((const uint8_t *)patch)[20]) !=
+				 image_crc32(out, size))) {
+				DBG(DBG_WARNING, "CRC error!");
+				return -1;
+			}
+			return size;
+
+		default:
+			return -1;
+		}
+	}
+
+	/* truncated patch */
+	return -1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Image cache
+ * ---------------------------------------------------------------------------
+ */
+
+/* Target IDs become file names, keep them plain */
+static bool target_id_valid(const char * target)
+{
+	const char * cp;
+
+	if ((target == NULL) || (*target == '\0') || (*target == '.'))
+		return false;
+
+	for (cp = target; *cp != '\0'; ++cp) {
+		if (!(((*cp >= 'a') && (*cp <= 'z')) ||
+			  ((*cp >= 'A') && (*cp <= 'Z')) ||
+			  ((*cp >= '0') && (*cp <= '9')) ||
+			  (*cp == '_') || (*cp == '-') || (*cp == '.')))
+			return false;
+	}
+
+	return (cp - target) < 64;
+}
+
+/* Write the file through a temporary name, readers never see it half
+   written. */
+static int file_replace(const char * path, const void * buf, size_t len)
+{
+	char tmp[DELTA_PATH_MAX + 4];
+	ssize_t n;
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY,
+				   0644)) < 0) {
+		DBG(DBG_WARNING, "open(\"%s\"): %s.", tmp, strerror(errno));
+		return -1;
+	}
+
+	n = write(fd, buf, len);
+	close(fd);
+
+	if (n != (ssize_t)len) {
+		DBG(DBG_WARNING, "write(): %s.", strerror(errno));
+		unlink(tmp);
+		return -1;
+	}
+
+#ifdef _WIN32
+	/* rename() won't replace an existing file */
+	unlink(path);
+#endif
+	if (rename(tmp, path) < 0) {
+		DBG(DBG_WARNING, "rename(): %s.", strerror(errno));
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+int delta_cache_put(const char * dir, const char * target,
+					const void * img, size_t size)
+{
+	char path[DELTA_PATH_MAX];
+	char name[32];
+	struct stat st;
+
+	if ((dir == NULL) || !target_id_valid(target) || (img == NULL))
+		return -1;
+
+#ifdef _WIN32
+	mkdir(dir);
+#else
+	mkdir(dir, 0755);
+#endif
+
+	/* content addressed: the same image is stored only once */
+	snprintf(name, sizeof(name), "%08x-%lu.img",
+			 image_crc32(img, size), (unsigned long)size);
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+	if ((stat(path, &st) < 0) || ((size_t)st.st_size != size)) {
+		if (file_replace(path, img, size) < 0)
+			return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s.ref", dir, target);
+
+	return file_replace(path, name, strlen(name));
+}
+
+void * delta_cache_get(const char * dir, const char * target, size_t * size)
+{
+	char path[DELTA_PATH_MAX];
+	char name[32];
+	FILE * f;
+	void * ptr;
+	int n;
+
+	if ((dir == NULL) || !target_id_valid(target) || (size == NULL))
+		return NULL;
+
+	snprintf(path, sizeof(path), "%s/%s.ref", dir, target);
+
+	if ((f = fopen(path, "r")) == NULL)
+		return NULL;
+
+	n = fread(name, 1, sizeof(name) - 1, f);
+	fclose(f);
+	name[n] = '\0';
+
+	if ((n == 0) || (strchr(name, '/') != NULL))
+		return NULL;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+	if ((ptr = fmap(path, size)) == NULL)
+		return NULL;
+
+	/* the name tells what the contents must be */
+	if (strtoul(name, NULL, 16) != image_crc32(ptr, *size)) {
+		DBG(DBG_WARNING, "\"%s\" is corrupted!", path);
+		funmap(ptr, *size);
+		return NULL;
+	}
+
+	return ptr;
+}
+
+/* ---------------------------------------------------------------------------
+ * Upload
+ * ---------------------------------------------------------------------------
+ */
+
+static int delta_send(struct xmodem_send * sx, const char * path,
+					  const void * base, size_t base_size,
+					  const void * img, size_t size)
+{
+	char fname[XMODEM_FNAME_MAX + 1];
+	const char * cp;
+	uint8_t * patch;
+	uint8_t * chk;
+	int len;
+	int ret;
+
+	if ((len = delta_encode(base, base_size, img, size, &patch)) < 0)
+		return -1;
+
+	DBG(DBG_INFO, "patch: %d bytes, image: %lu bytes", len,
+		(unsigned long)size);
+
+	if ((size_t)len >= size) {
+		free(patch);
+		return 1;
+	}
+
+	/* Make sure the target will get the image right */
+	if ((chk = malloc(size)) == NULL) {
+		free(patch);
+		return -1;
+	}
+	ret = delta_apply(base, base_size, patch, len, chk, size);
+	if ((ret != (int)size) || (memcmp(chk, img, size) != 0)) {
+		DBG(DBG_ERROR, "patch verification failed!");
+		free(chk);
+		free(patch);
+		return 1;
+	}
+	free(chk);
+
+	for (cp = path; *cp != '\0'; ++cp) {
+		if ((*cp == '/') || (*cp == '\\'))
+			path = cp + 1;
+	}
+	snprintf(fname, sizeof(fname), "%s%s", path, DELTA_SUFFIX);
+
+	if ((ret = xmodem_send_start(sx, fname, len)) == 0) {
+		if ((ret = xmodem_send_loop(sx, patch, len)) == 0)
+			ret = xmodem_send_eot(sx);
+	}
+
+	free(patch);
+
+	return ret;
+}
+
+int delta_upload(struct xmodem_send * sx, const char * dir,
+				 const char * target, const char * path)
+{
+	void * base = NULL;
+	size_t base_size = 0;
+	size_t size;
+	void * img;
+	int ret = 1;
+
+	if ((sx == NULL) || (path == NULL))
+		return -EINVAL;
+
+	/* the patch is told apart by its name, only YMODEM carries one */
+	if (sx->mode != MODE_YMODEM)
+		return -EINVAL;
+
+	if ((img = fmap(path, &size)) == NULL)
+		return -1;
+
+	if ((dir != NULL) &&
+		((base = delta_cache_get(dir, target, &base_size)) != NULL)) {
+		ret = delta_send(sx, path, base, base_size, img, size);
+		funmap(base, base_size);
+	}
+
+	/* no usable patch, send the whole image */
+	if (ret > 0)
+		ret = xmodem_send_file(sx, path);
+
+	if ((ret == 0) && (dir != NULL))
+		delta_cache_put(dir, target, img, size);
+
+	funmap(img, size);
+
+	return ret;
+}
+
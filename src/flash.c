@@ -0,0 +1,247 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "flash.h"
+#include "xmodem.h"
+/* xmodem_clock_ms() */
+#include "xymodem/private.h"
+#include "fmap.h"
+#include "debug.h"
+
+/* The image is fed to the sender in slices of this size, progress is
+   reported in between */
+#define FLASH_SLICE_SIZE (64 * 1024)
+/* Progress report step, in percent */
+#define FLASH_REPORT_STEP 10
+
+struct flash_batch {
+	pthread_mutex_t mutex;
+	const uint8_t * img;
+	unsigned int size;
+	const char * fname;
+	struct flash_target * lst;
+	int cnt;
+	int next; /* next target to be picked by a worker */
+	FILE * log;
+};
+
+static unsigned int flash_rate(unsigned int bytes, uint32_t ms)
+{
+	/* bytes per second */
+	return (ms == 0) ? 0 : (uint64_t)bytes * 1000 / ms;
+}
+
+static void flash_log(struct flash_batch * fb, const char * fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+static void flash_log(struct flash_batch * fb, const char * fmt, ...)
+{
+	va_list ap;
+
+	if (fb->log == NULL)
+		return;
+
+	/* one line at a time from all the workers */
+	pthread_mutex_lock(&fb->mutex);
+	va_start(ap, fmt);
+	vfprintf(fb->log, fmt, ap);
+	va_end(ap);
+	fflush(fb->log);
+	pthread_mutex_unlock(&fb->mutex);
+}
+
+static int flash_target_run(struct flash_batch * fb, 
+							struct flash_target * tgt)
+{
+	struct xmodem_send * sx;
+	unsigned int step = FLASH_REPORT_STEP;
+	uint32_t t0;
+	int ret;
+
+	if ((sx = xmodem_send_alloc()) == NULL)
+		return -ENOMEM;
+
+	t0 = xmodem_clock_ms();
+
+	if ((ret = xmodem_send_open(sx, tgt->dev, MODE_YMODEM)) < 0)
+		goto done;
+
+	if ((ret = xmodem_send_start(sx, fb->fname, fb->size)) < 0)
+		goto done;
+
+	/* The slices are sent straight from the shared mapping */
+	while (tgt->sent < fb->size) {
+		unsigned int n = fb->size - tgt->sent;
+
+		if (n > FLASH_SLICE_SIZE)
+			n = FLASH_SLICE_SIZE;
+
+		if ((ret = xmodem_send_loop(sx, fb->img + tgt->sent, n)) < 0)
+			goto done;
+
+		tgt->sent += n;
+		tgt->elapsed_ms = xmodem_clock_ms() - t0;
+
+		if ((uint64_t)tgt->sent * 100 >= (uint64_t)fb->size * step) {
+			flash_log(fb, "%s: %3d%% %u B/s\n", tgt->name, 
+					  (int)((uint64_t)tgt->sent * 100 / fb->size),
+					  flash_rate(tgt->sent, tgt->elapsed_ms));
+			while ((uint64_t)tgt->sent * 100 >= (uint64_t)fb->size * step)
+				step += FLASH_REPORT_STEP;
+		}
+	}
+
+	if ((ret = xmodem_send_eot(sx)) < 0)
+		goto done;
+
+	ret = xmodem_send_close(sx);
+
+done:
+	if ((ret < 0) && (tgt->dev != NULL))
+		xmodem_send_cancel(sx);
+
+	tgt->elapsed_ms = xmodem_clock_ms() - t0;
+	xmodem_send_free(sx);
+
+	return ret;
+}
+
+static void * flash_worker(void * arg)
+{
+	struct flash_batch * fb = (struct flash_batch *)arg;
+	struct flash_target * tgt;
+
+	for (;;) {
+		pthread_mutex_lock(&fb->mutex);
+		tgt = (fb->next < fb->cnt) ? &fb->lst[fb->next++] : NULL;
+		pthread_mutex_unlock(&fb->mutex);
+
+		if (tgt == NULL)
+			break;
+
+		flash_log(fb, "%s: start\n", tgt->name);
+
+		tgt->status = flash_target_run(fb, tgt);
+
+		if (tgt->status < 0)
+			flash_log(fb, "%s: failed (%d)\n", tgt->name, tgt->status);
+	}
+
+	return NULL;
+}
+
+int flash_batch(const char * path, struct flash_target lst[], int cnt,
+				int workers, FILE * log)
+{
+	pthread_t thread[FLASH_WORKERS_MAX];
+	struct flash_batch fb;
+	const char * cp;
+	size_t size;
+	void * img;
+	int fail = 0;
+	int n = 0;
+	int i;
+
+	if ((path == NULL) || (lst == NULL) || (cnt < 0))
+		return -1;
+
+	if ((img = fmap(path, &size)) == NULL)
+		return -1;
+
+	if (size > INT32_MAX) {
+		funmap(img, size);
+		return -1;
+	}
+
+	pthread_mutex_init(&fb.mutex, NULL);
+	fb.img = img;
+	fb.size = size;
+	fb.lst = lst;
+	fb.cnt = cnt;
+	fb.next = 0;
+	fb.log = log;
+
+	/* the header carries the file name only */
+	fb.fname = path;
+	for (cp = path; *cp != '\0'; ++cp) {
+		if ((*cp == '/') || (*cp == '\\'))
+			fb.fname = cp + 1;
+	}
+
+	for (i = 0; i < cnt; ++i) {
+		lst[i].status = -1;
+		lst[i].sent = 0;
+		lst[i].elapsed_ms = 0;
+		if (lst[i].name == NULL)
+			lst[i].name = "?";
+	}
+
+	if ((workers <= 0) || (workers > cnt))
+		workers = cnt;
+	if (workers > FLASH_WORKERS_MAX)
+		workers = FLASH_WORKERS_MAX;
+
+	for (i = 0; i < workers; ++i) {
+		if (pthread_create(&thread[n], NULL, flash_worker, &fb) != 0) {
+			DBG(DBG_WARNING, "pthread_create() failed!");
+			break;
+		}
+		n++;
+	}
+
+	/* without threads do it from here */
+	if (n == 0)
+		flash_worker(&fb);
+
+	for (i = 0; i < n; ++i)
+		pthread_join(thread[i], NULL);
+
+	if (log != NULL) {
+		fprintf(log, "\n%-16s %-6s %10s %8s %10s\n", 
+				"target", "status", "bytes", "time", "B/s");
+		for (i = 0; i < cnt; ++i) {
+			struct flash_target * tgt = &lst[i];
+
+			fprintf(log, "%-16s %-6s %10u %5u.%02u %10u\n", tgt->name,
+					(tgt->status == 0) ? "OK" : "FAIL", tgt->sent,
+					tgt->elapsed_ms / 1000, (tgt->elapsed_ms % 1000) / 10,
+					flash_rate(tgt->sent, tgt->elapsed_ms));
+		}
+	}
+
+	for (i = 0; i < cnt; ++i) {
+		if (lst[i].status != 0)
+			fail++;
+	}
+
+	if (log != NULL) {
+		fprintf(log, "%d of %d targets flashed", cnt - fail, cnt);
+		if (fail) {
+			fprintf(log, ", failed:");
+			for (i = 0; i < cnt; ++i) {
+				if (lst[i].status != 0)
+					fprintf(log, " %s(%d)", lst[i].name, lst[i].status);
+			}
+		}
+		fprintf(log, "\n");
+		fflush(log);
+	}
+
+	pthread_mutex_destroy(&fb.mutex);
+	funmap(img, size);
+
+	return fail;
+}
+
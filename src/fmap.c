@@ -0,0 +1,179 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "fmap.h"
+#include "debug.h"
+
+/* Zero length mappings are not allowed, empty files point here instead */
+static char fmap_empty[1];
+
+void * fmap_fd(int fd, size_t * size)
+{
+	struct stat st;
+	void * ptr;
+
+	if (fstat(fd, &st) < 0) {
+		DBG(DBG_WARNING, "fstat(): %s.", strerror(errno));
+		return NULL;
+	}
+
+	if (!S_ISREG(st.st_mode)) {
+		DBG(DBG_WARNING, "not a regular file!");
+		return NULL;
+	}
+
+	if (st.st_size == 0) {
+		*size = 0;
+		return fmap_empty;
+	}
+
+#ifdef _WIN32
+	{
+		HANDLE hMap;
+
+		hMap = CreateFileMapping((HANDLE)_get_osfhandle(fd), NULL, 
+								 PAGE_READONLY, 0, 0, NULL);
+		if (hMap == NULL) {
+			DBG(DBG_WARNING, "CreateFileMapping() failed!");
+			return NULL;
+		}
+
+		/* the view keeps a reference to the mapping object */
+		ptr = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(hMap);
+
+		if (ptr == NULL) {
+			DBG(DBG_WARNING, "MapViewOfFile() failed!");
+			return NULL;
+		}
+	}
+#else
+	if ((ptr = mmap(NULL, st.st_size, PROT_READ, 
+					MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		DBG(DBG_WARNING, "mmap(): %s.", strerror(errno));
+		return NULL;
+	}
+
+	/* the contents are going to be read front to back */
+	madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+#endif
+
+	*size = st.st_size;
+
+	return ptr;
+}
+
+void * fmap(const char * path, size_t * size)
+{
+	void * ptr;
+	int fd;
+
+	if ((path == NULL) || (size == NULL))
+		return NULL;
+
+	if ((fd = open(path, O_RDONLY | O_BINARY)) < 0) {
+		DBG(DBG_WARNING, "open(\"%s\"): %s.", path, strerror(errno));
+		return NULL;
+	}
+
+	ptr = fmap_fd(fd, size);
+	close(fd);
+
+	return ptr;
+}
+
+void * fmap_create(const char * path, size_t size)
+{
+	void * ptr;
+	int fd;
+
+	if (path == NULL)
+		return NULL;
+
+	/* not truncated, the contents up to 'size' are kept */
+	if ((fd = open(path, O_RDWR | O_CREAT | O_BINARY, 0644)) < 0) {
+		DBG(DBG_WARNING, "open(\"%s\"): %s.", path, strerror(errno));
+		return NULL;
+	}
+
+#ifdef _WIN32
+	if (_chsize(fd, size) < 0) {
+		DBG(DBG_WARNING, "_chsize(): %s.", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+#else
+	if (ftruncate(fd, size) < 0) {
+		DBG(DBG_WARNING, "ftruncate(): %s.", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+#endif
+
+	if (size == 0) {
+		close(fd);
+		return fmap_empty;
+	}
+
+#ifdef _WIN32
+	{
+		HANDLE hMap;
+
+		hMap = CreateFileMapping((HANDLE)_get_osfhandle(fd), NULL, 
+								 PAGE_READWRITE, (uint64_t)size >> 32, 
+								 size & 0xffffffff, NULL);
+		if (hMap == NULL) {
+			DBG(DBG_WARNING, "CreateFileMapping() failed!");
+			close(fd);
+			return NULL;
+		}
+
+		ptr = MapViewOfFile(hMap, FILE_MAP_WRITE, 0, 0, size);
+		CloseHandle(hMap);
+
+		if (ptr == NULL)
+			DBG(DBG_WARNING, "MapViewOfFile() failed!");
+	}
+#else
+	if ((ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, 
+					MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		DBG(DBG_WARNING, "mmap(): %s.", strerror(errno));
+		ptr = NULL;
+	}
+#endif
+
+	close(fd);
+
+	return ptr;
+}
+
+int funmap(void * ptr, size_t size)
+{
+	if ((ptr == NULL) || (ptr == fmap_empty) || (size == 0))
+		return 0;
+
+#ifdef _WIN32
+	return UnmapViewOfFile(ptr) ? 0 : -1;
+#else
+	return munmap(ptr, size);
+#endif
+}
+
@@ -27,6 +27,7 @@
 #ifndef __CONF_H__
 #define __CONF_H__
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -37,6 +38,8 @@ struct conf_typedesc {
 	char *t_name;
 	int (*t_get) (struct conf_entry *, char *);
 	int (*t_set) (struct conf_entry *, const char *);
+	/* size of the value in memory, 0 if it can't be copied as is */
+	unsigned int t_size;
 };
 
 struct conf_entry {
@@ -44,6 +47,7 @@ struct conf_entry {
 	struct conf_typedesc * type;
 	void * p; /* pointer to a variable holding the value */
 	unsigned int len;
+	uint32_t dirty; /* conf_entry_set() change since the last save, or 0 */
 };
 
 struct conf_root {
@@ -51,6 +55,25 @@ struct conf_root {
 	struct conf_entry entry[];
 };
 
+struct conf_snap;
+
+/* State of a streaming parse, see conf_parser_feed() */
+struct conf_parser {
+	struct conf_entry * root;
+	struct conf_entry * section; /* NULL inside an unknown section */
+	struct conf_snap * snap; /* values recorded for conf_load() */
+	char * buf; /* line split across chunks, or the value being set */
+	unsigned int buf_len;
+	unsigned int buf_size;
+	char * path; /* "section/entry" being looked up */
+	unsigned int path_len; /* length of the "section/" prefix */
+	unsigned int path_size;
+	unsigned int cnt; /* values set */
+	int line; /* current line */
+	int col; /* column of the error */
+	const char * err; /* syntax error, NULL if none */
+};
+
 enum conf_type {
 	CONF_VOID = 0,
 	CONF_SECTION = 1,
@@ -79,18 +102,18 @@ enum conf_type {
 	CONF_BIN32 = 21,
 	CONF_OCT32 = 22,
 
-	CONF_INT64 = 21,
-	CONF_UINT64 = 22,
-	CONF_HEX64 = 23,
-	CONF_BIN64 = 24,
-	CONF_OCT64 = 25,
-
-	CONF_IPV4ADDR = 26,
-	CONF_RGB = 27,
-	CONF_RGBI = 28,
-	CONF_CYMK = 29,
-	CONF_RATIO = 30,
-	CONF_MAX = 31
+	CONF_INT64 = 23,
+	CONF_UINT64 = 24,
+	CONF_HEX64 = 25,
+	CONF_BIN64 = 26,
+	CONF_OCT64 = 27,
+
+	CONF_IPV4ADDR = 28,
+	CONF_RGB = 29,
+	CONF_RGBI = 30,
+	CONF_CYMK = 31,
+	CONF_RATIO = 32,
+	CONF_MAX = 33
 };
 
 #define CONF_TYPE(TYPE) (&conf_type_tab[TYPE])
@@ -202,11 +225,101 @@ extern "C" {
 int conf_lookup(char *, const char **, const char **);
 
 int conf_dump(struct conf_entry *);
+/**
+ * Load the file 'path' into the tree. The values set are also written to
+ * a binary snapshot, "<path>.snap", which the next conf_load() copies back
+ * without parsing, as long as the layout of the tree and the file (its
+ * time, size and CRC32) did not change. conf_load_fd() always parses.
+ */
 int conf_load(const char *, struct conf_entry *);
+int conf_load_fd(int, struct conf_entry *);
+
+/**
+ * Parse 'len' bytes of configuration text, the buffer does not need to
+ * be NUL terminated. conf_load() maps the file and parses it in place,
+ * conf_load_fd() reads it in chunks, so it also takes pipes and devices.
+ */
+int conf_parse(const uint8_t * buf, size_t len, struct conf_entry * root);
+
+/**
+ * Start parsing text into the tree 'root', in chunks of any size given
+ * to conf_parser_feed(). Lines and values have no length limit.
+ */
+void conf_parser_init(struct conf_parser * p, struct conf_entry * root);
+
+/**
+ * Parse the complete lines of the chunk, the rest is kept for the next
+ * one. Returns -1 on a syntax error: 'line', 'col' and 'err' of the
+ * parser tell where and what it was, and the following chunks are
+ * ignored.
+ */
+int conf_parser_feed(struct conf_parser * p, const void * buf, size_t len);
+
+/**
+ * Parse the last line, if not terminated, and release the parser.
+ * Returns the number of values set, or -1 on a syntax error.
+ */
+int conf_parser_end(struct conf_parser * p);
+
+/**
+ * Write the tree to the file 'path'. The text is written to a temporary
+ * file which replaces the old one only once it is on the disk. Nothing
+ * is written if the file already holds the same text. Returns the number
+ * of values, or -1 on error.
+ */
 int conf_save(const char *, struct conf_entry *);
 
-int conf_var_set(struct conf_entry *, const char *, const char *);
-int conf_var_get(struct conf_entry *, const char *, char *);
+/**
+ * Write the text of the tree into a buffer allocated with malloc(),
+ * returned in 'text' and 'len'. Only memory is touched, so it is cheap
+ * to call with the tree locked and leave the disk to conf_write().
+ * Returns the number of values, or -1 if out of memory.
+ */
+int conf_encode(struct conf_entry * root, char ** text, size_t * len);
+
+/**
+ * Write 'len' bytes of text from conf_encode() to the file 'path', the
+ * same way as conf_save(). Returns 0 on success.
+ */
+int conf_write(const char * path, const char * text, size_t len);
+
+/**
+ * Return true if a value of the tree was changed by conf_entry_set()
+ * since it was last saved.
+ */
+bool conf_dirty(struct conf_entry *);
+
+/**
+ * Return the mark of the last change made by conf_entry_set(), to be 
+ * taken along with the text of conf_encode(), under the same lock. Once
+ * that text is on the disk, conf_dirty_commit() clears the changes up to
+ * the mark, the values set in the meantime stay dirty.
+ */
+uint32_t conf_dirty_mark(void);
+void conf_dirty_commit(struct conf_entry * root, uint32_t mark);
+
+/**
+ * Set the value of the entry 'name' of 'section' from its text. Returns
+ * 0 on success, -1 if there is no such entry or the text is not a value
+ * of its type, a number out of the range of the variable included.
+ */
+int conf_entry_set(struct conf_entry * section, const char * name,
+				   const char * value);
+
+/**
+ * Write the text of the value of the entry 'name' of 'section' to 'value'.
+ * Returns 0 on success, -1 if there is no such entry.
+ */
+int conf_entry_get(struct conf_entry * section, const char * name,
+				   char * value);
+
+/**
+ * Forget the lookup index of the tree 'root'. The index is built on the
+ * first lookup and kept, keyed by the address of the root, so it must
+ * be dropped before a tree is freed, or its entries are added, removed
+ * or renamed. Trees defined with BEGIN_SECTION() never need it.
+ */
+void conf_index_drop(struct conf_entry * root);
 
 #ifdef  __cplusplus
 }
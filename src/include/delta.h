@@ -0,0 +1,101 @@
+/*
+ * Copyright(C) 2012 Robinson Mittmann. All Rights Reserved.
+ *
+ * This file is part of the YARD-ICE.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You can receive a copy of the GNU Lesser General Public License from
+ * http://www.gnu.org/
+ */
+
+/**
+ * @file delta.h
+ * @brief YARD-ICE
+ * @author Robinson Mittmann <bobmittmann@gmail.com>
+ */
+
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "xmodem.h"
+
+/* 
+ * Patch format, all integers are 32 bits little endian:
+ *
+ *   header: magic, block size, base size, base CRC32, new size, new CRC32
+ *   'C' <block> <count>: copy 'count' blocks of the base image
+ *   'D' <length> <data>: literal data
+ *   'E': end of patch
+ *
+ * The target must check the base size and CRC against the image it 
+ * holds before applying the patch, and the new CRC afterwards.
+ */
+
+#define DELTA_MAGIC 0x544c4459 /* "YDLT" */
+#define DELTA_BLK_SIZE 512
+#define DELTA_HDR_LEN 24
+
+/* File name suffix of the patches sent to the targets */
+#define DELTA_SUFFIX ".dlt"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Compute the patch turning 'base' into 'img'. On success the patch is
+ * stored in a malloc'ed buffer at 'patch' and its length is returned.
+ * Returns -1 on error.
+ */
+int delta_encode(const void * base, size_t base_size,
+				 const void * img, size_t size, uint8_t ** patch);
+
+/**
+ * Apply 'patch' to 'base', writing the new image to 'out'. Returns the 
+ * size of the new image, or -1 if the patch is malformed, doesn't apply
+ * to this base or the result doesn't match.
+ */
+int delta_apply(const void * base, size_t base_size,
+				const void * patch, size_t len, void * out, size_t max);
+
+/**
+ * Record 'img' as the image flashed on 'target' in the cache directory
+ * 'dir'. Images are stored once, by content.
+ */
+int delta_cache_put(const char * dir, const char * target,
+					const void * img, size_t size);
+
+/**
+ * Map the image last recorded for 'target'. Returns NULL if there is none.
+ * Release it with funmap().
+ */
+void * delta_cache_get(const char * dir, const char * target, size_t * size);
+
+/**
+ * Upload the image file 'path' to 'target' over the open YMODEM session
+ * 'sx'. A patch against the cached image is sent when there is one and
+ * it is smaller than the image, the whole file otherwise. The cache is
+ * updated when the transfer succeeds. Returns -EINVAL if 'sx' was not
+ * opened in MODE_YMODEM.
+ */
+int delta_upload(struct xmodem_send * sx, const char * dir, 
+				 const char * target, const char * path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DELTA_H__ */
+
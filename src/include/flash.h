@@ -0,0 +1,68 @@
+/*
+ * Copyright(C) 2012 Robinson Mittmann. All Rights Reserved.
+ *
+ * This file is part of the YARD-ICE.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You can receive a copy of the GNU Lesser General Public License from
+ * http://www.gnu.org/
+ */
+
+/**
+ * @file flash.h
+ * @brief YARD-ICE
+ * @author Robinson Mittmann <bobmittmann@gmail.com>
+ */
+
+#ifndef __FLASH_H__
+#define __FLASH_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "serial.h"
+
+/* Maximum number of transfers running at the same time */
+#define FLASH_WORKERS_MAX 32
+
+struct flash_target {
+	/* set by the caller */
+	struct serial_dev * dev;
+	const char * name;
+	/* filled in by flash_batch() */
+	int status; /* 0 on success, the transfer error otherwise */
+	unsigned int sent; /* bytes sent */
+	uint32_t elapsed_ms;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * YMODEM the image file 'path' to the 'cnt' targets in 'lst', running up
+ * to 'workers' transfers at a time (0 for one per target). The image is
+ * mapped once and shared by all the transfers. Progress lines and the
+ * final summary are written to 'log', which can be NULL.
+ *
+ * Returns the number of targets that failed, or -1 if the image can't
+ * be read.
+ */
+int flash_batch(const char * path, struct flash_target lst[], int cnt,
+				int workers, FILE * log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FLASH_H__ */
+
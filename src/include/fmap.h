@@ -0,0 +1,66 @@
+/*
+ * Copyright(C) 2012 Robinson Mittmann. All Rights Reserved.
+ *
+ * This file is part of the YARD-ICE.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You can receive a copy of the GNU Lesser General Public License from
+ * http://www.gnu.org/
+ */
+
+/**
+ * @file fmap.h
+ * @brief YARD-ICE
+ * @author Robinson Mittmann <bobmittmann@gmail.com>
+ */
+
+#ifndef __FMAP_H__
+#define __FMAP_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Map the whole file 'path' read-only into memory. On success the file
+ * size is stored in 'size' and a pointer to the contents is returned.
+ * Returns NULL on error. An empty file yields a valid pointer and a
+ * zero size.
+ */
+void * fmap(const char * path, size_t * size);
+
+/**
+ * Same as fmap() for an already open file descriptor. The descriptor
+ * can be closed afterwards.
+ */
+void * fmap_fd(int fd, size_t * size);
+
+/**
+ * Create the file 'path' if needed, set its size to 'size' bytes and map
+ * it writable. Existing contents within 'size' are kept. Changes are 
+ * written back to the file. Returns NULL on error.
+ */
+void * fmap_create(const char * path, size_t size);
+
+/**
+ * Release a mapping returned by fmap(), fmap_fd() or fmap_create().
+ */
+int funmap(void * ptr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FMAP_H__ */
+
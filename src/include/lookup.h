@@ -0,0 +1,60 @@
+/*
+ * Copyright(C) 2012 Robinson Mittmann. All Rights Reserved.
+ *
+ * This file is part of the YARD-ICE.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You can receive a copy of the GNU Lesser General Public License from
+ * http://www.gnu.org/
+ */
+
+/**
+ * @file lookup.h
+ * @brief YARD-ICE
+ * @author Robinson Mittmann <bobmittmann@gmail.com>
+ */
+
+#ifndef __LOOKUP_H__
+#define __LOOKUP_H__
+
+#define FILE_NAME_MAX 256
+
+struct file_entry {
+	char name[FILE_NAME_MAX];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Copy the names of the entries in the directory 'path' matching 'regexp'
+ * into 'lst', up to 'max' entries. Returns the number of entries copied
+ * or -1 if the directory can't be read.
+ *
+ * The directory contents are cached and kept up to date by the file
+ * system notifications, so only the first lookup on a directory scans it.
+ */
+int file_lookup(const char * path, const char * regexp,
+				struct file_entry lst[], int max);
+
+/**
+ * Drop all cached directory indexes.
+ */
+void file_lookup_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOOKUP_H__ */
+
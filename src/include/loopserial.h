@@ -0,0 +1,78 @@
+/*
+ * Copyright(C) 2012 Robinson Mittmann. All Rights Reserved.
+ *
+ * This file is part of the YARD-ICE.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You can receive a copy of the GNU Lesser General Public License from
+ * http://www.gnu.org/
+ */
+
+/**
+ * @file loopserial.h
+ * @brief YARD-ICE
+ * @author Robinson Mittmann <bobmittmann@gmail.com>
+ */
+
+#ifndef __LOOPSERIAL_H__
+#define __LOOPSERIAL_H__
+
+#include "serial.h"
+
+/* Faults injected on the bytes sent by one end of the link. Each of the
+   first fields is the average number of events between faults, 0 
+   disables it. */
+struct loop_serial_fault {
+	unsigned int drop; /* bytes lost */
+	unsigned int flip; /* bytes with one bit inverted */
+	unsigned int dup; /* ACK characters received twice */
+	unsigned int can; /* writes followed by a spurious CAN */
+	unsigned int seed; /* random sequence, same seed, same faults */
+	/* Targeted loss: 'burst' bytes are lost from the 'nth' (from 1)
+	   write starting with the character 'chr', 'skip' bytes into it.
+	   A zero 'nth' disables it. */
+	unsigned int nth;
+	unsigned int skip;
+	unsigned int burst;
+	unsigned char chr;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Create an in-memory serial link and store its two ends in 'dev'. What
+ * is sent on one end is received on the other one, after the wire time
+ * of the characters at the configured baud rate (SERIAL_IOCTL_CONF_SET,
+ * on either end). The link starts with no delays and no faults.
+ *
+ * SERIAL_IOCTL_STAT_GET fills a 'struct serial_stat' with the bytes sent
+ * and received by the end and the number of faults injected on its
+ * transmissions.
+ *
+ * Both ends must be closed with serial_close(). Returns 0 on success.
+ */
+int loop_serial_open(struct serial_dev * dev[2]);
+
+/**
+ * Set the faults injected on the data sent by 'dev', NULL disables them.
+ */
+int loop_serial_fault_set(struct serial_dev * dev,
+						  const struct loop_serial_fault * fault);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOOPSERIAL_H__ */
+
@@ -133,12 +133,20 @@ enum {
 #define SERIAL_RX_EN 1
 #define SERIAL_TX_EN 2
 
+/* scatter/gather segment */
+struct serial_iov {
+	const void * base;
+	unsigned int len;
+};
+
 struct serial_op {
 	int (* send)(void *, const void *, unsigned int);
 	int (* recv)(void *, void *, unsigned int, unsigned int);
 	int (* drain)(void *);
 	int (* close)(void *);
 	int (* ioctl)(void *, int, uintptr_t, uintptr_t);
+	/* optional, may be NULL */
+	int (* sendv)(void *, const struct serial_iov *, unsigned int);
 };
 
 struct serial_dev {
@@ -156,6 +164,28 @@ static inline int serial_recv(struct serial_dev * dev, void * buf,
 	return dev->op->recv(dev->drv, buf, len, msec);
 }
 
+/* Send the segments in 'iov' as a single write if the driver supports
+   it, one segment at a time otherwise. Returns the total number of 
+   bytes sent. */
+static inline int serial_sendv(struct serial_dev * dev, 
+							   const struct serial_iov * iov, 
+							   unsigned int cnt) {
+	unsigned int i;
+	int sum = 0;
+	int ret;
+
+	if (dev->op->sendv != NULL)
+		return dev->op->sendv(dev->drv, iov, cnt);
+
+	for (i = 0; i < cnt; ++i) {
+		if ((ret = dev->op->send(dev->drv, iov[i].base, iov[i].len)) < 0)
+			return ret;
+		sum += ret;
+	}
+
+	return sum;
+}
+
 static inline int serial_drain(struct serial_dev * dev) {
 	return dev->op->drain(dev->drv);
 }
@@ -261,6 +291,9 @@ int serial_send(struct serial_dev * dev, const void * buf,
 int serial_recv(struct serial_dev * dev, void * buf, 
 				unsigned int len, unsigned int msec);
 
+int serial_sendv(struct serial_dev * dev, const struct serial_iov * iov, 
+				 unsigned int cnt);
+
 int serial_drain(struct serial_dev * dev);
 
 int serial_close(struct serial_dev * dev);
@@ -46,10 +46,28 @@ struct syscfg {
 	} session;
 };
 
+/* Working copy of the configuration, owned by the configuration service.
+   Other threads should read it through syscfg_get(). */
 extern struct syscfg syscfg;
 
+/**
+ * Copy the current configuration into 'cfg' without blocking the 
+ * configuration service. The copy is always consistent, even when the
+ * file is being reloaded. Returns a generation number which changes
+ * whenever a new configuration is published.
+ */
+unsigned int syscfg_get(struct syscfg * cfg);
+
+/* The file is loaded by syscfg_start(), then watched and reloaded when
+   it changes */
 int syscfg_load(void);
+/* Write the configuration, returns once it is on the disk */
 int syscfg_save(void);
+/* Schedule a write, requests close in time are written together by
+   the configuration service */
+int syscfg_save_req(void);
+/* Time a scheduled write waits for more requests, in milliseconds */
+void syscfg_save_delay(unsigned int ms);
 int syscfg_delete(void);
 int syscfg_start(const char * path); 
 int syscfg_stop(void);
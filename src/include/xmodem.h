@@ -35,8 +35,69 @@ enum {
 	FCS_CRC = 1,
 };
 
+/* Transfer options */
+enum {
+	/* YMODEM-G like streaming: data packets are not acknowledged, 
+	   any error cancels the transfer. Use only on reliable links. 
+	   Receiver only. */
+	XMODEM_OPT_STREAM = (1 << 0),
+	/* Resumable YMODEM file transfers: when the receiver already has
+	   a (partial) copy of the file, only the blocks whose CRC32 differ
+	   from the sender's manifest are transferred. Both ends must set it. */
+	XMODEM_OPT_RESUME = (1 << 1),
+	/* Extended packets: up to 4 or 8 KB blocks protected by a CRC32. 
+	   The block size is the smallest one enabled on both ends, legacy 
+	   peers get regular packets. */
+	XMODEM_OPT_BLK4K = (1 << 2),
+	XMODEM_OPT_BLK8K = (1 << 3)
+};
+
+/* Largest packet payload, the extended block sizes above it are 
+   disabled. Must be a multiple of 1024. */
+#ifndef XMODEM_PKT_DATA_MAX
+#define XMODEM_PKT_DATA_MAX 8192
+#endif
+
 #define XMODEM_FNAME_MAX 117
 
+/* Round trip time estimator, all times in milliseconds */
+struct xmodem_rtt {
+	uint32_t srtt; /* smoothed round trip time (x8) */
+	uint32_t rttvar; /* round trip time variation (x4) */
+	uint32_t rto; /* retransmission timeout */
+	uint32_t len; /* packet size of the samples, 0 if not relevant */
+	uint32_t baud; /* line rate, 0 if unknown */
+};
+
+/* Progress of the current file, as reported to the callback */
+struct xmodem_progress {
+	unsigned int bytes; /* data transferred */
+	unsigned int total; /* file size, 0 if unknown */
+	unsigned int rate; /* bytes/s since the previous report */
+	unsigned int avg_rate; /* bytes/s since the start of the file */
+	unsigned int retries; /* packets retransmitted or rejected */
+	uint32_t elapsed_ms;
+	uint32_t srtt_ms; /* smoothed round trip time */
+	uint32_t rto_ms; /* current retransmission timeout */
+	bool done; /* last report of the file */
+};
+
+typedef void (* xmodem_progress_cb_t)(void * arg, 
+									 const struct xmodem_progress * p);
+
+/* Progress accounting */
+struct xmodem_meter {
+	xmodem_progress_cb_t cb;
+	void * arg;
+	uint32_t interval; /* minimum time between reports */
+	uint32_t t0;
+	uint32_t t_last;
+	unsigned int bytes;
+	unsigned int last; /* bytes at the last report */
+	unsigned int total;
+	unsigned int retries;
+};
+
 struct xmodem_recv {
 	struct serial_dev * dev;
 	unsigned int pktno;
@@ -48,13 +109,18 @@ struct xmodem_recv {
 	signed char xfr_mode;
 	unsigned char sync;
 	unsigned char retry;
+	unsigned char opt;
+	unsigned char peer_opt; /* options announced in the YMODEM header */
+
+	struct xmodem_rtt rtt;
+	struct xmodem_meter meter;
 
 	unsigned short data_len;
 	unsigned short data_pos;
 	struct { 
-		unsigned char hdr[3];
-		unsigned char data[1024];
-		unsigned char fcs[2];
+		unsigned char hdr[4];
+		unsigned char data[XMODEM_PKT_DATA_MAX];
+		unsigned char fcs[4];
 	} pkt;
 };
 
@@ -64,19 +130,38 @@ enum {
 	MODE_YMODEM = 2
 };
 
+/* Framing of an outgoing packet, the payload is referenced, not copied */
+struct xmodem_frm {
+	const unsigned char * data;
+	unsigned short len;
+	unsigned char seq;
+	unsigned char hlen;
+	unsigned char flen;
+	unsigned char hdr[4];
+	unsigned char fcs[4];
+};
+
 struct xmodem_send {
 	struct serial_dev * dev;
 
 	unsigned char seq;
 	unsigned char state;
 	unsigned char mode;
+	unsigned char opt;
+	unsigned char hdr; /* the packet on the wire is a YMODEM header */
 	unsigned short data_len;
 	unsigned short data_max;
 
+	struct xmodem_rtt rtt;
+	struct xmodem_meter meter;
+
+	/* The packet on the wire and the next one, framed while
+	   waiting for the acknowledge of the former. */
+	unsigned char frm_idx;
+	struct xmodem_frm frm[2];
+
 	struct { 
-		unsigned char hdr[3];
-		unsigned char data[1024];
-		unsigned char fcs[2];
+		unsigned char data[XMODEM_PKT_DATA_MAX];
 	} pkt;
 };
 
@@ -89,8 +174,33 @@ int xmodem_recv_init(struct xmodem_recv * rx, const struct serial_dev * dev,
 
 int xmodem_recv_loop(struct xmodem_recv * rx, void * data, int len);
 
+/* Receive up to 'size' bytes of the current file into 'buf'. Whole 
+   blocks are written straight to 'buf'. Returns the number of bytes 
+   received, which is less than 'size' only at the end of the file. */
+int xmodem_recv_buf(struct xmodem_recv * rx, void * buf, int size);
+
+/* Receive the current file into 'path'. With YMODEM, 'path' can be NULL
+   to use the name in the header. Returns the file size, 0 at the end
+   of a YMODEM batch. */
+int xmodem_recv_file(struct xmodem_recv * rx, const char * path);
+
+/* Receive a whole YMODEM batch into the directory 'dir', under the names
+   in the headers. The files are preallocated from the header size and 
+   written by a background thread, so the serial side doesn't wait for 
+   the disk. Returns the number of files received. */
+int xmodem_recv_batch(struct xmodem_recv * rx, const char * dir);
+
 int xmodem_recv_cancel(struct xmodem_recv * rx);
 
+int xmodem_recv_opt_set(struct xmodem_recv * rx, unsigned int opt);
+
+/* Call 'cb' with the progress of the file being received, at most once
+   every 'interval_ms' and once at the end of the file. The callback runs
+   in the receiving thread and must return quickly. NULL disables it. */
+int xmodem_recv_progress_set(struct xmodem_recv * rx, 
+							 xmodem_progress_cb_t cb, void * arg,
+							 unsigned int interval_ms);
+
 struct xmodem_recv * xmodem_recv_alloc(void);
 
 void xmodem_recv_free(struct xmodem_recv * rx);
@@ -106,8 +216,20 @@ int xmodem_send_loop(struct xmodem_send * sx, const void * data, int len);
 
 int xmodem_send_eot(struct xmodem_send * sx);
 
+/* Send the file 'path' (header, data and EOT) straight from a memory
+   mapping of it. */
+int xmodem_send_file(struct xmodem_send * sx, const char * path);
+
 int xmodem_send_close(struct xmodem_send * sx);
 
+/* Set the transfer options, after xmodem_send_open() */
+int xmodem_send_opt_set(struct xmodem_send * sx, unsigned int opt);
+
+/* Same as xmodem_recv_progress_set(), for the file being sent */
+int xmodem_send_progress_set(struct xmodem_send * sx, 
+							 xmodem_progress_cb_t cb, void * arg,
+							 unsigned int interval_ms);
+
 int xmodem_send_cancel(struct xmodem_send * sx);
 
 struct xmodem_send * xmodem_send_alloc(void);
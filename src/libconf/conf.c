@@ -35,61 +35,79 @@
  * 
  */
 
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <math.h>
+#include <stdbool.h>
 #include <ctype.h>
 #include <string.h>
-
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+  #include <winsock2.h>
+  #include <windows.h>
+  #include <io.h>
+#else
+  #include <netinet/in.h>
+#endif
 
 #include "conf.h"
 #include "private.h"
+#include "fmap.h"
+#include "crc.h"
 #include "debug.h"
 
-struct conf_type conf_type_tab[] = {
-	{CONF_VOID, "void", void_get, void_set},
-	{CONF_SECTION, "section", void_get, void_set},
-	{CONF_INT, "integer", int_get, int_set},
-	{CONF_UINT, "unsigned", uint_get, uint_set},
-	{CONF_FLOAT, "float", float_get, float_set},
-	{CONF_STRING, "string", string_get, string_set},
-	{CONF_BOOLEAN, "boolean", bool_get, bool_set},
-	{CONF_CHAR, "char", char_get, char_set},
-
-	{CONF_INT8, "int_8", int8_get, int8_set},
-	{CONF_INT8, "uint_8", uint8_get, uint8_set},
-	{CONF_HEX8, "hex_8", hex8_get, hex8_set},
-	{CONF_BIN8, "binary_8", bin8_get, bin8_set},
-	{CONF_OCT8, "octal_8", oct8_get, oct8_set},
-
-	{CONF_INT16, "int_16", int16_get, int16_set},
-	{CONF_INT16, "uint_16", uint16_get, uint16_set},
-	{CONF_HEX16, "hex_16", hex16_get, hex16_set},
-	{CONF_BIN16, "binary_16", bin16_get, bin16_set},
-	{CONF_OCT16, "octal_16", oct16_get, oct16_set},
-
-/*	{CONF_INT32, "int_32", int_get, int_set},
-	{CONF_INT32, "uint_32", uint_get, uint_set}, */
-	{CONF_HEX32, "hex_32", hex32_get, hex32_set},
-	{CONF_BIN32, "binary_32", bin32_get, bin32_set},
-	{CONF_OCT32, "octal_32", oct32_get, oct32_set},
-
-	{CONF_INT64, "int_64", int64_get, int64_set},
-	{CONF_INT64, "uint_64", uint64_get, uint64_set},
-	{CONF_HEX64, "hex_64", hex64_get, hex64_set},
-	{CONF_BIN64, "binary_64", bin64_get, bin64_set},
-	{CONF_OCT64, "octal_64", oct64_get, oct64_set},
-
-	{CONF_IPV4ADDR, "ipv4_address", ipv4addr_get, ipv4addr_set},
-
-	{CONF_RGB, "rgb", rgb_get, rgb_set},
-	{CONF_RGBI, "rgbi", rgbi_get, rgbi_set},
-	{CONF_CYMK, "cymk", cymk_get, cymk_set},
-	{CONF_RATIO, "ratio", ratio_get, ratio_set}
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* Indexed by the type code */
+struct conf_typedesc conf_type_tab[] = {
+	[CONF_VOID] = {CONF_VOID, "void", void_get, void_set, 0},
+	[CONF_SECTION] = {CONF_SECTION, "section", void_get, void_set, 0},
+	[CONF_INT] = {CONF_INT, "integer", int_get, int_set, sizeof(int32_t)},
+	[CONF_UINT] = {CONF_UINT, "unsigned", uint_get, uint_set, sizeof(uint32_t)},
+	[CONF_FLOAT] = {CONF_FLOAT, "float", float_get, float_set, sizeof(double)},
+	[CONF_STRING] = {CONF_STRING, "string", string_get, string_set, 0},
+	[CONF_BOOLEAN] = {CONF_BOOLEAN, "boolean", bool_get, bool_set, sizeof(bool)},
+	[CONF_CHAR] = {CONF_CHAR, "char", char_get, char_set, sizeof(char)},
+
+	[CONF_INT8] = {CONF_INT8, "int_8", int8_get, int8_set, sizeof(int8_t)},
+	[CONF_UINT8] = {CONF_UINT8, "uint_8", uint8_get, uint8_set, sizeof(uint8_t)},
+	[CONF_HEX8] = {CONF_HEX8, "hex_8", hex8_get, hex8_set, sizeof(uint8_t)},
+	[CONF_BIN8] = {CONF_BIN8, "binary_8", bin8_get, bin8_set, sizeof(uint8_t)},
+	[CONF_OCT8] = {CONF_OCT8, "octal_8", oct8_get, oct8_set, sizeof(uint8_t)},
+
+	[CONF_INT16] = {CONF_INT16, "int_16", int16_get, int16_set, sizeof(int16_t)},
+	[CONF_UINT16] = {CONF_UINT16, "uint_16", uint16_get, uint16_set, sizeof(uint16_t)},
+	[CONF_HEX16] = {CONF_HEX16, "hex_16", hex16_get, hex16_set, sizeof(uint16_t)},
+	[CONF_BIN16] = {CONF_BIN16, "binary_16", bin16_get, bin16_set, sizeof(uint16_t)},
+	[CONF_OCT16] = {CONF_OCT16, "octal_16", oct16_get, oct16_set, sizeof(uint16_t)},
+
+	[CONF_INT32] = {CONF_INT32, "int_32", int_get, int_set, sizeof(int32_t)},
+	[CONF_UINT32] = {CONF_UINT32, "uint_32", uint_get, uint_set, sizeof(uint32_t)},
+	[CONF_HEX32] = {CONF_HEX32, "hex_32", hex32_get, hex32_set, sizeof(uint32_t)},
+	[CONF_BIN32] = {CONF_BIN32, "binary_32", bin32_get, bin32_set, sizeof(uint32_t)},
+	[CONF_OCT32] = {CONF_OCT32, "octal_32", oct32_get, oct32_set, sizeof(uint32_t)},
+
+	[CONF_INT64] = {CONF_INT64, "int_64", int64_get, int64_set, sizeof(int64_t)},
+	[CONF_UINT64] = {CONF_UINT64, "uint_64", uint64_get, uint64_set, sizeof(uint64_t)},
+	[CONF_HEX64] = {CONF_HEX64, "hex_64", hex64_get, hex64_set, sizeof(uint64_t)},
+	[CONF_BIN64] = {CONF_BIN64, "binary_64", bin64_get, bin64_set, sizeof(uint64_t)},
+	[CONF_OCT64] = {CONF_OCT64, "octal_64", oct64_get, oct64_set, sizeof(uint64_t)},
+
+	[CONF_IPV4ADDR] = {CONF_IPV4ADDR, "ipv4_address", ipv4addr_get, ipv4addr_set, sizeof(struct in_addr)},
+
+	[CONF_RGB] = {CONF_RGB, "rgb", rgb_get, rgb_set, 0},
+	[CONF_RGBI] = {CONF_RGBI, "rgbi", rgbi_get, rgbi_set, 0},
+	[CONF_CYMK] = {CONF_CYMK, "cymk", cymk_get, cymk_set, 0},
+	[CONF_RATIO] = {CONF_RATIO, "ratio", ratio_get, ratio_set, 0}
 };
 
 int strtokcmp(const char * haystack, const char * needle, 
@@ -123,20 +141,258 @@ int strtokcmp(const char * haystack, const char * needle,
 	return 0;
 }
 
-static conf_entry_t * section_lookup(conf_entry_t * section, 
-									 const char *name);
+/* Maximum number of trees indexed at the same time */
+#define CONF_INDEX_MAX 8
+/* Initial depth of the section stack of write_section() */
+#define CONF_DEPTH_MAX 16
+
+#define CONF_PATH_MAX 512
+
+#define CONF_HASH_INIT 2166136261u
+#define CONF_HASH_PRIME 16777619u
 
-static conf_entry_t * entry_lookup(conf_entry_t * section, const char *name)
+/* One node per entry of the tree. The hash covers the full path of the
+   entry from the root ("section/subsection/key"), so the path of a
+   child is hashed by continuing from its parent's hash. */
+struct conf_node {
+	uint32_t hash;
+	int up; /* parent section node, -1 for the entries of the root */
+	struct conf_entry * entry;
+};
+
+struct conf_index {
+	uint32_t stamp; /* LRU time stamp, 0 means empty slot */
+	struct conf_entry * root;
+	const char * name; /* of the first entry, checked on each lookup */
+	unsigned int cnt;
+	unsigned int mask; /* hash table size - 1 */
+	uint32_t schema; /* hash of the names and types of the tree */
+	struct conf_node * node;
+	int * tab; /* node index + 1, 0 is an empty bucket */
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	uint32_t clock;
+	struct conf_index idx[CONF_INDEX_MAX];
+} confidx = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.clock = 0
+};
+
+/* FNV-1a, continued from 'h' */
+static inline uint32_t conf_hash(uint32_t h, const char * s, unsigned int len)
 {
-	conf_entry_t *entry;
-	int ret;
-	char * rem;
+	while (len--)
+		h = (h ^ (uint8_t)*s++) * CONF_HASH_PRIME;
 
-	if ((name == NULL) || (*name == '\0')) {
-		DBG(DBG_WARNING, "name invalid");
+	return h;
+}
+
+/* The whole tree is indexed, whatever its depth: a lookup missing the
+   index is taken as an entry that doesn't exist. */
+static unsigned int conf_index_count(struct conf_entry * section)
+{
+	struct conf_entry * entry;
+	unsigned int cnt = 0;
+
+	for (entry = section; entry->name != NULL; entry++) {
+		cnt++;
+		if ((entry->type == CONF_TYPE(CONF_SECTION)) && (entry->p != NULL))
+			cnt += conf_index_count((struct conf_entry *)entry->p);
+	}
+
+	return cnt;
+}
+
+/* Compare the paths of two nodes */
+static bool conf_node_equal(struct conf_index * idx, int a, int b)
+{
+	while ((a >= 0) && (b >= 0)) {
+		if (a == b)
+			return true;
+		if (strcmp(idx->node[a].entry->name, idx->node[b].entry->name) != 0)
+			return false;
+		a = idx->node[a].up;
+		b = idx->node[b].up;
+	}
+
+	return (a == b);
+}
+
+/* Check the path of node 'n' against 'key', from the last component
+   up to the root */
+static bool conf_node_match(struct conf_index * idx, int n,
+							const char * key, unsigned int len)
+{
+	for (;;) {
+		const char * name = idx->node[n].entry->name;
+		unsigned int l = strlen(name);
+
+		if ((l > len) || (memcmp(key + len - l, name, l) != 0))
+			return false;
+		len -= l;
+
+		if ((n = idx->node[n].up) < 0)
+			return (len == 0);
+
+		if ((len == 0) || (key[--len] != '/'))
+			return false;
+	}
+}
+
+static void conf_index_insert(struct conf_index * idx, int n)
+{
+	unsigned int i = idx->node[n].hash & idx->mask;
+	int k;
+
+	while ((k = idx->tab[i]) != 0) {
+		/* on duplicated names the first one wins, as in a linear scan */
+		if ((idx->node[k - 1].hash == idx->node[n].hash) &&
+			conf_node_equal(idx, k - 1, n))
+			return;
+		i = (i + 1) & idx->mask;
+	}
+
+	idx->tab[i] = n + 1;
+}
+
+static void conf_index_fill(struct conf_index * idx,
+							struct conf_entry * section, int up)
+{
+	struct conf_entry * entry;
+	uint32_t h;
+	int n;
+
+	for (entry = section; entry->name != NULL; entry++) {
+		if (up < 0)
+			h = CONF_HASH_INIT;
+		else
+			h = (idx->node[up].hash ^ '/') * CONF_HASH_PRIME;
+
+		n = idx->cnt++;
+		idx->node[n].hash = conf_hash(h, entry->name, strlen(entry->name));
+		idx->node[n].up = up;
+		idx->node[n].entry = entry;
+		conf_index_insert(idx, n);
+
+		/* a change in the layout of the tree changes the schema hash */
+		idx->schema = conf_hash(idx->schema, (char *)&up, sizeof(int));
+		idx->schema = conf_hash(idx->schema, entry->name,
+								strlen(entry->name) + 1);
+		idx->schema = conf_hash(idx->schema, entry->type->t_name,
+								strlen(entry->type->t_name) + 1);
+		idx->schema = conf_hash(idx->schema, (char *)&entry->len,
+								sizeof(unsigned int));
+
+		if ((entry->type == CONF_TYPE(CONF_SECTION)) && (entry->p != NULL))
+			conf_index_fill(idx, (struct conf_entry *)entry->p, n);
+	}
+}
+
+static void conf_index_release(struct conf_index * idx)
+{
+	free(idx->node);
+	free(idx->tab);
+	memset(idx, 0, sizeof(struct conf_index));
+}
+
+/* Return the index of the tree, building it if needed. Must be called
+   with the mutex locked. The index is keyed by the address of the root,
+   a tree freed and replaced by another at the same address is only 
+   caught if its first entry changed, see conf_index_drop(). */
+static struct conf_index * conf_index_get(struct conf_entry * root)
+{
+	struct conf_index * lru;
+	struct conf_index * idx;
+	unsigned int size;
+	unsigned int cnt;
+	int i;
+
+	lru = &confidx.idx[0];
+	for (i = 0; i < CONF_INDEX_MAX; ++i) {
+		idx = &confidx.idx[i];
+		if ((idx->stamp != 0) && (idx->root == root)) {
+			if (idx->name == root->name) {
+				idx->stamp = ++confidx.clock;
+				return idx;
+			}
+			DBG(DBG_WARNING, "root 0x%p: stale index", root);
+			lru = idx;
+			break;
+		}
+		if (idx->stamp < lru->stamp)
+			lru = idx;
+	}
+
+	idx = lru;
+	if (idx->stamp != 0)
+		conf_index_release(idx);
+
+	/* keep the table at most half full */
+	cnt = conf_index_count(root);
+	for (size = 16; size < (2 * cnt); size <<= 1);
+
+	idx->node = malloc(cnt * sizeof(struct conf_node));
+	idx->tab = calloc(size, sizeof(int));
+	if ((idx->node == NULL) || (idx->tab == NULL)) {
+		DBG(DBG_WARNING, "malloc() failed!");
+		conf_index_release(idx);
 		return NULL;
 	}
 
+	idx->root = root;
+	idx->name = root->name;
+	idx->mask = size - 1;
+	idx->schema = CONF_HASH_INIT;
+	idx->cnt = 0;
+	conf_index_fill(idx, root, -1);
+	idx->stamp = ++confidx.clock;
+
+	DBG(DBG_INFO, "root 0x%p: %d entries", root, cnt);
+
+	return idx;
+}
+
+void conf_index_drop(struct conf_entry * root)
+{
+	int i;
+
+	pthread_mutex_lock(&confidx.mutex);
+
+	for (i = 0; i < CONF_INDEX_MAX; ++i) {
+		if ((confidx.idx[i].stamp != 0) && (confidx.idx[i].root == root))
+			conf_index_release(&confidx.idx[i]);
+	}
+
+	pthread_mutex_unlock(&confidx.mutex);
+}
+
+/* Return the node of the entry 'key', -1 if not found */
+static int conf_index_find(struct conf_index * idx, const char * key)
+{
+	unsigned int len = strlen(key);
+	uint32_t h = conf_hash(CONF_HASH_INIT, key, len);
+	unsigned int i = h & idx->mask;
+	int k;
+
+	while ((k = idx->tab[i]) != 0) {
+		if ((idx->node[k - 1].hash == h) &&
+			conf_node_match(idx, k - 1, key, len))
+			return k - 1;
+		i = (i + 1) & idx->mask;
+	}
+
+	return -1;
+}
+
+static struct conf_entry * entry_scan(struct conf_entry * section,
+									  const char *name)
+{
+	struct conf_entry *entry;
+	int ret;
+	char * rem;
+
 	if ((entry = section) == NULL) {
 		DBG(DBG_WARNING, "section invalid");
 		return NULL;
@@ -153,7 +409,7 @@ static conf_entry_t * entry_lookup(conf_entry_t * section, const char *name)
 				return NULL;
 			}
 
-			return entry_lookup((conf_entry_t *)entry->p, rem);
+			return entry_scan((struct conf_entry *)entry->p, rem);
 		}
 		entry++;
 	}
@@ -162,9 +418,63 @@ static conf_entry_t * entry_lookup(conf_entry_t * section, const char *name)
 	return NULL;
 }
 
-static conf_entry_t * section_lookup(conf_entry_t * section, const char *name)
+/*
+ * Look up an entry by its path ("section/subsection/key") relative to
+ * 'section'. The first lookup on a tree builds a hash index of all its
+ * paths, the tree falls back to a linear scan if it can't be indexed.
+ * If 'id' is not NULL the entry's node in the index is stored there, -1
+ * if the tree is not indexed.
+ */
+static struct conf_entry * entry_find(struct conf_entry * section, 
+									  const char *name, int * id)
+{
+	struct conf_index * idx;
+	struct conf_entry * entry;
+	int n;
+
+	if (id != NULL)
+		*id = -1;
+
+	if ((name == NULL) || (*name == '\0')) {
+		DBG(DBG_WARNING, "name invalid");
+		return NULL;
+	}
+
+	if (section == NULL) {
+		DBG(DBG_WARNING, "section invalid");
+		return NULL;
+	}
+
+	pthread_mutex_lock(&confidx.mutex);
+
+	if ((idx = conf_index_get(section)) == NULL) {
+		pthread_mutex_unlock(&confidx.mutex);
+		return entry_scan(section, name);
+	}
+
+	if ((n = conf_index_find(idx, name)) < 0)
+		entry = NULL;
+	else
+		entry = idx->node[n].entry;
+
+	pthread_mutex_unlock(&confidx.mutex);
+
+	if (entry == NULL)
+		DBG(DBG_WARNING, "name not found");
+	else if (id != NULL)
+		*id = n;
+
+	return entry;
+}
+
+static struct conf_entry * entry_lookup(struct conf_entry * section, const char *name)
 {
-	conf_entry_t * entry;
+	return entry_find(section, name, NULL);
+}
+
+static struct conf_entry * section_lookup(struct conf_entry * section, const char *name)
+{
+	struct conf_entry * entry;
 
 	DBG(DBG_INFO, "loking for \"%s\" at section 0x%p", name, section);
 
@@ -176,12 +486,72 @@ static conf_entry_t * section_lookup(conf_entry_t * section, const char *name)
 		return NULL;
 	}
 
-	return (conf_entry_t *) entry->p;
+	return (struct conf_entry *) entry->p;
 }
 
-int conf_entry_set(conf_entry_t * section, const char *name, const char *value)
+/* Size of the entry's value, 0 if it can't be copied */
+static unsigned int conf_value_len(struct conf_entry * entry)
+{
+	if (entry->p == NULL)
+		return 0;
+
+	if (entry->type == CONF_TYPE(CONF_STRING))
+		return strlen((char *)entry->p) + 1;
+
+	return entry->type->t_size;
+}
+
+/* Count of the changes made by conf_entry_set(), never 0. A dirty 
+   entry holds the count of its last change. */
+static uint32_t conf_change = 1;
+
+/* Clear the entries changed up to 'mark', all of them if 'mark' is 0 */
+static void conf_dirty_clear(struct conf_entry * section, uint32_t mark)
 {
-	conf_entry_t *entry;
+	struct conf_entry * entry;
+
+	for (entry = section; entry->name != NULL; entry++) {
+		if ((mark == 0) || ((int32_t)(entry->dirty - mark) <= 0))
+			entry->dirty = 0;
+		if ((entry->type == CONF_TYPE(CONF_SECTION)) && (entry->p != NULL))
+			conf_dirty_clear((struct conf_entry *)entry->p, mark);
+	}
+}
+
+uint32_t conf_dirty_mark(void)
+{
+	return __atomic_load_n(&conf_change, __ATOMIC_RELAXED);
+}
+
+void conf_dirty_commit(struct conf_entry * root, uint32_t mark)
+{
+	if ((root != NULL) && (mark != 0))
+		conf_dirty_clear(root, mark);
+}
+
+bool conf_dirty(struct conf_entry * section)
+{
+	struct conf_entry * entry;
+
+	if (section == NULL)
+		return false;
+
+	for (entry = section; entry->name != NULL; entry++) {
+		if (entry->dirty != 0)
+			return true;
+		if ((entry->type == CONF_TYPE(CONF_SECTION)) && 
+			conf_dirty((struct conf_entry *)entry->p))
+			return true;
+	}
+
+	return false;
+}
+
+int conf_entry_set(struct conf_entry * section, const char *name, const char *value)
+{
+	struct conf_entry *entry;
+	uint8_t prev[256];
+	unsigned int len;
 
 	entry = entry_lookup(section, name);
 	if (entry == NULL)
@@ -190,16 +560,31 @@ int conf_entry_set(conf_entry_t * section, const char *name, const char *value)
 	/* Assuming NULL set as a stub configuration. */
 	if (value == NULL)
 		value = NULL_STRING;
+
+	/* keep the old value to tell whether it changes */
+	if ((len = conf_value_len(entry)) > sizeof(prev))
+		len = 0;
+	if (len > 0)
+		memcpy(prev, entry->p, len);
 	
-	if (entry->type->t_set(entry, value))
+	if (entry->type->t_set(entry, value)) {
+		if ((len == 0) || (conf_value_len(entry) != len) ||
+			(memcmp(prev, entry->p, len) != 0)) {
+			uint32_t n;
+
+			while ((n = __atomic_add_fetch(&conf_change, 1, 
+										   __ATOMIC_RELAXED)) == 0);
+			entry->dirty = n;
+		}
 		return 0;
+	}
 
 	return -1;
 }
 
-int conf_entry_get(conf_entry_t * section, const char *name, char *value)
+int conf_entry_get(struct conf_entry * section, const char *name, char *value)
 {
-	conf_entry_t *entry;
+	struct conf_entry *entry;
 
 	if (value == NULL)
 		return -1;
@@ -218,276 +603,898 @@ int conf_entry_get(conf_entry_t * section, const char *name, char *value)
 	return -1;
 }
 
-int conf_parse(uint8_t * buf, conf_entry_t * root)
+/* Replace the file 'path' with 'len' bytes of 'buf'. The data goes to a
+   temporary file, which is flushed to the disk and then renamed over
+   the old one, so a crash leaves either the old or the new contents. */
+static int conf_file_write(const char * path, const void * buf, size_t len)
 {
-	conf_entry_t * section;
-	conf_entry_t * entry;
-	uint8_t * cp = buf;
-	char token[512];
-	int skip_section = 0;
-	int count = 0;;
-	int line = 0;
-	int pos;
-	int c;
+	char tmp[CONF_PATH_MAX + 4];
+	const uint8_t * cp = buf;
+	int ret = 0;
+	int fd;
+	int n;
 
-	section = root;
-
-	for (;;) {
-		/* ---------------------------------------------------------
-		   locate the next section, ignoring empty and comment lines */
-		line++;
-		DBG(DBG_MSG, "line %3d", line);
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+		return -1;
 
-		/* skip spaces */
-		do { c = *cp++; } while ((c == ' ') || (c == '\t'));
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644)) < 0) {
+		DBG(DBG_WARNING, "open(\"%s\"): %s.", tmp, strerror(errno));
+		return -1;
+	}
 
-		if (c == '\0')
+	while (len > 0) {
+		if ((n = write(fd, cp, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -1;
 			break;
+		}
+		cp += n;
+		len -= n;
+	}
 
-		if (c == '\n') {
-			DBG(DBG_MSG, "empty line");
-			continue;
+#ifdef _WIN32
+	if ((ret == 0) && (_commit(fd) < 0))
+		ret = -1;
+#else
+	if ((ret == 0) && (fsync(fd) < 0))
+		ret = -1;
+#endif
+
+	if ((close(fd) < 0) || (ret < 0)) {
+		DBG(DBG_WARNING, "\"%s\": %s.", tmp, strerror(errno));
+		remove(tmp);
+		return -1;
+	}
+
+#ifdef _WIN32
+	if (!MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING | 
+					 MOVEFILE_WRITE_THROUGH)) {
+#else
+	if (rename(tmp, path) < 0) {
+#endif
+		DBG(DBG_WARNING, "rename(\"%s\") fail!", tmp);
+		remove(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* ---------------------------------------------------------------------
+   Compiled snapshot
+
+   After a text file is parsed, the values it set are written to
+   "<path>.snap" as a list of records (entry node, length, value bytes)
+   behind a header. The next conf_load() of an unchanged file copies the
+   values back instead of parsing the text. The snapshot is only used if
+   the layout of the tree (schema hash) and the modification time, size
+   and CRC32 of the text file match the ones it was made from. The time
+   and size alone miss an edit made within the timestamp resolution, or
+   a file restored with its old time.
+   --------------------------------------------------------------------- */
+
+#define CONF_SNAP_MAGIC 0x504e5343 /* "CSNP" */
+#define CONF_SNAP_VERSION 2
+
+struct conf_snap_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t hlen; /* header length */
+	uint32_t schema; /* schema hash of the tree */
+	uint32_t cnt; /* number of records */
+	uint32_t size; /* length of the records */
+	uint32_t crc; /* CRC32 of the records */
+	uint32_t tcrc; /* CRC32 of the text file */
+	int64_t mtime; /* text file modification time (ns) */
+	int64_t fsize; /* text file size */
+};
+
+struct conf_snap_rec {
+	uint32_t id; /* entry node in the index */
+	uint32_t len; /* length of the value that follows */
+};
+
+/* Records collected while parsing, after room for the header */
+struct conf_snap {
+	bool valid; /* false if some value can't be recorded */
+	unsigned int cnt;
+	unsigned int len;
+	unsigned int size;
+	uint8_t * buf;
+};
+
+static void conf_snap_add(struct conf_snap * snap, int id,
+						  struct conf_entry * entry)
+{
+	struct conf_snap_rec rec;
+	unsigned int len;
+
+	if (!snap->valid)
+		return;
+
+	if ((id < 0) || ((len = conf_value_len(entry)) == 0)) {
+		DBG(DBG_INFO, "'%s' can't be recorded", entry->name);
+		snap->valid = false;
+		return;
+	}
+
+	if (snap->len + sizeof(rec) + len > snap->size) {
+		unsigned int size = snap->size ? snap->size : 4096;
+		uint8_t * buf;
+
+		while (snap->len + sizeof(rec) + len > size)
+			size *= 2;
+
+		if ((buf = realloc(snap->buf, size)) == NULL) {
+			snap->valid = false;
+			return;
 		}
+		snap->buf = buf;
+		snap->size = size;
+	}
+
+	rec.id = id;
+	rec.len = len;
+	memcpy(&snap->buf[snap->len], &rec, sizeof(rec));
+	memcpy(&snap->buf[snap->len + sizeof(rec)], entry->p, len);
+	snap->len += sizeof(rec) + len;
+	snap->cnt++;
+}
+
+/* ---------------------------------------------------------------------
+   Streaming parser
+   --------------------------------------------------------------------- */
+
+/* Store 'len' bytes of 's' at 'pos' of the growable buffer 'buf',
+   followed by a '\0'. Returns the copy, or NULL if out of memory. */
+static char * conf_buf_put(char ** buf, unsigned int * size,
+						   unsigned int pos, const char * s, unsigned int len)
+{
+	if (pos + len + 1 > *size) {
+		unsigned int n = *size ? *size : 256;
+		char * cp;
+
+		while (pos + len + 1 > n)
+			n *= 2;
+
+		if ((cp = realloc(*buf, n)) == NULL)
+			return NULL;
+		*buf = cp;
+		*size = n;
+	}
 
-		if (c == '#') {
-			DBG(DBG_MSG, "comment");
-			do {
-				c = *cp++;
-				if (c == '\0')
-					goto end;
-			} while (c != '\n');
-			continue;	
+	memcpy(*buf + pos, s, len);
+	(*buf)[pos + len] = '\0';
+
+	return *buf + pos;
+}
+
+/* Record a syntax error at the position 'cp' of the line 's' */
+static int conf_parser_error(struct conf_parser * p, const char * s,
+							 const char * cp, const char * msg)
+{
+	p->col = cp - s + 1;
+	p->err = msg;
+	DBG(DBG_ERROR, "line %d, column %d: %s", p->line, p->col, msg);
+
+	return -1;
+}
+
+#define SKIP_SPACES(CP, END) \
+	while (((CP) != (END)) && ((*(CP) == ' ') || (*(CP) == '\t'))) (CP)++
+
+/* Parse one line, without its '\n'. It is either a slice of the input
+   or the line assembled in p->line. */
+static int conf_parser_line(struct conf_parser * p, const char * s,
+							unsigned int len)
+{
+	struct conf_entry * entry;
+	const char * name;
+	const char * end;
+	const char * cp;
+	char * val;
+	unsigned int n;
+	int id;
+
+	p->line++;
+
+	if ((len > 0) && (s[len - 1] == '\r'))
+		len--;
+	end = s + len;
+
+	cp = s;
+	SKIP_SPACES(cp, end);
+
+	/* empty line or comment */
+	if ((cp == end) || (*cp == '#'))
+		return 0;
+
+	if (*cp == '[') {
+		cp++;
+		SKIP_SPACES(cp, end);
+
+		/* section name must start with a letter */
+		if ((cp == end) || !isalpha((unsigned char)*cp))
+			return conf_parser_error(p, s, cp, 
+									 "expecting alphabetic character");
+
+		name = cp;
+		while ((cp != end) && (isalnum((unsigned char)*cp) || 
+							   (*cp == '_') || (*cp == '/')))
+			cp++;
+		n = cp - name;
+
+		SKIP_SPACES(cp, end);
+		if ((cp == end) || (*cp != ']'))
+			return conf_parser_error(p, s, cp, "expecting ]");
+
+		cp++;
+		SKIP_SPACES(cp, end);
+		if ((cp != end) && (*cp != '#'))
+			return conf_parser_error(p, s, cp, "expecting EOL");
+
+		if (conf_buf_put(&p->path, &p->path_size, 0, name, n) == NULL)
+			return conf_parser_error(p, s, name, "out of memory");
+
+		DBG(DBG_MSG, "section_lookup: '%s'", p->path);
+
+		/* entries are looked up by their full path */
+		if ((p->section = section_lookup(p->root, p->path)) == NULL) {
+			DBG(DBG_WARNING, "invalid section: '%s'", p->path);
+		} else {
+			p->path[n] = '/';
+			p->path_len = n + 1;
 		}
 
-		if (c == '[') {
-			skip_section = 0;
+		return 0;
+	}
 
-			/* skip spaces */
-			do { c = *cp++; } while ((c == ' ') || (c == '\t'));
+	/* unknown section, skiping */
+	if (p->section == NULL)
+		return 0;
 
-			/* section name must start with a letter */
-			if (!isalpha(c)) {
-				DBG(DBG_ERROR, "line %d: expecting alphabetic character", 
-					line);
-				return -1;
-			}
+	/* entry name must start with a letter */
+	if (!isalpha((unsigned char)*cp))
+		return conf_parser_error(p, s, cp, "expecting alphabetic character");
+
+	name = cp;
+	while ((cp != end) && (isalnum((unsigned char)*cp) || (*cp == '.') || 
+						   (*cp == '-') || (*cp == '_')))
+		cp++;
+	n = cp - name;
+
+	SKIP_SPACES(cp, end);
+	if ((cp == end) || (*cp != '='))
+		return conf_parser_error(p, s, cp, "expecting =");
+	cp++;
 
-			/* read the section name */
-			pos = 0;
-			do { 
-				token[pos++] = c;	
-				c = *cp++; 
-			} while (isalnum(c) || (c == '_') || (c == '/'));
-			token[pos] = '\0';	
+	if (conf_buf_put(&p->path, &p->path_size, p->path_len, name, n) == NULL)
+		return conf_parser_error(p, s, name, "out of memory");
 
-			/* skip spaces, if any */
-			while ((c == ' ') || (c == '\t')) { c = *cp++; };
+	if ((entry = entry_find(p->root, p->path, &id)) == NULL) {
+		DBG(DBG_WARNING, "invalid entry: '%s'", p->path);
+		return 0;
+	}
+
+	SKIP_SPACES(cp, end);
+
+	/* The value is the rest of the line. The codecs take a string, so
+	   it is terminated in place if the line is our own copy. */
+	if (s == p->buf) {
+		val = p->buf + (cp - s);
+		val[end - cp] = '\0';
+	} else if ((val = conf_buf_put(&p->buf, &p->buf_size, 0, cp, 
+								   end - cp)) == NULL)
+		return conf_parser_error(p, s, cp, "out of memory");
+
+	if (entry->type->t_set(entry, val)) {
+		if (p->snap != NULL)
+			conf_snap_add(p->snap, id, entry);
+		p->cnt++;
+	} else
+		DBG(DBG_WARNING, "line %d: '%s': decode error.", p->line, 
+			entry->name);
+
+	return 0;
+}
 
-			if (c != ']') {
-				DBG(DBG_ERROR, "line %d: expecting ]", line);
+void conf_parser_init(struct conf_parser * p, struct conf_entry * root)
+{
+	memset(p, 0, sizeof(struct conf_parser));
+	p->root = root;
+	p->section = root;
+}
+
+int conf_parser_feed(struct conf_parser * p, const void * data, size_t len)
+{
+	const char * cp = data;
+	const char * end = cp + len;
+	const char * nl;
+
+	if (p->err != NULL)
+		return -1;
+
+	while (cp != end) {
+		if ((nl = memchr(cp, '\n', end - cp)) == NULL) {
+			/* keep the partial line for the next chunk */
+			if (conf_buf_put(&p->buf, &p->buf_size, p->buf_len, 
+							 cp, end - cp) == NULL) {
+				p->err = "out of memory";
 				return -1;
 			}
+			p->buf_len += end - cp;
+			break;
+		}
 
-			/* skip spaces */
-			do { c = *cp++; } while ((c == ' ') || (c == '\t'));
-
-			if (c == '#') {
-				/* ignore to the end of line */
-				DBG(DBG_MSG, "comment");
-				do {
-					c = *cp++;
-					if (c == '\0')
-						goto end;
-				} while (c != '\n');
-			} 
-
-			if (c != '\n') {
-				DBG(DBG_ERROR, "line %d: expecting EOL", line);
+		if (p->buf_len == 0) {
+			/* the whole line is in the chunk */
+			if (conf_parser_line(p, cp, nl - cp) < 0)
+				return -1;
+		} else {
+			if (conf_buf_put(&p->buf, &p->buf_size, p->buf_len, 
+							 cp, nl - cp) == NULL) {
+				p->err = "out of memory";
 				return -1;
 			}
+			len = p->buf_len + (nl - cp);
+			p->buf_len = 0;
+			if (conf_parser_line(p, p->buf, len) < 0)
+				return -1;
+		}
 
-			DBG(DBG_MSG, "section_lookup: '%s'", token);
+		cp = nl + 1;
+	}
 
-			if ((section = section_lookup(root, token)) == NULL) {
-				DBG(DBG_WARNING, "invalid section: '%s'", token);
-				skip_section = 1;
-			}
-			continue;
-		}
+	return 0;
+}
 
-		if (skip_section) {
-			DBG(DBG_MSG, "skiping");
-			do {
-				c = *cp++;
-				if (c == '\0')
-					goto end;
-			} while (c != '\n');
-			continue;	
-		}
-			
-		/* ---------------------------------------------------------
-		   read the section content 
-		   -------------------------------------------------------- */
-
-		/* entry name must start with a letter */
-		if (!isalpha(c)) {
-			DBG(DBG_ERROR, "line %d: expecting alphabetic character", line);
-			return -1;
-		}
+int conf_parser_end(struct conf_parser * p)
+{
+	int ret;
 
-		/* read the entry name */
-		pos = 0;
-		do { 
-			token[pos++] = c;	
-			c = *cp++; 
-		} while (isalnum(c) || (c == '.') || (c == '-') || (c == '_'));
-		token[pos] = '\0';	
+	/* the last line may have no '\n' */
+	if ((p->err == NULL) && (p->buf_len > 0)) {
+		unsigned int len = p->buf_len;
 
-		/* skip spaces, if any */
-		while ((c == ' ') || (c == '\t')) { c = *cp++; };
+		p->buf_len = 0;
+		conf_parser_line(p, p->buf, len);
+	}
 
-		if (c != '=') {
-			DBG(DBG_ERROR, "line %d: expecting =", line);
-			return -1;
+	ret = (p->err == NULL) ? (int)p->cnt : -1;
+
+	free(p->buf);
+	free(p->path);
+	p->buf = NULL;
+	p->buf_size = 0;
+	p->path = NULL;
+	p->path_size = 0;
+
+	return ret;
+}
+
+int conf_parse(const uint8_t * buf, size_t len, struct conf_entry * root)
+{
+	struct conf_parser p;
+
+	conf_parser_init(&p, root);
+	conf_parser_feed(&p, buf, len);
+
+	return (conf_parser_end(&p) < 0) ? -1 : 0;
+}
+
+static int64_t conf_mtime(const struct stat * st)
+{
+#ifdef __linux__
+	return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+#else
+	return (int64_t)st->st_mtime * 1000000000LL;
+#endif
+}
+
+/* Check a snapshot record against the tree. Returns the entry to copy
+   the value to, NULL if it doesn't fit. */
+static struct conf_entry * conf_snap_check(struct conf_index * idx,
+										   struct conf_snap_rec * rec,
+										   const uint8_t * val)
+{
+	struct conf_entry * entry;
+
+	if (rec->id >= idx->cnt)
+		return NULL;
+
+	entry = idx->node[rec->id].entry;
+	if (entry->p == NULL)
+		return NULL;
+
+	if (entry->type == CONF_TYPE(CONF_STRING)) {
+		if ((rec->len == 0) || (val[rec->len - 1] != '\0'))
+			return NULL;
+		/* string_set() keeps up to 'len' characters */
+		if ((entry->len > 0) && (rec->len > entry->len + 1))
+			return NULL;
+		return entry;
+	}
+
+	if ((entry->type->t_size == 0) || (rec->len != entry->type->t_size))
+		return NULL;
+
+	return entry;
+}
+
+static int conf_snap_load(const char * path, const struct stat * st,
+						  uint32_t tcrc, struct conf_entry * root)
+{
+	char fname[CONF_PATH_MAX];
+	struct conf_snap_hdr hdr;
+	struct conf_snap_rec rec;
+	struct conf_entry * entry;
+	struct conf_index * idx;
+	const uint8_t * cp;
+	const uint8_t * end;
+	uint8_t * ptr;
+	size_t size;
+	unsigned int i;
+	int pass;
+	int ret = -1;
+	int fd;
+
+	if (snprintf(fname, sizeof(fname), "%s.snap", path) >= (int)sizeof(fname))
+		return -1;
+
+	/* not having a snapshot is not an error */
+	if ((fd = open(fname, O_RDONLY | O_BINARY)) < 0)
+		return -1;
+
+	ptr = fmap_fd(fd, &size);
+	close(fd);
+	if (ptr == NULL)
+		return -1;
+
+	if (size < sizeof(hdr))
+		goto unmap;
+
+	memcpy(&hdr, ptr, sizeof(hdr));
+	if ((hdr.magic != CONF_SNAP_MAGIC) || (hdr.version != CONF_SNAP_VERSION) ||
+		(hdr.hlen != sizeof(hdr)) || (hdr.size != size - sizeof(hdr))) {
+		DBG(DBG_WARNING, "\"%s\": invalid header!", fname);
+		goto unmap;
+	}
+
+	if ((hdr.mtime != conf_mtime(st)) || (hdr.fsize != st->st_size) ||
+		(hdr.tcrc != tcrc)) {
+		DBG(DBG_INFO, "\"%s\" changed", path);
+		goto unmap;
+	}
+
+	if ((uint32_t)~crc32(~0UL, ptr + sizeof(hdr), hdr.size) != hdr.crc) {
+		DBG(DBG_WARNING, "\"%s\": CRC error!", fname);
+		goto unmap;
+	}
+
+	pthread_mutex_lock(&confidx.mutex);
+
+	if (((idx = conf_index_get(root)) == NULL) || (idx->schema != hdr.schema)) {
+		pthread_mutex_unlock(&confidx.mutex);
+		DBG(DBG_INFO, "schema changed");
+		goto unmap;
+	}
+
+	/* check all the records before changing any value */
+	end = ptr + size;
+	for (pass = 0; pass < 2; ++pass) {
+		cp = ptr + sizeof(hdr);
+		for (i = 0; i < hdr.cnt; ++i) {
+			if ((size_t)(end - cp) < sizeof(rec))
+				break;
+			memcpy(&rec, cp, sizeof(rec));
+			cp += sizeof(rec);
+			if ((rec.len > (size_t)(end - cp)) ||
+				((entry = conf_snap_check(idx, &rec, cp)) == NULL))
+				break;
+			if (pass == 1)
+				memcpy(entry->p, cp, rec.len);
+			cp += rec.len;
 		}
 
-		if ((entry = entry_lookup(section, token)) == NULL) {
-			DBG(DBG_WARNING, "invalid entry: '%s.%s'", section->name, token);
-			/* ignore to the end of line */
-			do {
-				c = *cp++;
-				if (c == '\0')
-					goto end;
-			} while (c != '\n');
-			continue;
+		if ((i != hdr.cnt) || (cp != end)) {
+			DBG(DBG_WARNING, "\"%s\": record %d invalid!", fname, i);
+			break;
 		}
+	}
 
-		/* skip spaces */
-		do { c = *cp++; } while ((c == ' ') || (c == '\t'));
+	pthread_mutex_unlock(&confidx.mutex);
 
-		/* read the entry value */
-		pos = 0;
-		do { 
-			token[pos++] = c;	
-			c = *cp++; 
-		} while ((c != '\n') && (c != '\0'));
-		token[pos] = '\0';	
+	if (pass == 2) {
+		DBG(DBG_INFO, "\"%s\": %d values", fname, hdr.cnt);
+		ret = 0;
+	}
 
-		/* set the variable */
-		if (entry->type->t_set(entry, token))
-			count++;
-		else
-			DBG(DBG_WARNING, "line %d: '%s': decode error.", line, entry->name);
+unmap:
+	funmap(ptr, size);
+
+	return ret;
+}
+
+static int conf_snap_save(const char * path, const struct stat * st,
+						  uint32_t tcrc, struct conf_entry * root, 
+						  struct conf_snap * snap)
+{
+	char fname[CONF_PATH_MAX];
+	struct conf_snap_hdr hdr;
+	struct conf_index * idx;
+
+	if (snap->buf == NULL)
+		return -1;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = CONF_SNAP_MAGIC;
+	hdr.version = CONF_SNAP_VERSION;
+	hdr.hlen = sizeof(hdr);
+	hdr.cnt = snap->cnt;
+	hdr.size = snap->len - sizeof(hdr);
+	hdr.crc = ~crc32(~0UL, snap->buf + sizeof(hdr), hdr.size);
+	hdr.tcrc = tcrc;
+	hdr.mtime = conf_mtime(st);
+	hdr.fsize = st->st_size;
+
+	pthread_mutex_lock(&confidx.mutex);
+	if ((idx = conf_index_get(root)) != NULL)
+		hdr.schema = idx->schema;
+	pthread_mutex_unlock(&confidx.mutex);
+
+	if (idx == NULL)
+		return -1;
+
+	if (snprintf(fname, sizeof(fname), "%s.snap", path) >= (int)sizeof(fname))
+		return -1;
+
+	memcpy(snap->buf, &hdr, sizeof(hdr));
+
+	return conf_file_write(fname, snap->buf, snap->len);
+}
+
+int conf_load_fd(int fd, struct conf_entry * root)
+{
+	struct conf_parser p;
+	char buf[4096];
+	int n;
+
+	conf_parser_init(&p, root);
+
+	while ((n = read(fd, buf, sizeof(buf))) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			DBG(DBG_ERROR, "read(): %s.", strerror(errno));
+			conf_parser_end(&p);
+			return -1;
+		}
+		if (conf_parser_feed(&p, buf, n) < 0)
+			break;
 	}
-end:
-	return 0;
+
+	return (conf_parser_end(&p) < 0) ? -1 : 0;
 }
 
-int conf_load(const char * path, conf_entry_t * root)
+int conf_load(const char * path, struct conf_entry * root)
 {
-	uint8_t * buf;
-	FILE * f;
-	int size;
+	struct conf_parser p;
+	struct conf_snap snap;
+	struct stat st;
+	uint32_t tcrc;
+	size_t size;
+	void * buf;
+	int ret;
+	int fd;
 
-	/* open the file for reading */
-	if (!(f = fopen(path, "r"))) {
-		DBG(DBG_ERROR, "fopen(\"%s\", \"r\") fail!", path);
+	if ((fd = open(path, O_RDONLY | O_BINARY)) < 0) {
+		DBG(DBG_ERROR, "open(\"%s\") fail!", path);
 		return -1;
 	}
 
-	/* get the file's size */
-	fseek(f, 0, SEEK_END);
-	size = ftell(f);
-	rewind(f);
-	/* alloc memory for reading */
-	buf = (uint8_t *)calloc(1, size + 1);
+	if (fstat(fd, &st) < 0) {
+		DBG(DBG_ERROR, "fstat() fail!");
+		close(fd);
+		return -1;
+	}
 
-	/* read the file */
-	if ((fread(buf, size, 1, f)) < 1) {
-		DBG(DBG_ERROR, "fread() fail!");
+	buf = fmap_fd(fd, &size);
+	close(fd);
+	if (buf == NULL) {
+		DBG(DBG_ERROR, "fmap_fd(\"%s\") fail!", path);
 		return -1;
 	}
 
-	/* close the file */
-	fclose(f);
-	/* null terminate the string */
-	buf[size] = '\0';
+	/* the snapshot must have been made from this very text */
+	tcrc = ~crc32(~0UL, buf, size);
 
-	return conf_parse(buf, root);
+	if (conf_snap_load(path, &st, tcrc, root) == 0) {
+		funmap(buf, size);
+		conf_dirty_clear(root, 0);
+		return 0;
+	}
+
+	memset(&snap, 0, sizeof(snap));
+	snap.valid = true;
+	snap.len = sizeof(struct conf_snap_hdr);
+
+	conf_parser_init(&p, root);
+	p.snap = &snap;
+	conf_parser_feed(&p, buf, size);
+	ret = (conf_parser_end(&p) < 0) ? -1 : 0;
+	funmap(buf, size);
+
+	if (ret == 0) {
+		conf_dirty_clear(root, 0);
+		if (snap.valid)
+			conf_snap_save(path, &st, tcrc, root, &snap);
+	}
+	free(snap.buf);
+
+	return ret;
 }
 
-/*
-* Recursive writes a section into a stream
-*
-*/
-static int write_section(FILE * f, conf_entry_t * section, char * branch)
+/* Growable output buffer */
+struct conf_out {
+	char * buf;
+	unsigned int len;
+	unsigned int size;
+	bool err; /* out of memory */
+};
+
+static int conf_out_grow(struct conf_out * out, unsigned int len)
 {
-	conf_entry_t *entry;
-	int count = 0;
-	char buf[2048];
+	unsigned int size = out->size ? out->size : 4096;
+	char * buf;
 
-	/* define a queue for sections */
-	conf_entry_t *queue[1024];
-	int head = 0;
-	int tail = 0;
+	while (out->len + len > size)
+		size *= 2;
+
+	if ((buf = realloc(out->buf, size)) == NULL) {
+		DBG(DBG_ERROR, "realloc() fail!");
+		out->err = true;
+		return -1;
+	}
+
+	out->buf = buf;
+	out->size = size;
+
+	return 0;
+}
+
+/* Append 'len' bytes of 's' */
+static inline void conf_out_put(struct conf_out * out, const char * s, 
+								unsigned int len)
+{
+	if (out->err || ((out->len + len > out->size) && 
+					 (conf_out_grow(out, len) < 0)))
+		return;
+
+	memcpy(out->buf + out->len, s, len);
+	out->len += len;
+}
+
+/* Room for the text of a value. A double printed with "%f" can take
+   more than 300 characters. */
+#define CONF_VALUE_MAX 512
+
+/* Append "name = value\n" */
+static void conf_out_entry(struct conf_out * out, struct conf_entry * entry)
+{
+	unsigned int max = CONF_VALUE_MAX;
+	unsigned int n;
+	char * val;
+
+	/* quotes and terminator */
+	if ((entry->type == CONF_TYPE(CONF_STRING)) && (entry->p != NULL))
+		max = strlen((char *)entry->p) + 3;
+
+	n = strlen(entry->name);
+	if (out->err || ((out->len + n + 4 + max > out->size) && 
+					 (conf_out_grow(out, n + 4 + max) < 0)))
+		return;
+
+	memcpy(out->buf + out->len, entry->name, n);
+	memcpy(out->buf + out->len + n, " = ", 3);
+	out->len += n + 3;
+
+	/* the codec writes straight into the buffer */
+	val = out->buf + out->len;
+	if (entry->type->t_get(entry, val))
+		out->len += strlen(val);
+	else {
+		/* Assuming the above failure means configuration stub. */
+		memcpy(val, NULL_STRING, sizeof(NULL_STRING) - 1);
+		out->len += sizeof(NULL_STRING) - 1;
+	}
+
+	out->buf[out->len++] = '\n';
+}
+
+/* Write the values of the section, returns how many */
+static int conf_out_values(struct conf_out * out, struct conf_entry * section)
+{
+	struct conf_entry * entry;
+	int count = 0;
 
 	if (section == NULL)
 		return 0;
 
-	DBG(DBG_INFO, "section: '%s'", section->name);
+	for (entry = section; entry->name != NULL; entry++) {
+		if (entry->type != CONF_TYPE(CONF_SECTION)) {
+			conf_out_entry(out, entry);
+			count++;
+		}
+	}
 
-	entry = section;
-	while (entry->name != NULL) {
+	return count;
+}
 
-		if (entry->type == CONF_TYPE(CONF_SECTION)) {
-			queue[tail++] = (conf_entry_t *) entry;
-		} else {
-			if (entry->type->t_get(entry, buf)) {
-				fprintf(f, "%s = %s\n", entry->name, buf);
-			} else {
-				/* Assuming the above failure means configuration stub. */
-				fprintf(f, "%s = %s\n", entry->name, NULL_STRING);
+/* Section being written, with the length of its path */
+struct conf_out_frame {
+	struct conf_entry * next; /* next entry to look for subsections */
+	unsigned int plen;
+};
+
+/*
+ * Write the tree into the buffer. The values of a section come first,
+ * then each of its subsections, under a "[path]" header. The tree is
+ * walked with an explicit stack, so there is no limit on its depth or
+ * on the number of entries of a section.
+ */
+static int write_section(struct conf_out * out, struct conf_entry * root)
+{
+	struct conf_out_frame * stack = NULL;
+	struct conf_entry * section = root;
+	struct conf_entry * entry;
+	char * path = NULL;
+	unsigned int path_size = 0;
+	unsigned int plen = 0;
+	unsigned int size = 0;
+	unsigned int sp = 0;
+	int count;
+
+	if (root == NULL)
+		return 0;
+
+	count = conf_out_values(out, root);
+
+	for (;;) {
+		unsigned int n;
+
+		if (section != NULL) {
+			/* enter the section */
+			if (sp == size) {
+				struct conf_out_frame * p;
+
+				size = size ? size * 2 : CONF_DEPTH_MAX;
+				if ((p = realloc(stack, size * sizeof(*p))) == NULL) {
+					DBG(DBG_ERROR, "realloc() fail!");
+					out->err = true;
+					break;
+				}
+				stack = p;
 			}
-			count++;
+			stack[sp].next = section;
+			stack[sp].plen = plen;
+			sp++;
 		}
-		entry++;
-	}
 
-	for (head = 0; head < tail; head++) {
-		entry = queue[head];
-		fprintf(f, "\n");
-		if ((branch != NULL) && (*branch != '\0'))
-			sprintf(buf, "%s/%s", branch, entry->name);
-		else
-			strcpy(buf, entry->name);
-		fprintf(f, "[%s]\n", buf);
-		count += write_section(f, (conf_entry_t *) entry->p, buf);
+		/* next subsection of the innermost section */
+		entry = stack[sp - 1].next;
+		while ((entry->name != NULL) && 
+			   (entry->type != CONF_TYPE(CONF_SECTION)))
+			entry++;
+
+		if (entry->name == NULL) {
+			/* done with this section */
+			if (--sp == 0)
+				break;
+			section = NULL;
+			continue;
+		}
+
+		stack[sp - 1].next = entry + 1;
+
+		/* "parent/name" */
+		plen = stack[sp - 1].plen;
+		n = strlen(entry->name);
+		if (plen > 0)
+			path[plen++] = '/';
+		if (conf_buf_put(&path, &path_size, plen, entry->name, n) == NULL) {
+			out->err = true;
+			break;
+		}
+		plen += n;
+
+		conf_out_put(out, "\n[", 2);
+		conf_out_put(out, path, plen);
+		conf_out_put(out, "]\n", 2);
+
+		/* an undefined section has no entries */
+		section = (struct conf_entry *)entry->p;
+		count += conf_out_values(out, section);
 	}
 
+	free(stack);
+	free(path);
+
 	return count;
 }
 
-int conf_save(const char *path, conf_entry_t *root)
+int conf_encode(struct conf_entry * root, char ** text, size_t * len)
 {
-	FILE *f;
+	struct conf_out out;
 	int count;
 
-	if (!(f = fopen(path, "w+"))) {
-		DBG(DBG_ERROR, "fopen('%s') fail!", path);
+	memset(&out, 0, sizeof(out));
+	count = write_section(&out, root);
+	if (out.err) {
+		free(out.buf);
 		return -1;
-	};
-
-	count = write_section(f, root, NULL);
+	}
 
-	fclose(f);
+	*text = out.buf;
+	*len = out.len;
 
 	return count;
 }
 
-int conf_dump(conf_entry_t *root)
+int conf_write(const char * path, const char * text, size_t len)
+{
+	bool same = false;
+	size_t size;
+	void * ptr;
+	int fd;
+
+	/* leave the file alone if it already holds the same text */
+	if ((fd = open(path, O_RDONLY | O_BINARY)) >= 0) {
+		if ((ptr = fmap_fd(fd, &size)) != NULL) {
+			same = (size == len) && 
+				((size == 0) || (memcmp(ptr, text, size) == 0));
+			funmap(ptr, size);
+		}
+		close(fd);
+	}
+
+	if (same) {
+		DBG(DBG_INFO, "\"%s\" unchanged", path);
+		return 0;
+	}
+
+	return conf_file_write(path, text, len);
+}
+
+int conf_save(const char *path, struct conf_entry *root)
 {
-	return write_section(stdout, root, NULL);
+	size_t len;
+	char * text;
+	int count;
+
+	if ((count = conf_encode(root, &text, &len)) < 0)
+		return -1;
+
+	if (conf_write(path, text, len) < 0)
+		count = -1;
+	else
+		conf_dirty_clear(root, 0);
+
+	free(text);
+
+	return count;
 }
 
+int conf_dump(struct conf_entry *root)
+{
+	struct conf_out out;
+	int count;
 
+	memset(&out, 0, sizeof(out));
+	count = write_section(&out, root);
+	if (out.len > 0)
+		fwrite(out.buf, out.len, 1, stdout);
+	free(out.buf);
 
+	return out.err ? -1 : count;
+}
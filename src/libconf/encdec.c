@@ -38,19 +38,181 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <math.h>
 #include <ctype.h>
 #include <string.h>
 
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
+#ifdef _WIN32
+  #include <winsock2.h>
+  #include <windows.h>
+  #include <ws2tcpip.h>
+  #ifndef in_addr_t
+    #define in_addr_t uint32_t
+  #endif
+#else
+  #include <sys/socket.h>
+  #include <netinet/in.h>
+  #include <arpa/inet.h>
+#endif
 
 #include "conf.h"
 #include "private.h"
 #include "debug.h"
 
-static int void_get(conf_entry_t *var, char *s)
+/*
+ * Number formatting and parsing. These are used instead of the printf
+ * and scanf families, which parse their format string on every call.
+ */
+
+static const char dec_pairs[201] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/* Write 'v' in decimal, returns the end of the string */
+static char * fmt_udec(char * s, uint64_t v)
+{
+	char buf[20];
+	char * cp = buf + sizeof(buf);
+	unsigned int n;
+
+	/* two digits at a time */
+	while (v >= 100) {
+		unsigned int i = (v % 100) * 2;
+
+		v /= 100;
+		*--cp = dec_pairs[i + 1];
+		*--cp = dec_pairs[i];
+	}
+
+	if (v >= 10) {
+		*--cp = dec_pairs[v * 2 + 1];
+		*--cp = dec_pairs[v * 2];
+	} else
+		*--cp = '0' + v;
+
+	n = buf + sizeof(buf) - cp;
+	memcpy(s, cp, n);
+	s[n] = '\0';
+
+	return s + n;
+}
+
+static char * fmt_dec(char * s, int64_t v)
+{
+	if (v < 0) {
+		*s++ = '-';
+		return fmt_udec(s, 0 - (uint64_t)v);
+	}
+
+	return fmt_udec(s, v);
+}
+
+/* Write 'prefix' and the 'n' low order digits of 'v' in base 2^'shift',
+   leading zeros included. */
+static char * fmt_pow2(char * s, const char * prefix, uint64_t v,
+					   unsigned int shift, unsigned int n)
+{
+	unsigned int mask = (1 << shift) - 1;
+	char * end;
+
+	while (*prefix != '\0')
+		*s++ = *prefix++;
+
+	end = s + n;
+	*end = '\0';
+	while (n > 0) {
+		s[--n] = hex_digits[v & mask];
+		v >>= shift;
+	}
+
+	return end;
+}
+
+/* Value of the digit 'c', 36 if it is not one */
+static inline unsigned int digit_val(int c)
+{
+	if ((unsigned int)(c - '0') < 10)
+		return c - '0';
+
+	c |= 0x20; /* lower case */
+	if ((unsigned int)(c - 'a') < 26)
+		return c - 'a' + 10;
+
+	return 36;
+}
+
+/*
+ * Parse an integer, with an optional sign, in 'base', for a variable of
+ * 'bits' bits, signed or not. A base of 0 takes it from the prefix: 
+ * "0x" hex, "0b" binary, "0" octal, else decimal. Leading spaces and a
+ * prefix matching the base are skipped, the text after the digits is
+ * ignored. Negative numbers are returned in two's complement.
+ * Returns false if there are no digits or the value doesn't fit the
+ * variable: a signed one takes -2^(bits-1) to 2^(bits-1)-1, an unsigned
+ * one 0 to 2^bits-1, whatever the base.
+ */
+static bool parse_int(const char * s, unsigned int base, unsigned int bits,
+					  bool sign, uint64_t * val)
+{
+	const unsigned char * cp = (const unsigned char *)s;
+	bool neg = false;
+	unsigned int d;
+	uint64_t max;
+	uint64_t v;
+
+	while (isspace(*cp))
+		cp++;
+
+	if ((*cp == '-') || (*cp == '+'))
+		neg = (*cp++ == '-');
+
+	if (cp[0] == '0') {
+		int x = cp[1] | 0x20;
+
+		if ((x == 'x') && ((base == 0) || (base == 16)) && 
+			(digit_val(cp[2]) < 16)) {
+			base = 16;
+			cp += 2;
+		} else if ((x == 'b') && ((base == 0) || (base == 2)) && 
+				   (digit_val(cp[2]) < 2)) {
+			base = 2;
+			cp += 2;
+		} else if (base == 0)
+			base = 8;
+	} else if (base == 0)
+		base = 10;
+
+	if ((d = digit_val(*cp)) >= base)
+		return false;
+
+	v = 0;
+	do {
+		if (v > (UINT64_MAX - d) / base)
+			return false;
+		v = v * base + d;
+		d = digit_val(*++cp);
+	} while (d < base);
+
+	max = (bits < 64) ? ((uint64_t)1 << bits) - 1 : UINT64_MAX;
+	if (sign)
+		max >>= 1;
+
+	/* a signed variable holds one more negative value */
+	if (neg ? (v > (sign ? max + 1 : 0)) : (v > max))
+		return false;
+
+	*val = neg ? 0 - v : v;
+
+	return true;
+}
+
+int void_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
@@ -61,65 +223,57 @@ static int void_get(conf_entry_t *var, char *s)
 	return 1;
 }
 
-static int void_set(conf_entry_t *var, const char *s)
+int void_set(struct conf_entry *var, const char *s)
 {
 	sscanf(s, "%p", &(var->p));
 	return 1;
 }
 
-static int int_get(conf_entry_t *var, char *s)
+int int_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "%i", *(int32_t *) (var->p));
+	fmt_dec(s, *(int32_t *)(var->p));
 	return 1;
 }
 
-static int int_set(conf_entry_t *var, const char *s)
+int int_set(struct conf_entry *var, const char *s)
 {
-	int32_t *p;
-
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(int32_t));
-	}
+	uint64_t val;
 
-	p = (int32_t *) var->p;
-
-	*p = strtol(s, NULL, 0);
+	if ((var->p == NULL) || !parse_int(s, 0, 32, true, &val))
+		return 0;
 
+	*(int32_t *)(var->p) = val;
 	return 1;
 }
 
-static int uint_get(conf_entry_t *var, char *s)
+int uint_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "%u", *(uint32_t *) (var->p));
+	fmt_udec(s, *(uint32_t *)(var->p));
 	return 1;
 }
 
-static int uint_set(conf_entry_t *var, const char *s)
+int uint_set(struct conf_entry *var, const char *s)
 {
-	uint32_t *p;
+	uint64_t val;
 
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint32_t));
-	}
-
-	p = (uint32_t *) var->p;
-
-	*p = strtoul(s, NULL, 0);
+	if ((var->p == NULL) || !parse_int(s, 0, 32, false, &val))
+		return 0;
 
+	*(uint32_t *)(var->p) = val;
 	return 1;
 }
 
-static int float_get(conf_entry_t *var, char *s)
+int float_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
@@ -130,16 +284,23 @@ static int float_get(conf_entry_t *var, char *s)
 	return 1;
 }
 
-static int float_set(conf_entry_t *var, const char *s)
+int float_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(double));
-	}
-	sscanf(s, "%lf", (double *) (var->p));
+	char * end;
+	double val;
+
+	if (var->p == NULL)
+		return 0;
+
+	val = strtod(s, &end);
+	if (end == s)
+		return 0;
+
+	*(double *)(var->p) = val;
 	return 1;
 }
 
-static int string_get(conf_entry_t *var, char *s)
+int string_get(struct conf_entry *var, char *s)
 {
 	char * cp;			/* source */
 
@@ -154,14 +315,14 @@ static int string_get(conf_entry_t *var, char *s)
 	return 1;
 }
 
-static int string_set(conf_entry_t *var, const char *s)
+int string_set(struct conf_entry *var, const char *s)
 {
 	char *cp;			/* source */
 	int len;
 	char quote;
 	char *ep;
 
-	if ((!s) || (!var))
+	if ((!s) || (!var) || (var->p == NULL))
 		return 0;
 
 	cp = (char *) s;
@@ -182,10 +343,6 @@ static int string_set(conf_entry_t *var, const char *s)
 		len = strlen(cp);
 	}
 
-	if (var->p == NULL) {
-		var->p = malloc(len + 1);
-	}
-
 	if (var->len > 0)
 		len = MIN(len, var->len);
 
@@ -196,22 +353,23 @@ static int string_set(conf_entry_t *var, const char *s)
 	return 1;
 }
 
-static int bool_get(conf_entry_t *var, char *s)
+int bool_get(struct conf_entry *var, char *s)
 {
-	if ((*(bool *) (var->p)) == 0)
-		sprintf(s, "False");
-	else
-		sprintf(s, "True");
+	if (var->p == NULL) {
+		strcpy(s, NULL_STRING);
+		return 0;
+	}
+
+	strcpy(s, (*(bool *)(var->p)) ? "True" : "False");
 	return 1;
 }
 
-static int bool_set(conf_entry_t *var, const char *s)
+int bool_set(struct conf_entry *var, const char *s)
 {
 	char *cp;			/* source */
 
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(int));
-	}
+	if (var->p == NULL)
+		return 0;
 
 	cp = (char *) s;
 	LTRIM(cp);
@@ -235,474 +393,483 @@ static int bool_set(conf_entry_t *var, const char *s)
 	return 0;
 }
 
-static int char_get(conf_entry_t *var, char *s)
+int char_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	//printf("*** %s: var '%s' = '%c'\n", __FUNCTION__, var->name, *(char *)(var->p));
-
-	sprintf(s, "%c", *(char *) (var->p));
+	s[0] = *(char *)(var->p);
+	s[1] = '\0';
 	return 1;
 }
 
-static int char_set(conf_entry_t *var, const char *s)
+int char_set(struct conf_entry *var, const char *s)
 {
 	char *cp;			/* source */
 
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(char));
-	}
+	if (var->p == NULL)
+		return 0;
 
 	cp = (char *) s;
 	LTRIM(cp);
 
-	//printf("*** %s: var '%s' source='%s'\n", __FUNCTION__, var->name, cp);
-
-	sscanf(cp, "%c", (char *) (var->p));
+	if (*cp != '\0')
+		*(char *)(var->p) = *cp;
 	return 1;
 }
 
 /*
  * 8 bits integers
  */
-static int int8_get(conf_entry_t *var, char *s)
+int int8_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "%i", *(int8_t *) (var->p));
+	fmt_dec(s, *(int8_t *)(var->p));
 	return 1;
 }
 
-static int int8_set(conf_entry_t *var, const char *s)
+int int8_set(struct conf_entry *var, const char *s)
 {
-	int8_t *p;
+	uint64_t val;
 
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(int8_t));
-	}
-
-	p = (int8_t *) var->p;
-
-	*p = strtol(s, NULL, 0);
+	if ((var->p == NULL) || !parse_int(s, 0, 8, true, &val))
+		return 0;
 
+	*(int8_t *)(var->p) = val;
 	return 1;
 }
 
-static int uint8_get(conf_entry_t *var, char *s)
+int uint8_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "%u", *(uint8_t *) (var->p));
+	fmt_udec(s, *(uint8_t *)(var->p));
 	return 1;
 }
 
-static int uint8_set(conf_entry_t *var, const char *s)
+int uint8_set(struct conf_entry *var, const char *s)
 {
-	uint8_t *p;
-
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint8_t));
-	}
-
-	p = (uint8_t *) var->p;
+	uint64_t val;
 
-	*p = strtoul(s, NULL, 0);
+	if ((var->p == NULL) || !parse_int(s, 0, 8, false, &val))
+		return 0;
 
+	*(uint8_t *)(var->p) = val;
 	return 1;
 }
 
-static int hex8_get(conf_entry_t *var, char *s)
+int hex8_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "0x%02X", *(uint8_t*) (var->p));
+	fmt_pow2(s, "0x", *(uint8_t *)(var->p), 4, 2);
 	return 1;
 }
 
-static int hex8_set(conf_entry_t *var, const char *s)
+int hex8_set(struct conf_entry *var, const char *s)
 {
-	uint32_t val;
+	uint64_t val;
 
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint8_t));
-	}
-	sscanf(s, "%X", &val);
+	if ((var->p == NULL) || !parse_int(s, 16, 8, false, &val))
+		return 0;
 
 	*(uint8_t *)(var->p) = val;
 	return 1;
 }
 
-static int bin8_get(conf_entry_t *var, char *s)
+int bin8_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
-	s = "";
 
-	return 0;
+	fmt_pow2(s, "0b", *(uint8_t *)(var->p), 1, 8);
+	return 1;
 }
 
-static int bin8_set(conf_entry_t *var, const char *s)
+int bin8_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(unsigned char));
-	}
+	uint64_t val;
 
-	return 0;
+	if ((var->p == NULL) || !parse_int(s, 2, 8, false, &val))
+		return 0;
+
+	*(uint8_t *)(var->p) = val;
+	return 1;
 }
 
-static int oct8_get(conf_entry_t *var, char *s)
+int oct8_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
-	s = "";
 
-	return 0;
+	fmt_pow2(s, "0", *(uint8_t *)(var->p), 3, 3);
+	return 1;
 }
 
-static int oct8_set(conf_entry_t *var, const char *s)
+int oct8_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(unsigned char));
-	}
+	uint64_t val;
 
-	return 0;
+	if ((var->p == NULL) || !parse_int(s, 8, 8, false, &val))
+		return 0;
+
+	*(uint8_t *)(var->p) = val;
+	return 1;
 }
 
 /*
  * 16 bits integers
  */
-static int int16_get(conf_entry_t *var, char *s)
+int int16_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "%i", *(int16_t *) (var->p));
+	fmt_dec(s, *(int16_t *)(var->p));
 	return 1;
 }
 
-static int int16_set(conf_entry_t *var, const char *s)
+int int16_set(struct conf_entry *var, const char *s)
 {
-	int16_t *p;
+	uint64_t val;
 
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(int16_t));
-	}
-
-	p = (int16_t *) var->p;
-
-	*p = strtol(s, NULL, 0);
+	if ((var->p == NULL) || !parse_int(s, 0, 16, true, &val))
+		return 0;
 
+	*(int16_t *)(var->p) = val;
 	return 1;
 }
 
-static int uint16_get(conf_entry_t *var, char *s)
+int uint16_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "%u", *(uint16_t *) (var->p));
+	fmt_udec(s, *(uint16_t *)(var->p));
 	return 1;
 }
 
-static int uint16_set(conf_entry_t *var, const char *s)
+int uint16_set(struct conf_entry *var, const char *s)
 {
-	uint16_t *p;
+	uint64_t val;
 
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint16_t));
-	}
-
-	p = (uint16_t *) var->p;
-
-	*p = strtoul(s, NULL, 0);
+	if ((var->p == NULL) || !parse_int(s, 0, 16, false, &val))
+		return 0;
 
+	*(uint16_t *)(var->p) = val;
 	return 1;
 }
 
-static int hex16_get(conf_entry_t *var, char *s)
+int hex16_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "0x%04X", *(uint16_t *) (var->p));
+	fmt_pow2(s, "0x", *(uint16_t *)(var->p), 4, 4);
 	return 1;
 }
 
-static int hex16_set(conf_entry_t *var, const char *s)
+int hex16_set(struct conf_entry *var, const char *s)
 {
-	uint32_t val;
+	uint64_t val;
+
+	if ((var->p == NULL) || !parse_int(s, 16, 16, false, &val))
+		return 0;
 
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint16_t));
-	}
-	sscanf(s, "%X", &val);
 	*(uint16_t *)(var->p) = val;
 	return 1;
 }
 
-static int bin16_get(conf_entry_t *var, char *s)
+int bin16_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
-	s = "";
 
-	return 0;
+	fmt_pow2(s, "0b", *(uint16_t *)(var->p), 1, 16);
+	return 1;
 }
 
-static int bin16_set(conf_entry_t *var, const char *s)
+int bin16_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(short int));
-	}
+	uint64_t val;
 
-	return 0;
+	if ((var->p == NULL) || !parse_int(s, 2, 16, false, &val))
+		return 0;
+
+	*(uint16_t *)(var->p) = val;
+	return 1;
 }
 
-static int oct16_get(conf_entry_t *var, char *s)
+int oct16_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
-	s = "";
 
-	return 0;
+	fmt_pow2(s, "0", *(uint16_t *)(var->p), 3, 6);
+	return 1;
 }
 
-static int oct16_set(conf_entry_t *var, const char *s)
+int oct16_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(short int));
-	}
+	uint64_t val;
 
-	return 0;
+	if ((var->p == NULL) || !parse_int(s, 8, 16, false, &val))
+		return 0;
+
+	*(uint16_t *)(var->p) = val;
+	return 1;
 }
 
 /*
  * 32 bits integers
  */
-
-static int hex32_get(conf_entry_t *var, char *s)
+int hex32_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
-		sprintf(s, "NULL");
+		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "0x%08X", *(uint32_t *) (var->p));
+	fmt_pow2(s, "0x", *(uint32_t *)(var->p), 4, 8);
 	return 1;
 }
 
-static int hex32_set(conf_entry_t *var, const char *s)
+int hex32_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint32_t));
-	}
+	uint64_t val;
+
+	if ((var->p == NULL) || !parse_int(s, 16, 32, false, &val))
+		return 0;
 
-	sscanf(s, "%X", (uint32_t *) (var->p));
+	*(uint32_t *)(var->p) = val;
 	return 1;
 }
 
-static int bin32_get(conf_entry_t *var, char *s)
+int bin32_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
-	s = "";
 
-	return 0;
+	fmt_pow2(s, "0b", *(uint32_t *)(var->p), 1, 32);
+	return 1;
 }
 
-static int bin32_set(conf_entry_t *var, const char *s)
+int bin32_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(unsigned long));
-	}
-	return 0;
-}
+	uint64_t val;
 
-static int oct32_get(conf_entry_t *var, char *s)
-{
-	s = "";
+	if ((var->p == NULL) || !parse_int(s, 2, 32, false, &val))
+		return 0;
 
-	return 0;
+	*(uint32_t *)(var->p) = val;
+	return 1;
 }
 
-static int oct32_set(conf_entry_t *var, const char *s)
+int oct32_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint32_t));
+		strcpy(s, NULL_STRING);
+		return 0;
 	}
 
-	return 0;
+	fmt_pow2(s, "0", *(uint32_t *)(var->p), 3, 11);
+	return 1;
+}
+
+int oct32_set(struct conf_entry *var, const char *s)
+{
+	uint64_t val;
+
+	if ((var->p == NULL) || !parse_int(s, 8, 32, false, &val))
+		return 0;
+
+	*(uint32_t *)(var->p) = val;
+	return 1;
 }
 
 /*
- * 32 bits integers
+ * 64 bits integers
  */
-static int int64_get(conf_entry_t *var, char *s)
+int int64_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "%lli", *(int64_t *) (var->p));
+	fmt_dec(s, *(int64_t *)(var->p));
 	return 1;
 }
 
-static int int64_set(conf_entry_t *var, const char *s)
+int int64_set(struct conf_entry *var, const char *s)
 {
-	int64_t *p;
-
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(int64_t));
-	}
+	uint64_t val;
 
-	p = (int64_t *) var->p;
-
-	*p = strtoll(s, NULL, 0);
+	if ((var->p == NULL) || !parse_int(s, 0, 64, true, &val))
+		return 0;
 
+	*(int64_t *)(var->p) = val;
 	return 1;
 }
 
-static int uint64_get(conf_entry_t *var, char *s)
+int uint64_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "%llu", *(uint64_t *) (var->p));
+	fmt_udec(s, *(uint64_t *)(var->p));
 	return 1;
 }
 
-static int uint64_set(conf_entry_t *var, const char *s)
+int uint64_set(struct conf_entry *var, const char *s)
 {
-	uint64_t *p;
+	uint64_t val;
 
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint64_t));
-	}
-
-	p = (uint64_t *) var->p;
-
-	*p = strtoull(s, NULL, 0);
+	if ((var->p == NULL) || !parse_int(s, 0, 64, false, &val))
+		return 0;
 
+	*(uint64_t *)(var->p) = val;
 	return 1;
 }
 
-static int hex64_get(conf_entry_t *var, char *s)
+int hex64_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	sprintf(s, "0x%016llX", *(uint64_t *) (var->p));
-
+	fmt_pow2(s, "0x", *(uint64_t *)(var->p), 4, 16);
 	return 1;
 }
 
-static int hex64_set(conf_entry_t *var, const char *s)
+int hex64_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint64_t));
-	}
+	uint64_t val;
 
-	sscanf(s, "%llX", (uint64_t *) (var->p));
+	if ((var->p == NULL) || !parse_int(s, 16, 64, false, &val))
+		return 0;
 
+	*(uint64_t *)(var->p) = val;
 	return 1;
 }
 
-static int bin64_get(conf_entry_t *var, char *s)
+int bin64_get(struct conf_entry *var, char *s)
 {
-	s = "";
+	if (var->p == NULL) {
+		strcpy(s, NULL_STRING);
+		return 0;
+	}
 
-	return 0;
+	fmt_pow2(s, "0b", *(uint64_t *)(var->p), 1, 64);
+	return 1;
 }
 
-static int bin64_set(conf_entry_t *var, const char *s)
+int bin64_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(long long int));
-	}
+	uint64_t val;
 
-	return 0;
+	if ((var->p == NULL) || !parse_int(s, 2, 64, false, &val))
+		return 0;
+
+	*(uint64_t *)(var->p) = val;
+	return 1;
 }
-static int oct64_get(conf_entry_t *var, char *s)
+
+int oct64_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
-		sprintf(s, "NULL");
+		strcpy(s, NULL_STRING);
 		return 0;
 	}
-	s = "";
 
-	return 0;
+	fmt_pow2(s, "0", *(uint64_t *)(var->p), 3, 22);
+	return 1;
 }
 
-static int oct64_set(conf_entry_t *var, const char *s)
+int oct64_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(long long int));
-	}
+	uint64_t val;
 
-	return 0;
+	if ((var->p == NULL) || !parse_int(s, 8, 64, false, &val))
+		return 0;
+
+	*(uint64_t *)(var->p) = val;
+	return 1;
 }
 
 /*
  * network stuff
  */
-static int ipv4addr_get(conf_entry_t *var, char *s)
+int ipv4addr_get(struct conf_entry *var, char *s)
 {
+	const uint8_t * b;
+	int i;
+
 	if (var->p == NULL) {
 		DBG(DBG_WARNING, "var->p == NULL!");
-		sprintf(s, "NULL");
+		strcpy(s, NULL_STRING);
 		return 0;
 	}
 
-	strcpy(s, inet_ntoa(*(struct in_addr *)var->p));
+	/* network order, first byte first */
+	b = (const uint8_t *)&((struct in_addr *)var->p)->s_addr;
+	for (i = 0; i < 4; ++i) {
+		s = fmt_udec(s, b[i]);
+		*s++ = '.';
+	}
+	s[-1] = '\0';
+
 	return 1;
 }
 
-static int ipv4addr_set(conf_entry_t *var, const char *s)
+int ipv4addr_set(struct conf_entry *var, const char *s)
 {
 	if (var->p == NULL) {
 		DBG(DBG_WARNING, "var->p == NULL!");
-		var->p = malloc(sizeof(struct in_addr));
+		return 0;
 	}
 
+#ifdef _WIN32
+	((struct in_addr *)var->p)->s_addr = inet_addr(s);
+#else
 	inet_aton(s, (struct in_addr *)var->p);
+#endif
 
 	return 1;
 }
 
-static int rgb_get(conf_entry_t *var, char *s)
+int rgb_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		sprintf(s, "NULL");
@@ -713,16 +880,12 @@ static int rgb_get(conf_entry_t *var, char *s)
 	return 0;
 }
 
-static int rgb_set(conf_entry_t *var, const char *s)
+int rgb_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint32_t));
-	}
-
 	return 0;
 }
 
-static int rgbi_get(conf_entry_t *var, char *s)
+int rgbi_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
@@ -733,16 +896,12 @@ static int rgbi_get(conf_entry_t *var, char *s)
 	return 0;
 }
 
-static int rgbi_set(conf_entry_t *var, const char *s)
+int rgbi_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint32_t));
-	}
-
 	return 0;
 }
 
-static int cymk_get(conf_entry_t *var, char *s)
+int cymk_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
@@ -753,16 +912,12 @@ static int cymk_get(conf_entry_t *var, char *s)
 	return 0;
 }
 
-static int cymk_set(conf_entry_t *var, const char *s)
+int cymk_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(sizeof(uint32_t));
-	}
-
 	return 0;
 }
 
-static int ratio_get(conf_entry_t *var, char *s)
+int ratio_get(struct conf_entry *var, char *s)
 {
 	if (var->p == NULL) {
 		strcpy(s, NULL_STRING);
@@ -773,11 +928,7 @@ static int ratio_get(conf_entry_t *var, char *s)
 	return 0;
 }
 
-static int ratio_set(conf_entry_t *var, const char *s)
+int ratio_set(struct conf_entry *var, const char *s)
 {
-	if (var->p == NULL) {
-		var->p = malloc(2 * sizeof(int));
-	}
-
 	return 0;
 }
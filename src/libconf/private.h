@@ -45,95 +45,95 @@ static const char NULL_STRING[] = "NULL";
 extern "C" {
 #endif
 
-	int void_get(conf_entry_t *, char *);
-	int void_set(conf_entry_t *, const char *);
+	int void_get(struct conf_entry *, char *);
+	int void_set(struct conf_entry *, const char *);
 
-	int int_get(conf_entry_t *, char *);
-	int int_set(conf_entry_t *, const char *);
+	int int_get(struct conf_entry *, char *);
+	int int_set(struct conf_entry *, const char *);
 
-	int int8_get(conf_entry_t *var, char *s);
-	int int8_set(conf_entry_t *var, const char *s);
+	int int8_get(struct conf_entry *var, char *s);
+	int int8_set(struct conf_entry *var, const char *s);
 
-	int uint_get(conf_entry_t *, char *);
-	int uint_set(conf_entry_t *, const char *);
+	int uint_get(struct conf_entry *, char *);
+	int uint_set(struct conf_entry *, const char *);
 
-	int float_get(conf_entry_t *, char *);
-	int float_set(conf_entry_t *, const char *);
+	int float_get(struct conf_entry *, char *);
+	int float_set(struct conf_entry *, const char *);
 
-	int string_get(conf_entry_t *, char *);
-	int string_set(conf_entry_t *, const char *);
+	int string_get(struct conf_entry *, char *);
+	int string_set(struct conf_entry *, const char *);
 
-	int bool_get(conf_entry_t *, char *);
-	int bool_set(conf_entry_t *, const char *);
+	int bool_get(struct conf_entry *, char *);
+	int bool_set(struct conf_entry *, const char *);
 
-	int char_get(conf_entry_t *, char *);
-	int char_set(conf_entry_t *, const char *);
+	int char_get(struct conf_entry *, char *);
+	int char_set(struct conf_entry *, const char *);
 
-	int uint8_get(conf_entry_t *var, char *s);
-	int uint8_set(conf_entry_t *var, const char *s);
+	int uint8_get(struct conf_entry *var, char *s);
+	int uint8_set(struct conf_entry *var, const char *s);
 
-	int hex8_get(conf_entry_t *, char *);
-	int hex8_set(conf_entry_t *, const char *);
+	int hex8_get(struct conf_entry *, char *);
+	int hex8_set(struct conf_entry *, const char *);
 
-	int bin8_get(conf_entry_t *, char *);
-	int bin8_set(conf_entry_t *, const char *);
+	int bin8_get(struct conf_entry *, char *);
+	int bin8_set(struct conf_entry *, const char *);
 
-	int oct8_get(conf_entry_t *, char *);
-	int oct8_set(conf_entry_t *, const char *);
+	int oct8_get(struct conf_entry *, char *);
+	int oct8_set(struct conf_entry *, const char *);
 
-	int int16_get(conf_entry_t *var, char *s);
-	int int16_set(conf_entry_t *var, const char *s);
+	int int16_get(struct conf_entry *var, char *s);
+	int int16_set(struct conf_entry *var, const char *s);
 
-	int uint16_get(conf_entry_t *var, char *s);
-	int uint16_set(conf_entry_t *var, const char *s);
+	int uint16_get(struct conf_entry *var, char *s);
+	int uint16_set(struct conf_entry *var, const char *s);
 
-	int hex16_get(conf_entry_t *, char *);
-	int hex16_set(conf_entry_t *, const char *);
+	int hex16_get(struct conf_entry *, char *);
+	int hex16_set(struct conf_entry *, const char *);
 
-	int oct16_get(conf_entry_t *, char *);
-	int oct16_set(conf_entry_t *, const char *);
+	int oct16_get(struct conf_entry *, char *);
+	int oct16_set(struct conf_entry *, const char *);
 
-	int bin16_get(conf_entry_t *, char *);
-	int bin16_set(conf_entry_t *, const char *);
+	int bin16_get(struct conf_entry *, char *);
+	int bin16_set(struct conf_entry *, const char *);
 
-	int hex32_get(conf_entry_t *, char *);
-	int hex32_set(conf_entry_t *, const char *);
+	int hex32_get(struct conf_entry *, char *);
+	int hex32_set(struct conf_entry *, const char *);
 
-	int bin32_get(conf_entry_t *, char *);
-	int bin32_set(conf_entry_t *, const char *);
+	int bin32_get(struct conf_entry *, char *);
+	int bin32_set(struct conf_entry *, const char *);
 
-	int oct32_get(conf_entry_t *, char *);
-	int oct32_set(conf_entry_t *, const char *);
+	int oct32_get(struct conf_entry *, char *);
+	int oct32_set(struct conf_entry *, const char *);
 
-	int int64_get(conf_entry_t *, char *);
-	int int64_set(conf_entry_t *, const char *);
+	int int64_get(struct conf_entry *, char *);
+	int int64_set(struct conf_entry *, const char *);
 
-	int uint64_get(conf_entry_t *, char *);
-	int uint64_set(conf_entry_t *, const char *);
+	int uint64_get(struct conf_entry *, char *);
+	int uint64_set(struct conf_entry *, const char *);
 
-	int hex64_get(conf_entry_t *, char *);
-	int hex64_set(conf_entry_t *, const char *);
+	int hex64_get(struct conf_entry *, char *);
+	int hex64_set(struct conf_entry *, const char *);
 
-	int bin64_get(conf_entry_t *, char *);
-	int bin64_set(conf_entry_t *, const char *);
+	int bin64_get(struct conf_entry *, char *);
+	int bin64_set(struct conf_entry *, const char *);
 
-	int oct64_get(conf_entry_t *, char *);
-	int oct64_set(conf_entry_t *, const char *);
+	int oct64_get(struct conf_entry *, char *);
+	int oct64_set(struct conf_entry *, const char *);
 
-	int ipv4addr_get(conf_entry_t *, char *);
-	int ipv4addr_set(conf_entry_t *, const char *);
+	int ipv4addr_get(struct conf_entry *, char *);
+	int ipv4addr_set(struct conf_entry *, const char *);
 
-	int rgb_get(conf_entry_t *, char *);
-	int rgb_set(conf_entry_t *, const char *);
+	int rgb_get(struct conf_entry *, char *);
+	int rgb_set(struct conf_entry *, const char *);
 
-	int rgbi_get(conf_entry_t *, char *);
-	int rgbi_set(conf_entry_t *, const char *);
+	int rgbi_get(struct conf_entry *, char *);
+	int rgbi_set(struct conf_entry *, const char *);
 
-	int cymk_get(conf_entry_t *, char *);
-	int cymk_set(conf_entry_t *, const char *);
+	int cymk_get(struct conf_entry *, char *);
+	int cymk_set(struct conf_entry *, const char *);
 
-	int ratio_get(conf_entry_t *, char *);
-	int ratio_set(conf_entry_t *, const char *);
+	int ratio_get(struct conf_entry *, char *);
+	int ratio_set(struct conf_entry *, const char *);
 #ifdef  __cplusplus
 }
 #endif
@@ -0,0 +1,15 @@
+# Configuration engine test and benchmark, built by "make test"
+
+include ../mk/config.mk
+
+PROG = conftest
+
+CFILES = test/conftest.c
+
+LIBDIRS = . ../libcrc
+
+LIBS = conf crc pthread m
+
+INCPATH = ../include
+
+include ../mk/prog.mk
@@ -0,0 +1,1027 @@
+/*
+ * Copyright(C) 2012-2014 Robinson Mittmann. All Rights Reserved.
+ *
+ * This file is part of the YARD-ICE.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You can receive a copy of the GNU Lesser General Public License from
+ * http://www.gnu.org/
+ */
+
+/**
+ * @file conftest.c
+ * @brief Configuration engine checks and benchmark
+ * @author Robinson Mittmann <bobmittmann@gmail.com>
+ *
+ * The checks set and read back every codec, then random values and
+ * numbers near the limits of the types, parse a text whole and one
+ * byte at a time, load a file twice to go through its snapshot, and
+ * save a tree and load it back. The benchmark generates a tree of
+ * thousands of values in nested sections and times the parser, the
+ * encoder, conf_load() with and without the snapshot and conf_save().
+ *
+ * Usage: conftest [-q | -b]
+ *   -q  skip the benchmark
+ *   -b  run the benchmark only
+ *
+ * The files are written to the current directory. Exits with 1 if any
+ * check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#include <sys/utime.h>
+#else
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+#endif
+
+#include "conf.h"
+
+#define CT_FILE "conftest.cfg"
+#define CT_SNAP CT_FILE ".snap"
+
+/* ---------------------------------------------------------------------------
+ * Tree
+ * ---------------------------------------------------------------------------
+ */
+
+static struct {
+	int32_t i32;
+	uint32_t u32;
+	int8_t i8;
+	uint8_t u8;
+	uint16_t h16;
+	uint8_t b8;
+	uint32_t o32;
+	int64_t i64;
+	uint64_t u64;
+	uint64_t h64;
+	int32_t i;
+	uint32_t u;
+	int16_t i16;
+	uint16_t u16;
+	uint8_t h8;
+	uint32_t h32;
+	uint16_t b16;
+	uint32_t b32;
+	uint64_t b64;
+	uint8_t o8;
+	uint16_t o16;
+	uint64_t o64;
+	int32_t deep;
+	bool flag;
+	char ch;
+	double ratio;
+	char name[32];
+	struct in_addr addr;
+} ct;
+
+BEGIN_SECTION(ct_inner)
+	DEFINE_INT32("deep", &ct.deep)
+END_SECTION
+
+BEGIN_SECTION(ct_num)
+	DEFINE_INT32("i32", &ct.i32)
+	DEFINE_UINT32("u32", &ct.u32)
+	DEFINE_INT8("i8", &ct.i8)
+	DEFINE_UINT8("u8", &ct.u8)
+	DEFINE_HEX16("h16", &ct.h16)
+	DEFINE_BIN8("b8", &ct.b8)
+	DEFINE_OCT32("o32", &ct.o32)
+	DEFINE_INT64("i64", &ct.i64)
+	DEFINE_UINT64("u64", &ct.u64)
+	DEFINE_HEX64("h64", &ct.h64)
+	DEFINE_INT("int", &ct.i)
+	DEFINE_UINT("uint", &ct.u)
+	DEFINE_INT16("i16", &ct.i16)
+	DEFINE_UINT16("u16", &ct.u16)
+	DEFINE_HEX8("h8", &ct.h8)
+	DEFINE_HEX32("h32", &ct.h32)
+	DEFINE_BIN16("b16", &ct.b16)
+	DEFINE_BIN32("b32", &ct.b32)
+	DEFINE_BIN64("b64", &ct.b64)
+	DEFINE_OCT8("o8", &ct.o8)
+	DEFINE_OCT16("o16", &ct.o16)
+	DEFINE_OCT64("o64", &ct.o64)
+	DEFINE_SECTION("inner", &ct_inner)
+END_SECTION
+
+BEGIN_SECTION(ct_misc)
+	DEFINE_BOOLEAN("flag", &ct.flag)
+	DEFINE_CHAR("ch", &ct.ch)
+	DEFINE_FLOAT("ratio", &ct.ratio)
+	DEFINE_STRINGCNT("name", &ct.name, sizeof(ct.name) - 1)
+	DEFINE_IPV4ADDR("addr", &ct.addr)
+END_SECTION
+
+BEGIN_SECTION(ct_root)
+	DEFINE_SECTION("num", &ct_num)
+	DEFINE_SECTION("misc", &ct_misc)
+END_SECTION
+
+static const char ct_text[] =
+	"# every type of the tree\n"
+	"[num]\n"
+	"i32 = -123456\n"
+	"u32 = 0xdeadbeef\n"
+	"i8 = -7\n"
+	"u8 = 200\n"
+	"h16 = beef\n"
+	"b8 = 1010\n"
+	"o32 = 0755\n"
+	"i64 = -9000000000\n"
+	"u64 = 18000000000000000000\n"
+	"h64 = 0x0123456789abcdef\n"
+	"int = -5\n"
+	"uint = 3000000000\n"
+	"i16 = -32768\n"
+	"u16 = 65535\n"
+	"h8 = 7f\n"
+	"h32 = 0xCAFEF00D\n"
+	"b16 = 0b1000000000000001\n"
+	"b32 = 11110000\n"
+	"b64 = 0b1\n"
+	"o8 = 0377\n"
+	"o16 = 0177777\n"
+	"o64 = 01777777777777777777777\n"
+	"\n"
+	"[num/inner]\r\n"
+	"deep = 42\r\n"
+	"\n"
+	"[nowhere]\n"
+	"lost = 1\n"
+	"[misc]\n"
+	"  flag = yes  # trailing spaces\n"
+	"ch = x\n"
+	"ratio = 0.25\n"
+	"unknown = 3\n"
+	"name = \"a name\"\n"
+	"addr = 10.0.0.254";
+
+static uint32_t ct_clock_us(void)
+{
+#ifdef _WIN32
+	return GetTickCount() * 1000;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static int ct_file_write(const char * path, const void * buf,
+						 unsigned int size)
+{
+	FILE * f;
+	int ret;
+
+	if ((f = fopen(path, "wb")) == NULL)
+		return -1;
+
+	ret = (fwrite(buf, 1, size, f) == size) ? 0 : -1;
+	fclose(f);
+
+	return ret;
+}
+
+/* The tree as text, NULL if out of memory. To be released with free(). */
+static char * ct_encode(size_t * len)
+{
+	char * text;
+
+	if (conf_encode(ct_root, &text, len) < 0)
+		return NULL;
+
+	return text;
+}
+
+/* The values of ct_text, set one by one */
+static bool ct_expect(void)
+{
+	return (ct.i32 == -123456) && (ct.u32 == 0xdeadbeef) && (ct.i8 == -7) &&
+		(ct.u8 == 200) && (ct.h16 == 0xbeef) && (ct.b8 == 10) &&
+		(ct.o32 == 0755) && (ct.i64 == -9000000000LL) &&
+		(ct.u64 == 18000000000000000000ULL) &&
+		(ct.h64 == 0x0123456789abcdefULL) && (ct.i == -5) &&
+		(ct.u == 3000000000U) && (ct.i16 == -32768) && (ct.u16 == 65535) &&
+		(ct.h8 == 0x7f) && (ct.h32 == 0xcafef00d) && (ct.b16 == 0x8001) &&
+		(ct.b32 == 0xf0) && (ct.b64 == 1) && (ct.o8 == 0377) &&
+		(ct.o16 == 0177777) && (ct.o64 == UINT64_MAX) && (ct.deep == 42) &&
+		ct.flag &&
+		(ct.ch == 'x') && (ct.ratio == 0.25) &&
+		(strcmp(ct.name, "a name") == 0) &&
+		(ct.addr.s_addr == htonl(0x0a0000fe));
+}
+
+static int ct_report(const char * name, bool ok)
+{
+	printf("%-40s %6s\n", name, ok ? "OK" : "FAIL");
+	fflush(stdout);
+
+	return ok ? 0 : 1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Codecs
+ * ---------------------------------------------------------------------------
+ */
+
+static int ct_codecs(void)
+{
+	static const struct {
+		const char * path;
+		const char * in;
+		const char * out; /* NULL if the text must be refused */
+	} lst[] = {
+		{ "num/i32", "-123", "-123" },
+		{ "num/i32", "  +0x7fffffff", "2147483647" },
+		{ "num/i32", "-2147483648", "-2147483648" },
+		{ "num/i32", "12abc", "12" },
+		{ "num/i32", "abc", NULL },
+		{ "num/i32", "2147483648", NULL },
+		{ "num/i32", "-2147483649", NULL },
+		{ "num/i32", "0xffffffff", NULL },
+		{ "num/u32", "4294967295", "4294967295" },
+		{ "num/u32", "4294967296", NULL },
+		{ "num/u32", "-1", NULL },
+		{ "num/u32", "-0", "0" },
+		{ "num/u32", "0b11", "3" },
+		{ "num/i8", "-128", "-128" },
+		{ "num/i8", "128", NULL },
+		{ "num/u8", "010", "8" },
+		{ "num/u8", "256", NULL },
+		{ "num/h16", "beef", "0xBEEF" },
+		{ "num/h16", "0x1", "0x0001" },
+		{ "num/h16", "xyz", NULL },
+		{ "num/h16", "0x10000", NULL },
+		{ "num/b8", "101", "0b00000101" },
+		{ "num/b8", "2", NULL },
+		{ "num/b8", "100000000", NULL },
+		{ "num/o32", "755", "000000000755" },
+		{ "num/o32", "40000000000", NULL },
+		{ "num/i64", "-9223372036854775808", "-9223372036854775808" },
+		{ "num/i64", "9223372036854775808", NULL },
+		{ "num/u64", "18446744073709551615", "18446744073709551615" },
+		{ "num/u64", "18446744073709551616", NULL },
+		{ "num/u64", "99999999999999999999999", NULL },
+		{ "num/h64", "0x0123456789abcdef", "0x0123456789ABCDEF" },
+		{ "num/int", "-2147483648", "-2147483648" },
+		{ "num/int", "0x7fffffff", "2147483647" },
+		{ "num/int", "2147483648", NULL },
+		{ "num/int", "-2147483649", NULL },
+		{ "num/uint", "4294967295", "4294967295" },
+		{ "num/uint", "4294967296", NULL },
+		{ "num/uint", "-1", NULL },
+		{ "num/i16", "-32768", "-32768" },
+		{ "num/i16", "32767", "32767" },
+		{ "num/i16", "32768", NULL },
+		{ "num/i16", "-32769", NULL },
+		{ "num/u16", "65535", "65535" },
+		{ "num/u16", "0xffff", "65535" },
+		{ "num/u16", "65536", NULL },
+		{ "num/u16", "-1", NULL },
+		{ "num/h8", "ff", "0xFF" },
+		{ "num/h8", "0x0", "0x00" },
+		{ "num/h8", "0x100", NULL },
+		{ "num/h8", "g", NULL },
+		{ "num/h32", "ffffffff", "0xFFFFFFFF" },
+		{ "num/h32", "0x1", "0x00000001" },
+		{ "num/h32", "100000000", NULL },
+		{ "num/b16", "1111111111111111", "0b1111111111111111" },
+		{ "num/b16", "0b1", "0b0000000000000001" },
+		{ "num/b16", "10000000000000000", NULL },
+		{ "num/b32", "11111111111111111111111111111111",
+			"0b11111111111111111111111111111111" },
+		{ "num/b32", "100000000000000000000000000000000", NULL },
+		{ "num/b32", "3", NULL },
+		{ "num/b64",
+			"11111111111111111111111111111111"
+			"11111111111111111111111111111111",
+			"0b11111111111111111111111111111111"
+			"11111111111111111111111111111111" },
+		{ "num/b64",
+			"1" "00000000000000000000000000000000"
+			"00000000000000000000000000000000", NULL },
+		{ "num/o8", "377", "0377" },
+		{ "num/o8", "0", "0000" },
+		{ "num/o8", "400", NULL },
+		{ "num/o8", "8", NULL },
+		{ "num/o16", "177777", "0177777" },
+		{ "num/o16", "200000", NULL },
+		{ "num/o64", "1777777777777777777777", "01777777777777777777777" },
+		{ "num/o64", "2000000000000000000000", NULL },
+		{ "num/inner/deep", "99", "99" },
+		{ "misc/flag", "yes", "True" },
+		{ "misc/flag", "off", "False" },
+		{ "misc/flag", "maybe", NULL },
+		{ "misc/ch", "  z", "z" },
+		{ "misc/ratio", "2.5", "2.500000" },
+		{ "misc/ratio", "x", NULL },
+		{ "misc/name", "\"hello world\"", "\"hello world\"" },
+		{ "misc/name", "'single'", "\"single\"" },
+		{ "misc/name", "0123456789012345678901234567890123456789",
+			"\"0123456789012345678901234567890\"" },
+		{ "misc/addr", "192.168.1.20", "192.168.1.20" }
+	};
+	char val[512];
+	unsigned int i;
+	int fail = 0;
+
+	memset(&ct, 0, sizeof(ct));
+
+	for (i = 0; i < sizeof(lst) / sizeof(lst[0]); ++i) {
+		int ret = conf_entry_set(ct_root, lst[i].path, lst[i].in);
+		bool ok;
+
+		if (lst[i].out == NULL)
+			ok = (ret < 0);
+		else
+			ok = (ret == 0) && (conf_entry_get(ct_root, lst[i].path, val) == 0)
+				&& (strcmp(val, lst[i].out) == 0);
+
+		if (!ok) {
+			printf("%s = %s: got %s\n", lst[i].path, lst[i].in,
+				   (ret < 0) ? "error" : val);
+			fail++;
+		}
+	}
+
+	if (conf_entry_set(ct_root, "num/none", "1") == 0)
+		fail++;
+
+	return ct_report("codecs", fail == 0);
+}
+
+/* ---------------------------------------------------------------------------
+ * Fuzz
+ * ---------------------------------------------------------------------------
+ */
+
+static uint32_t ct_seed = 1;
+
+static uint32_t ct_rand(void)
+{
+	ct_seed ^= ct_seed << 13;
+	ct_seed ^= ct_seed >> 17;
+	ct_seed ^= ct_seed << 5;
+
+	return ct_seed;
+}
+
+/* A random value for the variable of 'entry', one its text can hold */
+static void ct_rand_value(struct conf_entry * entry)
+{
+	uint8_t * p = entry->p;
+	unsigned int i;
+
+	if (entry->type == CONF_TYPE(CONF_BOOLEAN)) {
+		*(bool *)p = ct_rand() & 1;
+	} else if (entry->type == CONF_TYPE(CONF_CHAR)) {
+		*(char *)p = '!' + ct_rand() % 94;
+	} else if (entry->type == CONF_TYPE(CONF_FLOAT)) {
+		/* "%f" keeps 6 decimals, 1/64 takes 6 */
+		*(double *)p = (int32_t)ct_rand() / 64.0;
+	} else if (entry->type == CONF_TYPE(CONF_STRING)) {
+		static const char chr[] = "abcdefghijklmnopqrstuvwxyz"
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _.-/#=[]";
+		unsigned int n = ct_rand() % (entry->len + 1);
+
+		for (i = 0; i < n; ++i)
+			p[i] = chr[ct_rand() % (sizeof(chr) - 1)];
+		p[n] = '\0';
+	} else {
+		for (i = 0; i < entry->type->t_size; ++i)
+			p[i] = ct_rand();
+	}
+}
+
+static bool ct_value_equal(struct conf_entry * entry, const void * val)
+{
+	if (entry->type == CONF_TYPE(CONF_STRING))
+		return strcmp(entry->p, val) == 0;
+
+	return memcmp(entry->p, val, entry->type->t_size) == 0;
+}
+
+/* Random decimal text, with an optional sign and up to 22 digits */
+static void ct_rand_dec(char * s)
+{
+	unsigned int n = 1 + ct_rand() % 22;
+	unsigned int r = ct_rand() % 4;
+
+	if (r == 0)
+		*s++ = '-';
+	else if (r == 1)
+		*s++ = '+';
+
+	/* mostly near the limits of the types */
+	if (ct_rand() & 1)
+		n = (const unsigned int []){ 3, 5, 10, 19, 20 }[ct_rand() % 5];
+
+	/* a leading zero would make it octal */
+	*s++ = '1' + ct_rand() % 9;
+	while (--n)
+		*s++ = '0' + ct_rand() % 10;
+	*s = '\0';
+}
+
+/* Whether the decimal text 's' fits a variable of 'bits' bits, by way
+   of the C library */
+static bool ct_dec_fits(const char * s, unsigned int bits, bool sign)
+{
+	char * end;
+
+	errno = 0;
+	if (sign) {
+		long long v = strtoll(s, &end, 10);
+		long long max = (bits < 64) ? (1LL << (bits - 1)) - 1 : LLONG_MAX;
+
+		return (errno == 0) && (v <= max) && (v >= -max - 1);
+	} else {
+		unsigned long long v;
+		unsigned long long max = (bits < 64) ? (1ULL << bits) - 1 : 
+			ULLONG_MAX;
+
+		/* strtoull() takes a negative number and negates it */
+		if (s[0] == '-')
+			return false;
+		v = strtoull(s, &end, 10);
+
+		return (errno == 0) && (v <= max);
+	}
+}
+
+static int ct_fuzz(void)
+{
+	struct conf_entry * sec[] = { ct_num, ct_inner, ct_misc };
+	static const struct {
+		const char * path;
+		unsigned int bits;
+		bool sign;
+	} dec[] = {
+		{ "num/i8", 8, true },
+		{ "num/u8", 8, false },
+		{ "num/i16", 16, true },
+		{ "num/u16", 16, false },
+		{ "num/int", 32, true },
+		{ "num/uint", 32, false },
+		{ "num/i32", 32, true },
+		{ "num/u32", 32, false },
+		{ "num/i64", 64, true },
+		{ "num/u64", 64, false }
+	};
+	struct conf_entry * entry;
+	uint8_t prev[64];
+	char text[512];
+	char * before;
+	char * after;
+	size_t len0;
+	size_t len1;
+	unsigned int i;
+	unsigned int j;
+	int bad = 0;
+	int fail = 0;
+
+	/* each value to text and back */
+	for (i = 0; i < 10000; ++i) {
+		for (j = 0; j < sizeof(sec) / sizeof(sec[0]); ++j) {
+			for (entry = sec[j]; entry->name != NULL; entry++) {
+				if (entry->type == CONF_TYPE(CONF_SECTION))
+					continue;
+				ct_rand_value(entry);
+				if (entry->type == CONF_TYPE(CONF_STRING))
+					strcpy((char *)prev, entry->p);
+				else
+					memcpy(prev, entry->p, entry->type->t_size);
+				entry->type->t_get(entry, text);
+				memset(entry->p, 0xa5, (entry->type->t_size) ?
+					   entry->type->t_size : entry->len + 1);
+				if (!entry->type->t_set(entry, text) ||
+					!ct_value_equal(entry, prev)) {
+					if (bad++ < 8)
+						printf("%s: \"%s\"\n", entry->name, text);
+				}
+			}
+		}
+	}
+	fail += ct_report("fuzz, values to text and back", bad == 0);
+
+	/* the whole tree to text and back */
+	bad = 0;
+	for (i = 0; i < 1000; ++i) {
+		for (j = 0; j < sizeof(sec) / sizeof(sec[0]); ++j) {
+			for (entry = sec[j]; entry->name != NULL; entry++) {
+				if (entry->type != CONF_TYPE(CONF_SECTION))
+					ct_rand_value(entry);
+			}
+		}
+		before = ct_encode(&len0);
+		memset(&ct, 0, sizeof(ct));
+		if (before != NULL)
+			conf_parse((const uint8_t *)before, len0, ct_root);
+		after = ct_encode(&len1);
+		if ((before == NULL) || (after == NULL) || (len0 != len1) ||
+			(memcmp(before, after, len0) != 0))
+			bad++;
+		free(before);
+		free(after);
+	}
+	fail += ct_report("fuzz, tree to text and back", bad == 0);
+
+	/* decimal text against the C library, out of range is refused */
+	bad = 0;
+	for (i = 0; i < 100000; ++i) {
+		bool fits;
+		int ret;
+
+		j = ct_rand() % (sizeof(dec) / sizeof(dec[0]));
+		ct_rand_dec(text);
+		fits = ct_dec_fits(text, dec[j].bits, dec[j].sign);
+		ret = conf_entry_set(ct_root, dec[j].path, text);
+		if ((ret == 0) != fits) {
+			if (bad++ < 8)
+				printf("%s = %s: %s\n", dec[j].path, text,
+					   fits ? "refused" : "taken");
+		}
+	}
+	fail += ct_report("fuzz, integer range", bad == 0);
+
+	return fail;
+}
+
+/* ---------------------------------------------------------------------------
+ * Parser
+ * ---------------------------------------------------------------------------
+ */
+
+static int ct_parse(void)
+{
+	static const char bad[] = "[num]\ni32 = 5\n[ bad\nu8 = 1\n";
+	struct conf_parser p;
+	unsigned int i;
+	int fail = 0;
+	int ret;
+
+	memset(&ct, 0, sizeof(ct));
+	ret = conf_parse((const uint8_t *)ct_text, sizeof(ct_text) - 1, ct_root);
+	fail += ct_report("parse", (ret == 0) && ct_expect());
+
+	/* the lines split anywhere */
+	memset(&ct, 0, sizeof(ct));
+	conf_parser_init(&p, ct_root);
+	for (i = 0; i < sizeof(ct_text) - 1; ++i)
+		conf_parser_feed(&p, &ct_text[i], 1);
+	ret = conf_parser_end(&p);
+	fail += ct_report("parse, one byte at a time", (ret == 28) && ct_expect());
+
+	/* the error stops the parse, the values before it stay */
+	memset(&ct, 0, sizeof(ct));
+	conf_parser_init(&p, ct_root);
+	ret = conf_parser_feed(&p, bad, sizeof(bad) - 1);
+	fail += ct_report("parse, syntax error", (ret < 0) && (p.line == 3) &&
+					  (p.col == 6) && (p.err != NULL) && (ct.i32 == 5) &&
+					  (ct.u8 == 0) && (conf_parser_end(&p) < 0));
+
+	return fail;
+}
+
+/* ---------------------------------------------------------------------------
+ * Snapshot
+ * ---------------------------------------------------------------------------
+ */
+
+/* Set the modification time of 'path' back to the one in 'st' */
+static int ct_mtime_set(const char * path, const struct stat * st)
+{
+#ifdef _WIN32
+	struct _utimbuf t;
+
+	t.actime = st->st_atime;
+	t.modtime = st->st_mtime;
+
+	return _utime(path, &t);
+#else
+	struct timespec ts[2];
+
+	ts[0] = st->st_atim;
+	ts[1] = st->st_mtim;
+
+	return utimensat(AT_FDCWD, path, ts, 0);
+#endif
+}
+
+static int ct_snap(void)
+{
+	struct stat st;
+	char * edit;
+	FILE * f;
+	int fail = 0;
+	int ret;
+
+	unlink(CT_SNAP);
+	ct_file_write(CT_FILE, ct_text, sizeof(ct_text) - 1);
+
+	memset(&ct, 0, sizeof(ct));
+	ret = conf_load(CT_FILE, ct_root);
+	fail += ct_report("load, snapshot written", (ret == 0) && ct_expect() &&
+					  (stat(CT_SNAP, &st) == 0));
+
+	memset(&ct, 0, sizeof(ct));
+	ret = conf_load(CT_FILE, ct_root);
+	fail += ct_report("load, from the snapshot", (ret == 0) && ct_expect() &&
+					  !conf_dirty(ct_root));
+
+	/* an edit that keeps the time and the size */
+	stat(CT_FILE, &st);
+	edit = strdup(ct_text);
+	strstr(edit, "u8 = 200")[5] = '1';
+	ct_file_write(CT_FILE, edit, sizeof(ct_text) - 1);
+	ct_mtime_set(CT_FILE, &st);
+
+	memset(&ct, 0, sizeof(ct));
+	ret = conf_load(CT_FILE, ct_root);
+	fail += ct_report("load, same time and size, new text", (ret == 0) &&
+					  (ct.u8 == 100) && (ct.deep == 42));
+	free(edit);
+
+	/* a damaged snapshot is ignored */
+	ct_file_write(CT_FILE, ct_text, sizeof(ct_text) - 1);
+	conf_load(CT_FILE, ct_root);
+	if ((f = fopen(CT_SNAP, "r+b")) != NULL) {
+		fseek(f, -1, SEEK_END);
+		fputc(0x55, f);
+		fclose(f);
+	}
+	memset(&ct, 0, sizeof(ct));
+	ret = conf_load(CT_FILE, ct_root);
+	fail += ct_report("load, damaged snapshot", (f != NULL) && (ret == 0) &&
+					  ct_expect());
+
+	unlink(CT_SNAP);
+	unlink(CT_FILE);
+
+	return fail;
+}
+
+/* ---------------------------------------------------------------------------
+ * Save
+ * ---------------------------------------------------------------------------
+ */
+
+static int ct_save(void)
+{
+	struct stat st0;
+	struct stat st1;
+	char * before;
+	char * after;
+	size_t len0;
+	size_t len1;
+	uint32_t mark;
+	bool ok;
+	int fail = 0;
+	int ret;
+
+	memset(&ct, 0, sizeof(ct));
+	conf_parse((const uint8_t *)ct_text, sizeof(ct_text) - 1, ct_root);
+	conf_entry_set(ct_root, "misc/name", "\"saved\"");
+	fail += ct_report("set, dirty", conf_dirty(ct_root));
+
+	ret = conf_save(CT_FILE, ct_root);
+	fail += ct_report("save", (ret == 28) && !conf_dirty(ct_root));
+
+	/* setting the same value again changes nothing */
+	conf_entry_set(ct_root, "num/i32", "-123456");
+	fail += ct_report("set, same value, clean", !conf_dirty(ct_root));
+
+	/* a change made while the text is being written stays dirty */
+	conf_entry_set(ct_root, "num/u8", "1");
+	mark = conf_dirty_mark();
+	conf_entry_set(ct_root, "misc/ch", "y");
+	conf_dirty_commit(ct_root, mark);
+	ok = conf_dirty(ct_misc) && !conf_dirty(ct_num);
+	conf_dirty_commit(ct_root, conf_dirty_mark());
+	fail += ct_report("commit, later change dirty", ok && !conf_dirty(ct_root));
+	conf_save(CT_FILE, ct_root);
+
+	before = ct_encode(&len0);
+	memset(&ct, 0, sizeof(ct));
+	ret = conf_load(CT_FILE, ct_root);
+	after = ct_encode(&len1);
+	ok = (ret == 0) && (before != NULL) && (after != NULL) &&
+		(len0 == len1) && (memcmp(before, after, len0) == 0);
+	fail += ct_report("save, load back", ok);
+	free(before);
+	free(after);
+
+	/* the same text is not written again */
+	stat(CT_FILE, &st0);
+	ret = conf_save(CT_FILE, ct_root);
+	stat(CT_FILE, &st1);
+#ifdef _WIN32
+	ok = (ret == 28) && (st0.st_mtime == st1.st_mtime);
+#else
+	ok = (ret == 28) && (st0.st_ino == st1.st_ino);
+#endif
+	fail += ct_report("save, unchanged", ok);
+
+	unlink(CT_SNAP);
+	unlink(CT_FILE);
+
+	return fail;
+}
+
+/* Sections nested one in the other, "d/d/.../v" */
+#define CT_DEEP 24
+
+static int ct_deep(void)
+{
+	static struct conf_entry sec[CT_DEEP][3];
+	static int32_t val[CT_DEEP];
+	char path[2 * CT_DEEP];
+	unsigned int i;
+	bool ok;
+	int fail = 0;
+	int ret;
+
+	for (i = 0; i < CT_DEEP; ++i) {
+		sec[i][0].name = "v";
+		sec[i][0].type = CONF_TYPE(CONF_INT32);
+		sec[i][0].p = &val[i];
+		if (i + 1 < CT_DEEP) {
+			sec[i][1].name = "d";
+			sec[i][1].type = CONF_TYPE(CONF_SECTION);
+			sec[i][1].p = sec[i + 1];
+		}
+		val[i] = i * 1000;
+		path[2 * i] = 'd';
+		path[2 * i + 1] = '/';
+	}
+	strcpy(&path[2 * (CT_DEEP - 1)], "v");
+
+	unlink(CT_SNAP);
+	ret = conf_save(CT_FILE, sec[0]);
+	memset(val, 0, sizeof(val));
+	ok = (ret == CT_DEEP) && (conf_load(CT_FILE, sec[0]) == 0);
+	for (i = 0; i < CT_DEEP; ++i)
+		ok = ok && (val[i] == (int32_t)i * 1000);
+	fail += ct_report("save, load back, deep sections", ok);
+
+	ok = (conf_entry_set(sec[0], path, "7") == 0) &&
+		(val[CT_DEEP - 1] == 7) && conf_dirty(sec[0]);
+	ret = conf_save(CT_FILE, sec[0]);
+	fail += ct_report("set, save, deep sections", ok && (ret == CT_DEEP) &&
+					  !conf_dirty(sec[0]));
+
+	unlink(CT_SNAP);
+	unlink(CT_FILE);
+
+	return fail;
+}
+
+/* ---------------------------------------------------------------------------
+ * Benchmark
+ * ---------------------------------------------------------------------------
+ */
+
+static void ct_bench_row(const char * name, unsigned int cnt, uint32_t us,
+						 size_t bytes)
+{
+	printf("%-28s %8u %10u %8u\n", name, cnt, us / cnt,
+		   us ? (unsigned int)((uint64_t)bytes * cnt / us) : 0);
+	fflush(stdout);
+}
+
+/* Generated tree: CT_BIG_SEC sections of CT_BIG_VAR values and
+   CT_BIG_SUB subsections, each of these with CT_BIG_VAR values too. */
+#define CT_BIG_SEC 16
+#define CT_BIG_SUB 8
+#define CT_BIG_VAR 32
+/* entries, with the terminators */
+#define CT_BIG_CNT ((CT_BIG_SEC + 1) + \
+	CT_BIG_SEC * (CT_BIG_VAR + CT_BIG_SUB + 1) + \
+	CT_BIG_SEC * CT_BIG_SUB * (CT_BIG_VAR + 1))
+
+struct ct_big {
+	struct conf_entry * entry; /* the root section comes first */
+	char (* name)[8];
+	uint64_t (* val)[2];
+	unsigned int cnt;
+};
+
+/* Fill a section of 'nvar' values and 'nsub' subsections, whose entries
+   are taken next in 'big'. Returns the section. */
+static struct conf_entry * ct_big_section(struct ct_big * big,
+										  unsigned int nvar, unsigned int nsub,
+										  bool root)
+{
+	static const enum conf_type type[] = {
+		CONF_INT32, CONF_UINT32, CONF_HEX32, CONF_INT64, CONF_BOOLEAN,
+		CONF_STRING, CONF_FLOAT, CONF_UINT16
+	};
+	struct conf_entry * sec = &big->entry[big->cnt];
+	struct conf_entry * entry;
+	unsigned int i;
+
+	big->cnt += nvar + nsub + 1;
+
+	for (i = 0; i < nvar; ++i) {
+		entry = &sec[i];
+		sprintf(big->name[entry - big->entry], "v%u", i);
+		entry->name = big->name[entry - big->entry];
+		entry->type = CONF_TYPE(type[i % (sizeof(type) / sizeof(type[0]))]);
+		entry->p = big->val[entry - big->entry];
+		entry->len = (entry->type == CONF_TYPE(CONF_STRING)) ? 15 : 0;
+		ct_rand_value(entry);
+	}
+
+	for (i = 0; i < nsub; ++i) {
+		entry = &sec[nvar + i];
+		sprintf(big->name[entry - big->entry], root ? "s%u" : "t%u", i);
+		entry->name = big->name[entry - big->entry];
+		entry->type = CONF_TYPE(CONF_SECTION);
+		entry->p = ct_big_section(big, CT_BIG_VAR, root ? CT_BIG_SUB : 0,
+								  false);
+	}
+
+	/* zeroed by calloc(), the terminator */
+	return sec;
+}
+
+static int ct_big_alloc(struct ct_big * big)
+{
+	big->entry = calloc(CT_BIG_CNT, sizeof(struct conf_entry));
+	big->name = calloc(CT_BIG_CNT, sizeof(big->name[0]));
+	big->val = calloc(CT_BIG_CNT, sizeof(big->val[0]));
+	big->cnt = 0;
+
+	if ((big->entry == NULL) || (big->name == NULL) || (big->val == NULL))
+		return -1;
+
+	ct_big_section(big, 0, CT_BIG_SEC, true);
+
+	return 0;
+}
+
+static void ct_big_free(struct ct_big * big)
+{
+	free(big->entry);
+	free(big->name);
+	free(big->val);
+}
+
+static int ct_bench(void)
+{
+	const unsigned int cnt = 100;
+	struct conf_entry * root;
+	struct conf_parser p;
+	struct ct_big big;
+	unsigned int i;
+	uint32_t t0;
+	char * text;
+	char * tmp;
+	char val[16];
+	size_t len;
+	size_t n;
+	int fail = 0;
+	int fd;
+
+	if (ct_big_alloc(&big) < 0) {
+		ct_big_free(&big);
+		return 1;
+	}
+	root = big.entry;
+
+	if (conf_encode(root, &text, &len) < 0) {
+		ct_big_free(&big);
+		return 1;
+	}
+
+	printf("\n%u entries in %u sections, %u bytes of text\n",
+		   CT_BIG_SEC * (CT_BIG_SUB + 1) * CT_BIG_VAR,
+		   CT_BIG_SEC * (CT_BIG_SUB + 1), (unsigned int)len);
+	printf("\n%-28s %8s %10s %8s\n", "operation", "calls", "us/call", "MB/s");
+
+	t0 = ct_clock_us();
+	for (i = 0; i < cnt; ++i)
+		fail += (conf_parse((const uint8_t *)text, len, root) != 0);
+	ct_bench_row("parse", cnt, ct_clock_us() - t0, len);
+
+	t0 = ct_clock_us();
+	for (i = 0; i < cnt; ++i) {
+		const char * cp = text;
+		const char * end = text + len;
+
+		conf_parser_init(&p, root);
+		for (; cp < end; cp += 256)
+			conf_parser_feed(&p, cp, (end - cp) < 256 ? (end - cp) : 256);
+		fail += (conf_parser_end(&p) < 0);
+	}
+	ct_bench_row("parse, 256 byte chunks", cnt, ct_clock_us() - t0, len);
+
+	t0 = ct_clock_us();
+	for (i = 0; i < cnt; ++i) {
+		if (conf_encode(root, &tmp, &n) < 0) {
+			fail++;
+			break;
+		}
+		fail += (n != len);
+		free(tmp);
+	}
+	ct_bench_row("encode", cnt, ct_clock_us() - t0, len);
+
+	ct_file_write(CT_FILE, text, len);
+	unlink(CT_SNAP);
+
+	t0 = ct_clock_us();
+	for (i = 0; i < cnt; ++i) {
+		if ((fd = open(CT_FILE, O_RDONLY)) < 0) {
+			fail++;
+			break;
+		}
+		fail += (conf_load_fd(fd, root) != 0);
+		close(fd);
+	}
+	ct_bench_row("load, parsed", cnt, ct_clock_us() - t0, len);
+
+	conf_load(CT_FILE, root);
+	t0 = ct_clock_us();
+	for (i = 0; i < cnt; ++i)
+		fail += (conf_load(CT_FILE, root) != 0);
+	ct_bench_row("load, snapshot", cnt, ct_clock_us() - t0, len);
+
+	/* a value changes before each save, the text is written */
+	t0 = ct_clock_us();
+	for (i = 0; i < cnt; ++i) {
+		sprintf(val, "%u", i);
+		conf_entry_set(root, "s7/t3/v0", val);
+		fail += (conf_save(CT_FILE, root) < 0);
+	}
+	ct_bench_row("save", cnt, ct_clock_us() - t0, len);
+
+	t0 = ct_clock_us();
+	for (i = 0; i < cnt; ++i)
+		fail += (conf_save(CT_FILE, root) < 0);
+	ct_bench_row("save, unchanged", cnt, ct_clock_us() - t0, len);
+
+	unlink(CT_SNAP);
+	unlink(CT_FILE);
+	free(text);
+	ct_big_free(&big);
+
+	return fail;
+}
+
+int main(int argc, char * argv[])
+{
+	bool cases = true;
+	bool bench = true;
+	int fail = 0;
+
+	if ((argc > 1) && (strcmp(argv[1], "-q") == 0))
+		bench = false;
+	if ((argc > 1) && (strcmp(argv[1], "-b") == 0))
+		cases = false;
+
+	if (cases) {
+		fail += ct_codecs();
+		fail += ct_fuzz();
+		fail += ct_parse();
+		fail += ct_snap();
+		fail += ct_save();
+		fail += ct_deep();
+	}
+
+	if (bench)
+		fail += ct_bench();
+
+	if (fail) {
+		printf("\n%d failed\n", fail);
+		return 1;
+	}
+
+	return 0;
+}
@@ -1,39 +1,490 @@
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <libgen.h>
 #include <dirent.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #include "match.h"
+#include "lookup.h"
+#include "debug.h"
+
+/* Maximum number of directories indexed at the same time */
+#define DIR_INDEX_MAX 8
+#define DIR_PATH_MAX 512
+
+#define DIR_HASH_INIT 2166136261u
+#define DIR_HASH_PRIME 16777619u
 
+/* The names are kept in an array, in no particular order, and in an
+   open addressing hash table which is never more than half full, so 
+   the inotify events find theirs without a scan. An index is keyed by
+   the device and inode of the directory: the paths naming the same one
+   share it, as they share its inotify watch. */
+struct dir_index {
+	uint32_t stamp; /* LRU time stamp, 0 means empty slot */
+	bool valid; /* false if the entries must be rescanned */
+	int wd; /* inotify watch descriptor */
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	time_t scan; /* when the entries were read */
+	unsigned int cnt;
+	unsigned int size;
+	char ** name;
+	uint32_t * hash; /* of each name */
+	unsigned int mask; /* hash table size - 1 */
+	int * tab; /* name index + 1, 0 is an empty bucket */
+	char path[DIR_PATH_MAX];
+};
 
-char * file_lookup(char * path, char * regexp)
+static struct {
+	pthread_mutex_t mutex;
+	uint32_t clock;
+	int ifd; /* inotify file descriptor */
+	struct dir_index idx[DIR_INDEX_MAX];
+} dirsvc = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.clock = 0,
+	.ifd = -1
+};
+
+/* FNV-1a */
+static inline uint32_t dir_hash(const char * s)
+{
+	uint32_t h = DIR_HASH_INIT;
+
+	while (*s != '\0')
+		h = (h ^ (uint8_t)*s++) * DIR_HASH_PRIME;
+
+	return h;
+}
+
+static void dir_tab_insert(struct dir_index * idx, unsigned int n)
+{
+	unsigned int i = idx->hash[n] & idx->mask;
+
+	while (idx->tab[i] != 0)
+		i = (i + 1) & idx->mask;
+
+	idx->tab[i] = n + 1;
+}
+
+/* Return the bucket of 'name', -1 if it is not in the index */
+static int dir_tab_find(struct dir_index * idx, const char * name, uint32_t h)
+{
+	unsigned int i;
+	int k;
+
+	if (idx->tab == NULL)
+		return -1;
+
+	i = h & idx->mask;
+	while ((k = idx->tab[i]) != 0) {
+		if ((idx->hash[k - 1] == h) && (strcmp(idx->name[k - 1], name) == 0))
+			return i;
+		i = (i + 1) & idx->mask;
+	}
+
+	return -1;
+}
+
+/* Empty the bucket 'b'. The names after it in the same run are moved
+   back, so a lookup doesn't stop short of them. */
+static void dir_tab_delete(struct dir_index * idx, unsigned int b)
+{
+	unsigned int i = b;
+	unsigned int j = b;
+	unsigned int home;
+	int k;
+
+	for (;;) {
+		j = (j + 1) & idx->mask;
+		if ((k = idx->tab[j]) == 0)
+			break;
+		home = idx->hash[k - 1] & idx->mask;
+		/* it stays if its home bucket is in (i, j] */
+		if ((i <= j) ? ((home <= i) || (home > j)) : 
+			((home <= i) && (home > j))) {
+			idx->tab[i] = k;
+			i = j;
+		}
+	}
+
+	idx->tab[i] = 0;
+}
+
+static void dir_index_clear(struct dir_index * idx)
+{
+	unsigned int i;
+
+	for (i = 0; i < idx->cnt; ++i)
+		free(idx->name[i]);
+	if (idx->tab != NULL)
+		memset(idx->tab, 0, (idx->mask + 1) * sizeof(int));
+	idx->cnt = 0;
+	idx->valid = false;
+}
+
+static int dir_index_add(struct dir_index * idx, const char * name)
+{
+	char * s;
+
+	if (idx->cnt == idx->size) {
+		unsigned int size = (idx->size == 0) ? 256 : 2 * idx->size;
+		uint32_t * h;
+		char ** p;
+		int * tab;
+		unsigned int i;
+
+		if ((p = realloc(idx->name, size * sizeof(char *))) == NULL)
+			return -1;
+		idx->name = p;
+		if ((h = realloc(idx->hash, size * sizeof(uint32_t))) == NULL)
+			return -1;
+		idx->hash = h;
+		/* keep the table at most half full */
+		if ((tab = calloc(2 * size, sizeof(int))) == NULL)
+			return -1;
+		free(idx->tab);
+		idx->tab = tab;
+		idx->mask = 2 * size - 1;
+		idx->size = size;
+		for (i = 0; i < idx->cnt; ++i)
+			dir_tab_insert(idx, i);
+	}
+
+	if ((s = strdup(name)) == NULL)
+		return -1;
+
+	idx->hash[idx->cnt] = dir_hash(s);
+	idx->name[idx->cnt] = s;
+	dir_tab_insert(idx, idx->cnt++);
+
+	return 0;
+}
+
+static int dir_index_find(struct dir_index * idx, const char * name)
+{
+	int b;
+
+	if ((b = dir_tab_find(idx, name, dir_hash(name))) < 0)
+		return -1;
+
+	return idx->tab[b] - 1;
+}
+
+static void dir_index_remove(struct dir_index * idx, const char * name)
+{
+	unsigned int last;
+	int b;
+	int i;
+
+	if ((b = dir_tab_find(idx, name, dir_hash(name))) < 0)
+		return;
+
+	i = idx->tab[b] - 1;
+	dir_tab_delete(idx, b);
+	free(idx->name[i]);
+
+	/* the order of the entries is irrelevant, the last one takes the
+	   place of the removed one */
+	last = --idx->cnt;
+	if (i != (int)last) {
+		b = dir_tab_find(idx, idx->name[last], idx->hash[last]);
+		idx->tab[b] = i + 1;
+		idx->name[i] = idx->name[last];
+		idx->hash[i] = idx->hash[last];
+	}
+}
+
+static int dir_index_scan(struct dir_index * idx)
 {
-	DIR * dir;
 	struct dirent * ent;
+	struct stat st;
+	DIR * dir;
+
+	dir_index_clear(idx);
 
-	if ((dir = opendir(path)) == NULL) {
+	idx->scan = time(NULL);
+	if (stat(idx->path, &st) < 0) {
+		DBG(DBG_WARNING, "stat(\"%s\"): %s.", idx->path, strerror(errno));
+		return -1;
+	}
+
+	if ((dir = opendir(idx->path)) == NULL) {
 		fprintf(stderr, "ERROR: %s: opendir(): %s.\n",
 				__func__, strerror(errno));
 		fflush(stderr);
-
-		return NULL;
+		return -1;
 	}
 
-	/* print all the files and directories within directory */
 	while ((ent = readdir(dir)) != NULL) {
-		if (match(regexp, ent->d_name)) {
-			break;
+		if ((strcmp(ent->d_name, ".") == 0) ||
+			(strcmp(ent->d_name, "..") == 0))
+			continue;
+		if (dir_index_add(idx, ent->d_name) < 0) {
+			closedir(dir);
+			dir_index_clear(idx);
+			return -1;
 		}
 	}
 
 	closedir(dir);
 
-	if (ent == NULL)
+	idx->mtime = st.st_mtime;
+	idx->valid = true;
+
+	DBG(DBG_TRACE, "\"%s\": %d entries.", idx->path, idx->cnt);
+
+	return 0;
+}
+
+static void dir_index_release(struct dir_index * idx)
+{
+#ifdef __linux__
+	if (idx->wd >= 0)
+		inotify_rm_watch(dirsvc.ifd, idx->wd);
+#endif
+	dir_index_clear(idx);
+	free(idx->name);
+	free(idx->hash);
+	free(idx->tab);
+	idx->name = NULL;
+	idx->hash = NULL;
+	idx->tab = NULL;
+	idx->mask = 0;
+	idx->size = 0;
+	idx->wd = -1;
+	idx->stamp = 0;
+}
+
+#ifdef __linux__
+
+static struct dir_index * dir_index_by_wd(int wd)
+{
+	int i;
+
+	for (i = 0; i < DIR_INDEX_MAX; ++i) {
+		struct dir_index * idx = &dirsvc.idx[i];
+		if ((idx->stamp != 0) && (idx->wd == wd))
+			return idx;
+	}
+
+	return NULL;
+}
+
+/* Apply the pending inotify events to the indexes. */
+static void dir_events_process(void)
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event * ev;
+	struct dir_index * idx;
+	ssize_t n;
+	char * cp;
+	int i;
+
+	while ((n = read(dirsvc.ifd, buf, sizeof(buf))) > 0) {
+		for (cp = buf; cp < buf + n; cp += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *)cp;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				DBG(DBG_WARNING, "inotify queue overflow!");
+				for (i = 0; i < DIR_INDEX_MAX; ++i)
+					dirsvc.idx[i].valid = false;
+				continue;
+			}
+
+			if ((idx = dir_index_by_wd(ev->wd)) == NULL)
+				continue;
+
+			if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+				/* the directory itself is gone, rescan on next lookup */
+				if (ev->mask & IN_IGNORED)
+					idx->wd = -1;
+				idx->valid = false;
+				continue;
+			}
+
+			if (!idx->valid || (ev->len == 0))
+				continue;
+
+			if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+				/* may have been picked up by the scan already */
+				if ((dir_index_find(idx, ev->name) < 0) &&
+					(dir_index_add(idx, ev->name) < 0))
+					idx->valid = false;
+			} else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+				dir_index_remove(idx, ev->name);
+			}
+		}
+	}
+}
+
+static int dir_index_watch(struct dir_index * idx)
+{
+	if (dirsvc.ifd < 0) {
+		if ((dirsvc.ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+			DBG(DBG_WARNING, "inotify_init1(): %s.", strerror(errno));
+			return -1;
+		}
+	}
+
+	idx->wd = inotify_add_watch(dirsvc.ifd, idx->path,
+								IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+								IN_MOVED_TO | IN_DELETE_SELF |
+								IN_MOVE_SELF | IN_ONLYDIR);
+	if (idx->wd < 0) {
+		DBG(DBG_WARNING, "inotify_add_watch(): %s.", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+#endif
+
+/* Make sure the index reflects the current directory contents. */
+static int dir_index_refresh(struct dir_index * idx)
+{
+#ifdef __linux__
+	if (idx->wd < 0) {
+		/* The watch must be in place before scanning, otherwise
+		   changes in between would be lost. */
+		if (dir_index_watch(idx) < 0)
+			idx->valid = false;
+	}
+
+	if (dirsvc.ifd >= 0)
+		dir_events_process();
+
+	if (idx->valid && (idx->wd >= 0))
+		return 0;
+#else
+	struct stat st;
+
+	/* No change notifications, rely on the directory modification
+	   time instead. It has a resolution of a second, a change made in
+	   the second of the scan may not move it: such an index is read
+	   again. */
+	if (idx->valid && (idx->mtime < idx->scan) &&
+		(stat(idx->path, &st) == 0) && (st.st_mtime == idx->mtime))
+		return 0;
+#endif
+
+	return dir_index_scan(idx);
+}
+
+static struct dir_index * dir_index_get(const char * path)
+{
+	struct dir_index * lru;
+	struct dir_index * idx;
+	struct stat st;
+	int i;
+
+	if (strlen(path) >= DIR_PATH_MAX)
 		return NULL;
 
-	return ent->d_name;
+	if (stat(path, &st) < 0) {
+		DBG(DBG_WARNING, "stat(\"%s\"): %s.", path, strerror(errno));
+		return NULL;
+	}
+
+	lru = &dirsvc.idx[0];
+	for (i = 0; i < DIR_INDEX_MAX; ++i) {
+		idx = &dirsvc.idx[i];
+		/* without inode numbers (Windows), the path tells them apart */
+		if ((idx->stamp != 0) && (idx->dev == st.st_dev) &&
+			(idx->ino == st.st_ino) &&
+			((st.st_ino != 0) || (strcmp(idx->path, path) == 0)))
+			goto found;
+		if (idx->stamp < lru->stamp)
+			lru = idx;
+	}
+
+	idx = lru;
+	if (idx->stamp != 0)
+		dir_index_release(idx);
+
+	strcpy(idx->path, path);
+	idx->dev = st.st_dev;
+	idx->ino = st.st_ino;
+	idx->wd = -1;
+	idx->valid = false;
+
+found:
+	idx->stamp = ++dirsvc.clock;
+
+	return idx;
+}
+
+int file_lookup(const char * path, const char * regexp,
+				struct file_entry lst[], int max)
+{
+	struct dir_index * idx;
+	unsigned int i;
+	int cnt = 0;
+
+	if ((path == NULL) || (regexp == NULL) || (lst == NULL) || (max < 0))
+		return -1;
+
+	pthread_mutex_lock(&dirsvc.mutex);
+
+	if ((idx = dir_index_get(path)) == NULL) {
+		pthread_mutex_unlock(&dirsvc.mutex);
+		return -1;
+	}
+
+	if (dir_index_refresh(idx) < 0) {
+		dir_index_release(idx);
+		pthread_mutex_unlock(&dirsvc.mutex);
+		return -1;
+	}
+
+	for (i = 0; (i < idx->cnt) && (cnt < max); ++i) {
+		char * name = idx->name[i];
+
+		if (match((char *)regexp, name)) {
+			strncpy(lst[cnt].name, name, FILE_NAME_MAX - 1);
+			lst[cnt].name[FILE_NAME_MAX - 1] = '\0';
+			cnt++;
+		}
+	}
+
+	pthread_mutex_unlock(&dirsvc.mutex);
+
+	return cnt;
+}
+
+void file_lookup_flush(void)
+{
+	int i;
+
+	pthread_mutex_lock(&dirsvc.mutex);
+
+	for (i = 0; i < DIR_INDEX_MAX; ++i) {
+		if (dirsvc.idx[i].stamp != 0)
+			dir_index_release(&dirsvc.idx[i]);
+	}
+
+#ifdef __linux__
+	if (dirsvc.ifd >= 0) {
+		close(dirsvc.ifd);
+		dirsvc.ifd = -1;
+	}
+#endif
+
+	pthread_mutex_unlock(&dirsvc.mutex);
 }
 
@@ -0,0 +1,517 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "loopserial.h"
+#include "debug.h"
+
+/* Bytes in flight on each direction, the sender blocks when full */
+#define LOOP_SERIAL_BUF_LEN (64 * 1024)
+/* Writes in flight on each direction */
+#define LOOP_SERIAL_MARK_MAX 256
+
+#define ACK 0x06
+#define CAN 0x18
+
+/* One direction of the link */
+struct loop_line {
+	uint32_t head; /* write position */
+	uint32_t ready; /* bytes up to here went through the wire */
+	uint32_t tail; /* read position */
+	uint64_t idle; /* the wire is busy until then */
+	/* completion time of the writes in flight */
+	unsigned int mark_head;
+	unsigned int mark_tail;
+	struct {
+		uint32_t pos;
+		uint64_t tm;
+	} mark[LOOP_SERIAL_MARK_MAX];
+	struct loop_serial_fault fault;
+	uint32_t seed;
+	uint32_t chr_cnt; /* writes starting with the targeted character */
+	uint32_t skip; /* bytes to go before the burst */
+	uint32_t burst; /* bytes left to lose in the current burst */
+	struct serial_stat stat;
+	uint8_t buf[LOOP_SERIAL_BUF_LEN];
+};
+
+struct loop_serial_link;
+
+struct loop_serial_end {
+	struct loop_serial_link * link;
+	struct loop_line * tx;
+	struct loop_line * rx;
+	bool open;
+};
+
+struct loop_serial_link {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint32_t char_us; /* wire time of a character, 0 for no delay */
+	struct serial_config cfg; /* line settings, 0 bps for no delay */
+	struct loop_serial_end end[2];
+	struct serial_dev dev[2];
+	struct loop_line line[2];
+};
+
+static uint64_t loop_clock_us(void)
+{
+#ifdef _WIN32
+	return (uint64_t)GetTickCount() * 1000;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/* Wait on the link condition for 'us' microseconds at most */
+static void loop_link_wait(struct loop_serial_link * link, uint64_t us)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += us / 1000000;
+	ts.tv_nsec += (us % 1000000) * 1000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	pthread_cond_timedwait(&link->cond, &link->mutex, &ts);
+}
+
+/* One in 'n' chance, from the line's own random sequence */
+static bool loop_line_fault(struct loop_line * ln, unsigned int n)
+{
+	uint32_t x;
+
+	if (n == 0)
+		return false;
+
+	/* xorshift32, the state must not be zero */
+	x = (ln->seed != 0) ? ln->seed : 0x2545f491;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	ln->seed = x;
+
+	return (x % n) == 0;
+}
+
+/* The bytes written since the last commit go on the wire after the
+   ones already there. */
+static void loop_line_commit(struct loop_serial_link * link,
+							 struct loop_line * ln)
+{
+	unsigned int last = (ln->mark_head - 1) % LOOP_SERIAL_MARK_MAX;
+	uint64_t now = loop_clock_us();
+	uint32_t cnt;
+
+	cnt = ln->head - ((ln->mark_head != ln->mark_tail) ?
+					  ln->mark[last].pos : ln->ready);
+	if (cnt == 0)
+		return;
+
+	if (ln->idle < now)
+		ln->idle = now;
+	ln->idle += (uint64_t)cnt * link->char_us;
+
+	if ((ln->mark_head - ln->mark_tail) == LOOP_SERIAL_MARK_MAX) {
+		/* too many writes in flight, merge with the last one */
+		ln->mark[last].pos = ln->head;
+		ln->mark[last].tm = ln->idle;
+	} else {
+		ln->mark[ln->mark_head % LOOP_SERIAL_MARK_MAX].pos = ln->head;
+		ln->mark[ln->mark_head % LOOP_SERIAL_MARK_MAX].tm = ln->idle;
+		ln->mark_head++;
+	}
+
+	pthread_cond_broadcast(&link->cond);
+}
+
+/* Move the bytes whose wire time is over to the ready part, a character
+   at a time. Returns the time until the next one arrives, 0 if none in
+   flight. */
+static uint64_t loop_line_update(struct loop_serial_link * link,
+								 struct loop_line * ln)
+{
+	uint64_t now = loop_clock_us();
+
+	while (ln->mark_tail != ln->mark_head) {
+		unsigned int i = ln->mark_tail % LOOP_SERIAL_MARK_MAX;
+		uint64_t rem;
+		uint32_t pos;
+
+		if ((ln->mark[i].tm <= now) || (link->char_us == 0)) {
+			ln->ready = ln->mark[i].pos;
+			ln->mark_tail++;
+			continue;
+		}
+
+		/* characters of this write still on the wire */
+		rem = ln->mark[i].tm - now;
+		pos = ln->mark[i].pos - (rem + link->char_us - 1) / link->char_us;
+		if ((int32_t)(pos - ln->ready) > 0)
+			ln->ready = pos;
+
+		return ((rem - 1) % link->char_us) + 1;
+	}
+
+	return 0;
+}
+
+static int loop_line_put(struct loop_serial_end * end, uint8_t c)
+{
+	struct loop_serial_link * link = end->link;
+	struct loop_line * ln = end->tx;
+
+	while ((ln->head - ln->tail) == LOOP_SERIAL_BUF_LEN) {
+		/* the receiver can't get what is not on the wire yet */
+		loop_line_commit(link, ln);
+		if (!end->open || !link->end[(end == &link->end[0]) ? 1 : 0].open)
+			return -1;
+		loop_link_wait(link, 100000);
+	}
+
+	ln->buf[ln->head % LOOP_SERIAL_BUF_LEN] = c;
+	ln->head++;
+
+	return 0;
+}
+
+static int loop_serial_sendv(struct loop_serial_end * end,
+							 const struct serial_iov * iov, unsigned int cnt)
+{
+	struct loop_serial_link * link = end->link;
+	struct loop_line * ln = end->tx;
+	unsigned int i;
+	unsigned int j;
+	int sum = 0;
+
+	pthread_mutex_lock(&link->mutex);
+
+	for (i = 0; i < cnt; ++i) {
+		const uint8_t * cp = (const uint8_t *)iov[i].base;
+
+		for (j = 0; j < iov[i].len; ++j) {
+			uint8_t c = cp[j];
+
+			sum++;
+			ln->stat.tx_cnt++;
+
+			if ((sum == 1) && (ln->fault.nth != 0) && 
+				(c == ln->fault.chr) && (++ln->chr_cnt == ln->fault.nth)) {
+				ln->skip = ln->fault.skip;
+				ln->burst = ln->fault.burst;
+			}
+
+			if (ln->burst != 0) {
+				if (ln->skip == 0) {
+					DBG(DBG_INFO, "lose 0x%02x", c);
+					ln->burst--;
+					ln->stat.err_cnt++;
+					continue;
+				}
+				ln->skip--;
+			}
+
+			if (loop_line_fault(ln, ln->fault.drop)) {
+				DBG(DBG_INFO, "drop 0x%02x", c);
+				ln->stat.err_cnt++;
+				continue;
+			}
+
+			if (loop_line_fault(ln, ln->fault.flip)) {
+				DBG(DBG_INFO, "flip 0x%02x", c);
+				c ^= 1 << (ln->seed % 8);
+				ln->stat.err_cnt++;
+			}
+
+			if (loop_line_put(end, c) < 0)
+				goto error;
+
+			if ((c == ACK) && loop_line_fault(ln, ln->fault.dup)) {
+				DBG(DBG_INFO, "duplicate ACK");
+				ln->stat.err_cnt++;
+				if (loop_line_put(end, c) < 0)
+					goto error;
+			}
+		}
+	}
+
+	if (loop_line_fault(ln, ln->fault.can)) {
+		DBG(DBG_INFO, "spurious CAN");
+		ln->stat.err_cnt++;
+		if (loop_line_put(end, CAN) < 0)
+			goto error;
+	}
+
+	loop_line_commit(link, ln);
+	pthread_mutex_unlock(&link->mutex);
+
+	return sum;
+
+error:
+	pthread_mutex_unlock(&link->mutex);
+
+	return -1;
+}
+
+static int loop_serial_send(struct loop_serial_end * end,
+							const void * buf, unsigned int len)
+{
+	struct serial_iov iov;
+
+	iov.base = buf;
+	iov.len = len;
+
+	return loop_serial_sendv(end, &iov, 1);
+}
+
+static int loop_serial_recv(struct loop_serial_end * end, void * buf,
+							unsigned int len, unsigned int msec)
+{
+	struct loop_serial_link * link = end->link;
+	struct loop_line * ln = end->rx;
+	uint64_t deadline = loop_clock_us() + (uint64_t)msec * 1000;
+	uint8_t * cp = (uint8_t *)buf;
+	unsigned int cnt = 0;
+
+	pthread_mutex_lock(&link->mutex);
+
+	for (;;) {
+		uint64_t wait = loop_line_update(link, ln);
+		uint64_t now;
+
+		while ((ln->tail != ln->ready) && (cnt < len)) {
+			cp[cnt++] = ln->buf[ln->tail % LOOP_SERIAL_BUF_LEN];
+			ln->tail++;
+		}
+
+		if (cnt > 0) {
+			ln->stat.rx_cnt += cnt;
+			/* room for a blocked sender */
+			pthread_cond_broadcast(&link->cond);
+			break;
+		}
+
+		if (!end->open || !link->end[(end == &link->end[0]) ? 1 : 0].open) {
+			pthread_mutex_unlock(&link->mutex);
+			return -1;
+		}
+
+		if ((now = loop_clock_us()) >= deadline)
+			break;
+
+		if ((wait == 0) || (wait > deadline - now))
+			wait = deadline - now;
+
+		loop_link_wait(link, wait);
+	}
+
+	pthread_mutex_unlock(&link->mutex);
+
+	return cnt;
+}
+
+/* Wait for the data sent to go through the wire */
+static int loop_serial_drain(struct loop_serial_end * end)
+{
+	struct loop_serial_link * link = end->link;
+	uint64_t now;
+
+	pthread_mutex_lock(&link->mutex);
+
+	while ((now = loop_clock_us()) < end->tx->idle)
+		loop_link_wait(link, end->tx->idle - now);
+
+	pthread_mutex_unlock(&link->mutex);
+
+	return 0;
+}
+
+static int loop_serial_close(struct loop_serial_end * end)
+{
+	struct loop_serial_link * link = end->link;
+	bool release;
+
+	pthread_mutex_lock(&link->mutex);
+	end->open = false;
+	release = !link->end[0].open && !link->end[1].open;
+	pthread_cond_broadcast(&link->cond);
+	pthread_mutex_unlock(&link->mutex);
+
+	if (release) {
+		pthread_cond_destroy(&link->cond);
+		pthread_mutex_destroy(&link->mutex);
+		free(link);
+	}
+
+	return 0;
+}
+
+static int loop_serial_conf_set(struct loop_serial_end * end,
+								const struct serial_config * cfg)
+{
+	struct loop_serial_link * link = end->link;
+	unsigned int bits;
+
+	/* start bit, data bits, parity and stop bits */
+	bits = 1 + cfg->databits;
+	if (cfg->parity != SERIAL_PARITY_NONE)
+		bits++;
+	bits += (cfg->stopbits == SERIAL_STOPBITS_2) ? 2 : 1;
+
+	pthread_mutex_lock(&link->mutex);
+	link->cfg = *cfg;
+	link->char_us = (cfg->baudrate == 0) ? 0 :
+		(bits * 1000000 + cfg->baudrate - 1) / cfg->baudrate;
+	pthread_mutex_unlock(&link->mutex);
+
+	DBG(DBG_INFO, "%d bps, %d us/char", cfg->baudrate, link->char_us);
+
+	return 0;
+}
+
+static int loop_serial_conf_get(struct loop_serial_end * end,
+								struct serial_config * cfg)
+{
+	struct loop_serial_link * link = end->link;
+
+	pthread_mutex_lock(&link->mutex);
+	*cfg = link->cfg;
+	pthread_mutex_unlock(&link->mutex);
+
+	return 0;
+}
+
+static int loop_serial_ioctl(struct loop_serial_end * end, int opt,
+							 uintptr_t arg1, uintptr_t arg2)
+{
+	struct loop_serial_link * link = end->link;
+	struct serial_stat * stat;
+
+	switch (opt) {
+	case SERIAL_IOCTL_ENABLE:
+	case SERIAL_IOCTL_DISABLE:
+	case SERIAL_IOCTL_RESET:
+		break;
+
+	case SERIAL_IOCTL_DRAIN:
+		loop_serial_drain(end);
+		break;
+
+	case SERIAL_IOCTL_FLUSH:
+		/* discard what was received */
+		pthread_mutex_lock(&link->mutex);
+		loop_line_update(link, end->rx);
+		end->rx->tail = end->rx->ready;
+		pthread_cond_broadcast(&link->cond);
+		pthread_mutex_unlock(&link->mutex);
+		break;
+
+	case SERIAL_IOCTL_STAT_GET:
+		if ((stat = (struct serial_stat *)arg1) == NULL)
+			return -EINVAL;
+		pthread_mutex_lock(&link->mutex);
+		stat->tx_cnt = end->tx->stat.tx_cnt;
+		stat->err_cnt = end->tx->stat.err_cnt;
+		stat->rx_cnt = end->rx->stat.rx_cnt;
+		pthread_mutex_unlock(&link->mutex);
+		break;
+
+	case SERIAL_IOCTL_CONF_SET:
+		return loop_serial_conf_set(end, (struct serial_config *)arg1);
+
+	case SERIAL_IOCTL_CONF_GET:
+		if (arg1 == 0)
+			return -EINVAL;
+		return loop_serial_conf_get(end, (struct serial_config *)arg1);
+
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+const struct serial_op loop_serial_op = {
+	.send = (void *)loop_serial_send,
+	.recv = (void *)loop_serial_recv,
+	.drain = (void *)loop_serial_drain,
+	.close = (void *)loop_serial_close,
+	.ioctl = (void *)loop_serial_ioctl,
+	.sendv = (void *)loop_serial_sendv
+};
+
+int loop_serial_fault_set(struct serial_dev * dev,
+						  const struct loop_serial_fault * fault)
+{
+	struct loop_serial_end * end;
+	struct loop_line * ln;
+
+	if ((dev == NULL) || (dev->op != &loop_serial_op))
+		return -EINVAL;
+
+	end = (struct loop_serial_end *)dev->drv;
+	ln = end->tx;
+
+	pthread_mutex_lock(&end->link->mutex);
+	if (fault != NULL) {
+		ln->fault = *fault;
+		ln->seed = fault->seed;
+	} else
+		memset(&ln->fault, 0, sizeof(ln->fault));
+	ln->chr_cnt = 0;
+	ln->skip = 0;
+	ln->burst = 0;
+	pthread_mutex_unlock(&end->link->mutex);
+
+	return 0;
+}
+
+int loop_serial_open(struct serial_dev * dev[2])
+{
+	struct loop_serial_link * link;
+	int i;
+
+	if (dev == NULL)
+		return -EINVAL;
+
+	link = (struct loop_serial_link *)calloc(1, sizeof(*link));
+	if (link == NULL) {
+		DBG(DBG_WARNING, "calloc() failed!");
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&link->mutex, NULL);
+	pthread_cond_init(&link->cond, NULL);
+
+	for (i = 0; i < 2; ++i) {
+		struct loop_serial_end * end = &link->end[i];
+
+		end->link = link;
+		end->tx = &link->line[i];
+		end->rx = &link->line[i ^ 1];
+		end->open = true;
+
+		link->dev[i].drv = (void *)end;
+		link->dev[i].op = &loop_serial_op;
+		dev[i] = &link->dev[i];
+	}
+
+	return 0;
+}
+
@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
 
 static int matchhere(char *regexp, char *text);
 
@@ -34,14 +37,152 @@ static int matchhere(char *regexp, char *text)
 	return false;
 }
 
-/* match: search for regexp anywhere in text */
-bool match(char *regexp, char *text)
+/* ---------------------------------------------------------------------------
+ * Compiled patterns
+ * ---------------------------------------------------------------------------
+ */
+
+/* Patterns longer than this are not cached, they are interpreted by
+   matchhere() on every call. */
+#define RE_PATTERN_MAX 64
+/* Number of compiled patterns kept in the LRU cache */
+#define RE_CACHE_SIZE 8
+
+struct re_atom {
+	char c;
+	bool star;
+};
+
+struct re_prog {
+	uint32_t stamp; /* LRU time stamp, 0 means empty slot */
+	bool bol; /* anchored at the beginning of the text */
+	bool eol; /* anchored at the end of the text */
+	uint8_t cnt; /* number of atoms */
+	uint8_t lit_pos; /* index of the first atom of the required literal */
+	uint8_t lit_len; /* length of the required literal */
+	char lit[RE_PATTERN_MAX + 1];
+	struct re_atom atom[RE_PATTERN_MAX];
+	char pattern[RE_PATTERN_MAX + 1];
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	uint32_t clock;
+	struct re_prog prog[RE_CACHE_SIZE];
+} re_cache = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.clock = 0
+};
+
+/* re_compile: translate the pattern into a list of atoms and extract the
+   longest run of plain characters, which must be present in any
+   matching text. */
+static void re_compile(struct re_prog * re, const char * regexp)
+{
+	const char * p = regexp;
+	int run = 0;
+	int i;
+
+	strcpy(re->pattern, regexp);
+
+	re->bol = false;
+	re->eol = false;
+	re->cnt = 0;
+	re->lit_pos = 0;
+	re->lit_len = 0;
+
+	if (*p == '^') {
+		re->bol = true;
+		p++;
+	}
+
+	while (*p != '\0') {
+		struct re_atom * a = &re->atom[re->cnt];
+
+		if (p[1] == '*') {
+			a->c = p[0];
+			a->star = true;
+			p += 2;
+		} else if (p[0] == '$' && p[1] == '\0') {
+			re->eol = true;
+			p++;
+			continue;
+		} else {
+			a->c = p[0];
+			a->star = false;
+			p++;
+		}
+
+		if (a->star || a->c == '.') {
+			run = 0;
+		} else if (++run > re->lit_len) {
+			re->lit_len = run;
+			re->lit_pos = re->cnt + 1 - run;
+		}
+
+		re->cnt++;
+	}
+
+	for (i = 0; i < re->lit_len; ++i)
+		re->lit[i] = re->atom[re->lit_pos + i].c;
+	re->lit[i] = '\0';
+}
+
+/* re_here: search for the atoms starting at index i at beginning of text */
+static bool re_here(const struct re_prog * re, int i, const char * text)
+{
+	for (; i < re->cnt; ++i) {
+		const struct re_atom * a = &re->atom[i];
+
+		if (a->star) {
+			do {    /* a * matches zero or more instances */
+				if (re_here(re, i + 1, text))
+					return true;
+			} while (*text != '\0' && (*text++ == a->c || a->c == '.'));
+
+			return false;
+		}
+
+		if (*text == '\0' || (a->c != '.' && a->c != *text))
+			return false;
+
+		text++;
+	}
+
+	return re->eol ? (*text == '\0') : true;
+}
+
+static bool re_exec(const struct re_prog * re, const char * text)
 {
-	if (regexp[0] == '^')
-		return matchhere(regexp + 1, text);
+	const char * cp;
+
+	if (re->lit_len > 0) {
+		/* prefilter: reject texts lacking the required literal */
+		if (re->lit_len == 1)
+			cp = strchr(text, re->lit[0]);
+		else
+			cp = strstr(text, re->lit);
+
+		if (cp == NULL)
+			return false;
+
+		/* When the pattern starts with the literal, only the positions
+		   where the literal occurs can start a match. */
+		if (!re->bol && re->lit_pos == 0) {
+			do {
+				if (re_here(re, 0, cp))
+					return true;
+			} while ((cp = strstr(cp + 1, re->lit)) != NULL);
+
+			return false;
+		}
+	}
+
+	if (re->bol)
+		return re_here(re, 0, text);
 
 	do {    /* must look even if string is empty */
-		if (matchhere(regexp, text))
+		if (re_here(re, 0, text))
 			return true;
 
 	} while (*text++ != '\0');
@@ -49,3 +190,55 @@ bool match(char *regexp, char *text)
 	return false;
 }
 
+/* re_lookup: get a copy of the compiled pattern from the cache, compiling
+   it into the least recently used slot if not found. */
+static void re_lookup(struct re_prog * re, const char * regexp)
+{
+	struct re_prog * lru;
+	struct re_prog * p;
+	int i;
+
+	pthread_mutex_lock(&re_cache.mutex);
+
+	lru = &re_cache.prog[0];
+	for (i = 0; i < RE_CACHE_SIZE; ++i) {
+		p = &re_cache.prog[i];
+		if ((p->stamp != 0) && (strcmp(p->pattern, regexp) == 0))
+			goto found;
+		if (p->stamp < lru->stamp)
+			lru = p;
+	}
+
+	p = lru;
+	re_compile(p, regexp);
+
+found:
+	p->stamp = ++re_cache.clock;
+	*re = *p;
+
+	pthread_mutex_unlock(&re_cache.mutex);
+}
+
+/* match: search for regexp anywhere in text */
+bool match(char *regexp, char *text)
+{
+	struct re_prog re;
+
+	if (strlen(regexp) > RE_PATTERN_MAX) {
+		if (regexp[0] == '^')
+			return matchhere(regexp + 1, text);
+
+		do {    /* must look even if string is empty */
+			if (matchhere(regexp, text))
+				return true;
+
+		} while (*text++ != '\0');
+
+		return false;
+	}
+
+	re_lookup(&re, regexp);
+
+	return re_exec(&re, text);
+}
+
@@ -59,8 +59,8 @@ SFILES_OUT = $(addprefix $(OUTDIR)/, $(SFILES_GEN))
 OFILES = $(addprefix $(OUTDIR)/,\
 		   $(CFILES_GEN:.c=.o) \
 		   $(SFILES_GEN:.S=.o) \
-		   $(CFILES:.c=.o) \
-		   $(SFILES:.S=.o) \
+		   $(subst ../,,$(CFILES:.c=.o)) \
+		   $(subst ../,,$(SFILES:.S=.o)) \
 		   $(OBJS))
 #ODIRS = $(abspath $(sort $(dir $(OFILES))))
 ODIRS = $(sort $(dir $(OFILES)))
@@ -68,7 +68,8 @@ ODIRS = $(sort $(dir $(OFILES)))
 #------------------------------------------------------------------------------ 
 # dependency files
 #------------------------------------------------------------------------------ 
-DFILES = $(addprefix $(DEPDIR)/, $(CFILES:.c=.d) $(SFILES:.S=.d))
+DFILES = $(addprefix $(DEPDIR)/, $(subst ../,,$(CFILES:.c=.d)) \
+		   $(subst ../,,$(SFILES:.S=.d)))
 #DDIRS = $(abspath $(sort $(dir $(DFILES))))
 DDIRS = $(sort $(dir $(DFILES)))
 
@@ -11,6 +11,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -27,6 +28,9 @@
 
 #define Q15(VAL) (((int32_t)((VAL) * (1 << 16)) + 1) >> 1)
 
+/* Save requests arriving within this time are written together */
+#define SYSCONF_SAVE_MS 15000
+
 struct sysconf syscfg = {
 	.debug_enabled = false,
 	.quiet = true,
@@ -280,33 +284,112 @@ END_SECTION
 
 static struct {
 	bool started;
+	bool stop;
+	bool flush; /* write the pending changes now */
 	uint32_t save_req;
 	uint32_t save_ack;
+	int save_ret; /* result of the last write */
+	unsigned int save_ms;
 	char path[128];
-//	struct timer * tmr;
-	timer_t tmr;
 	pthread_mutex_t mutex;
-} confsvc;
+	pthread_cond_t cond;
+	pthread_t writer;
+} confsvc = {
+	.save_ms = SYSCONF_SAVE_MS
+};
 
+/* Write the pending changes. Called by the writer thread with
+   confsvc.mutex locked, which is released during the disk I/O. The
+   text is encoded first, as a snapshot of the values at that time. */
 static int sysconf_commit(void)
 {
+	uint32_t req = confsvc.save_req;
+	uint32_t mark;
+	size_t len;
+	char * text;
 	int ret;
 
-	if (confsvc.save_ack == confsvc.save_req) {
+	if (confsvc.save_ack == req) {
 		return 0;
 	}
 
 	DBG(DBG_TRACE, "commiting changes ...");
 
-	if ((ret = conf_save(confsvc.path, conf_root)) < 0) {
-		DBG(DBG_WARNING, "conf_save() failed!");
+	mark = conf_dirty_mark();
+	if ((ret = conf_encode(conf_root, &text, &len)) >= 0) {
+		pthread_mutex_unlock(&confsvc.mutex);
+
+		if ((ret = conf_write(confsvc.path, text, len)) < 0) {
+			DBG(DBG_WARNING, "conf_write() failed!");
+		}
+		free(text);
+
+		pthread_mutex_lock(&confsvc.mutex);
+
+		/* the values changed during the write stay dirty */
+		if (ret >= 0)
+			conf_dirty_commit(conf_root, mark);
 	}
 
-	confsvc.save_ack = confsvc.save_req;
+	confsvc.save_ack = req;
+	confsvc.save_ret = ret;
+	pthread_cond_broadcast(&confsvc.cond);
 
 	return ret;
 }
 
+/* Clock of confsvc.cond. A change of the date doesn't stretch or cut 
+   the wait on the monotonic one, winpthreads only has the real time. */
+#ifdef _WIN32
+#define SYSCONF_COND_CLOCK CLOCK_REALTIME
+#else
+#define SYSCONF_COND_CLOCK CLOCK_MONOTONIC
+#endif
+
+/* Absolute time 'ms' from now, for pthread_cond_timedwait() */
+static void sysconf_deadline(struct timespec * ts, unsigned int ms)
+{
+	clock_gettime(SYSCONF_COND_CLOCK, ts);
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/* Single writer of the file. A request waits for the others arriving
+   within confsvc.save_ms, then they are all written at once. */
+static void * sysconf_write_task(void * arg)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&confsvc.mutex);
+
+	for (;;) {
+		while ((confsvc.save_ack == confsvc.save_req) && !confsvc.stop)
+			pthread_cond_wait(&confsvc.cond, &confsvc.mutex);
+
+		/* stopping, with nothing left to write */
+		if (confsvc.save_ack == confsvc.save_req)
+			break;
+
+		DBG(DBG_INFO, "saving global configuration...");
+
+		sysconf_deadline(&ts, confsvc.save_ms);
+		while (!confsvc.stop && !confsvc.flush && 
+			   (pthread_cond_timedwait(&confsvc.cond, &confsvc.mutex, 
+									   &ts) != ETIMEDOUT));
+
+		confsvc.flush = false;
+		sysconf_commit();
+	}
+
+	pthread_mutex_unlock(&confsvc.mutex);
+
+	return NULL;
+}
+
 int sysconf_load(void)
 {
 	int ret;
@@ -328,6 +411,7 @@ int sysconf_load(void)
 
 int sysconf_save(void)
 {
+	uint32_t req;
 	int ret;
 
 	if (!confsvc.started) {
@@ -337,26 +421,21 @@ int sysconf_save(void)
 
 	pthread_mutex_lock(&confsvc.mutex);
 
-	confsvc.save_req++;
-	ret = sysconf_commit();
+	req = ++confsvc.save_req;
 
-	pthread_mutex_unlock(&confsvc.mutex);
-	return ret;
-}
-
-static void sysconf_save_req_tmo(union sigval arg)
-{
-	DBG(DBG_INFO, "saving global configuration...");
+	/* have the writer skip the wait, and wait for it */
+	confsvc.flush = true;
+	pthread_cond_broadcast(&confsvc.cond);
+	while ((int32_t)(confsvc.save_ack - req) < 0)
+		pthread_cond_wait(&confsvc.cond, &confsvc.mutex);
+	ret = confsvc.save_ret;
 
-	pthread_mutex_lock(&confsvc.mutex);
-	sysconf_commit();
 	pthread_mutex_unlock(&confsvc.mutex);
+	return ret;
 }
 
 int sysconf_save_req(void)
 {
-	struct itimerspec its;
-
 	if (!confsvc.started) {
 		DBG(DBG_WARNING, "Config service not started.");
 		return -1;
@@ -364,19 +443,24 @@ int sysconf_save_req(void)
 
 	DBG(DBG_INFO, "scheduling save ...");
 
+	pthread_mutex_lock(&confsvc.mutex);
+
 	confsvc.save_req++;
+	pthread_cond_broadcast(&confsvc.cond);
 
-	/* restart timer ... */
-	its.it_value.tv_sec = 15;
-	its.it_value.tv_nsec = 0;
-	its.it_interval.tv_sec = 0;
-	its.it_interval.tv_nsec = 0;
+	pthread_mutex_unlock(&confsvc.mutex);
+	return 0;
+}
 
-	if (timer_settime(confsvc.tmr, 0, &its, NULL) < 0) {
-		DBG(DBG_WARNING, "timer_settime() failed: %s!", strerror(errno));
-	}
+void sysconf_save_delay(unsigned int ms)
+{
+	if (confsvc.started)
+		pthread_mutex_lock(&confsvc.mutex);
 
-	return 0;
+	confsvc.save_ms = ms;
+
+	if (confsvc.started)
+		pthread_mutex_unlock(&confsvc.mutex);
 }
 
 int sysconf_delete(void)
@@ -402,8 +486,7 @@ int sysconf_delete(void)
 
 int sysconf_start(const char * path) 
 {
-	struct sigevent sev;
-	pthread_attr_t attr;
+	pthread_condattr_t attr;
 
 	if (confsvc.started)
 		return 0;
@@ -414,25 +497,25 @@ int sysconf_start(const char * path)
 	strcpy(confsvc.path, path);
 
 	pthread_mutex_init(&confsvc.mutex, NULL);
+	pthread_condattr_init(&attr);
+#ifndef _WIN32
+	pthread_condattr_setclock(&attr, SYSCONF_COND_CLOCK);
+#endif
+	pthread_cond_init(&confsvc.cond, &attr);
+	pthread_condattr_destroy(&attr);
 
 	confsvc.save_req = 0;
 	confsvc.save_ack = 0;
+	confsvc.flush = false;
+	confsvc.stop = false;
 
- /* Create the timer */
-	pthread_attr_init(&attr);
-
-	sev.sigev_notify = SIGEV_THREAD;
-	sev.sigev_notify_function = sysconf_save_req_tmo;
-	sev.sigev_notify_attributes = &attr;
-	sev.sigev_value.sival_ptr = &confsvc.tmr;
-
-	if (timer_create(CLOCK_MONOTONIC, &sev, &confsvc.tmr) < 0) {
-		DBG(DBG_ERROR, "timer_create() failed: %s.", strerror(errno));
+	if (pthread_create(&confsvc.writer, NULL, sysconf_write_task, NULL) != 0) {
+		DBG(DBG_ERROR, "pthread_create() failed!");
+		pthread_cond_destroy(&confsvc.cond);
+		pthread_mutex_destroy(&confsvc.mutex);
 		return -1;
 	}
 
-	pthread_attr_destroy(&attr);
-
 	DBG(DBG_TRACE, "Config service started (%s).", path);
 
 	confsvc.started = true;
@@ -446,15 +529,15 @@ int sysconf_stop(void)
 	if (!confsvc.started)
 		return -1;
 
+	/* the writer commits any pending save request before leaving */
 	pthread_mutex_lock(&confsvc.mutex);
-
-	/* commit any pending save request */
-	sysconf_commit();
-
-	timer_delete(confsvc.tmr);
-
+	confsvc.stop = true;
+	pthread_cond_broadcast(&confsvc.cond);
 	pthread_mutex_unlock(&confsvc.mutex);
 
+	pthread_join(confsvc.writer, NULL);
+
+	pthread_cond_destroy(&confsvc.cond);
 	pthread_mutex_destroy(&confsvc.mutex);
 
 	DBG(DBG_TRACE, "Config service stopped.");
@@ -11,6 +11,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -18,20 +19,39 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <stdbool.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 
 #include "debug.h"
 #include "syscfg.h"
 #include "conf.h"
+#include "crc.h"
+#include "fmap.h"
+
+/* Period of the configuration file checks where there is no inotify */
+#define SYSCFG_POLL_MS 1000
+/* Time for a change to the file to settle before reloading it */
+#define SYSCFG_SETTLE_MS 100
+/* Save requests arriving within this time are written together */
+#define SYSCFG_SAVE_MS 1000
+
+#define SYSCFG_DEFAULT { \
+	.debug_enabled = false, \
+	.quiet = true, \
+	.session = { \
+		.name = "Default", \
+		.port = "COM1", \
+		.tmo_ms = 500 \
+	} \
+}
 
-struct syscfg syscfg = {
-	.debug_enabled = false,
-	.quiet = true,
-	.session = {
-		.name = "Default",
-		.port = "COM1",
-		.tmo_ms = 500
-	}
-};
+static const struct syscfg syscfg_default = SYSCFG_DEFAULT;
+
+/* Working copy, the configuration tables point into it. Only the
+   configuration service changes it, with confsvc.mutex locked. */
+struct syscfg syscfg = SYSCFG_DEFAULT;
 
 BEGIN_SECTION(conf_session)
 	DEFINE_STRINGCNT("name", &syscfg.session.name, SESSION_NAME_MAX)
@@ -47,31 +67,222 @@ END_SECTION
 
 static struct {
 	bool started;
+	volatile bool stop;
+	bool flush; /* write the pending changes now */
+	bool writing; /* the file is being replaced */
+	bool reload; /* a change of the file waits for the pending save */
 	uint32_t save_req;
 	uint32_t save_ack;
+	int save_ret; /* result of the last write */
+	unsigned int save_ms;
 	char path[128];
 	pthread_mutex_t mutex;
-} confsvc;
+	pthread_cond_t cond;
+	pthread_t watcher;
+	pthread_t writer;
+	/* the file as last loaded or saved */
+	struct {
+		time_t mtime;
+		off_t size;
+		ino_t ino;
+		uint32_t crc; /* of the contents */
+	} stamp;
+} confsvc = {
+	.save_ms = SYSCFG_SAVE_MS
+};
+
+/* Copy of the working configuration published to the readers. The
+   sequence count is odd while the copy is being updated. */
+static struct {
+	uint32_t seq;
+	struct syscfg cfg;
+} cfgpub;
+
+/* Publish the working copy. Must be called with confsvc.mutex locked. */
+static void syscfg_publish(void)
+{
+	uint32_t seq = cfgpub.seq;
+
+	__atomic_store_n(&cfgpub.seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&cfgpub.cfg, &syscfg, sizeof(struct syscfg));
+	__atomic_store_n(&cfgpub.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Publish the working copy if it differs from the published one, the
+   generation only moves on a change. Must be called with confsvc.mutex
+   locked. */
+static void syscfg_update(void)
+{
+	if (memcmp(&cfgpub.cfg, &syscfg, sizeof(struct syscfg)) != 0)
+		syscfg_publish();
+}
+
+unsigned int syscfg_get(struct syscfg * cfg)
+{
+	uint32_t seq;
+
+	do {
+		while ((seq = __atomic_load_n(&cfgpub.seq, __ATOMIC_ACQUIRE)) & 1);
+		memcpy(cfg, &cfgpub.cfg, sizeof(struct syscfg));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&cfgpub.seq, __ATOMIC_RELAXED) != seq);
+
+	return seq >> 1;
+}
+
+/* Record the state of the file. Returns true if it changed since the
+   last call. The time has a resolution of a second and may be set back,
+   so the contents are compared too. */
+static bool syscfg_stamp(void)
+{
+	struct stat st;
+	uint32_t crc = 0;
+	size_t size;
+	void * ptr;
+
+	if (stat(confsvc.path, &st) < 0)
+		memset(&st, 0, sizeof(st));
+	else if ((ptr = fmap(confsvc.path, &size)) != NULL) {
+		crc = ~crc32(~0UL, ptr, size);
+		funmap(ptr, size);
+	}
+
+	if ((st.st_mtime == confsvc.stamp.mtime) && 
+		(st.st_size == confsvc.stamp.size) &&
+		(st.st_ino == confsvc.stamp.ino) &&
+		(crc == confsvc.stamp.crc))
+		return false;
+
+	confsvc.stamp.mtime = st.st_mtime;
+	confsvc.stamp.size = st.st_size;
+	confsvc.stamp.ino = st.st_ino;
+	confsvc.stamp.crc = crc;
+
+	return true;
+}
+
+/* Parse the file. The values not in the file go back to their defaults,
+   and on a parse error the previous values are kept. Readers only see
+   the result once it is complete. Must be called with confsvc.mutex
+   locked. */
+static int syscfg_parse(void)
+{
+	struct syscfg prev;
+	int ret;
+
+	DBG(DBG_TRACE, "reloading \"%s\" ...", confsvc.path);
+
+	memcpy(&prev, &syscfg, sizeof(struct syscfg));
+	memcpy(&syscfg, &syscfg_default, sizeof(struct syscfg));
+
+	if ((ret = conf_load(confsvc.path, conf_root)) < 0) {
+		DBG(DBG_WARNING, "conf_load() failed!");
+		memcpy(&syscfg, &prev, sizeof(struct syscfg));
+	} else {
+		syscfg_update();
+	}
+
+	return ret;
+}
 
+/* Write the pending changes. Called by the writer thread with
+   confsvc.mutex locked, which is released during the disk I/O. The
+   text is encoded first, as a snapshot of the values at that time. */
 static int syscfg_commit(void)
 {
+	uint32_t req = confsvc.save_req;
+	uint32_t mark;
+	size_t len;
+	char * text;
 	int ret;
 
-	if (confsvc.save_ack == confsvc.save_req) {
+	if (confsvc.save_ack == req) {
 		return 0;
 	}
 
 	DBG(DBG_TRACE, "commiting changes ...");
 
-	if ((ret = conf_save(confsvc.path, conf_root)) < 0) {
-		DBG(DBG_WARNING, "conf_save() failed!");
+	mark = conf_dirty_mark();
+	if ((ret = conf_encode(conf_root, &text, &len)) >= 0) {
+		confsvc.writing = true;
+		pthread_mutex_unlock(&confsvc.mutex);
+
+		if ((ret = conf_write(confsvc.path, text, len)) < 0) {
+			DBG(DBG_WARNING, "conf_write() failed!");
+		}
+		free(text);
+
+		pthread_mutex_lock(&confsvc.mutex);
+		confsvc.writing = false;
+
+		/* the values changed during the write stay dirty */
+		if (ret >= 0)
+			conf_dirty_commit(conf_root, mark);
 	}
 
-	confsvc.save_ack = confsvc.save_req;
+	confsvc.save_ack = req;
+	confsvc.save_ret = ret;
+	/* Our own changes are not reloaded. A change deferred by the save
+	   is gone once it is written, if not the file still holds it. */
+	if (syscfg_stamp() && confsvc.reload && (ret < 0))
+		syscfg_parse();
+	confsvc.reload = false;
+	pthread_cond_broadcast(&confsvc.cond);
 
 	return ret;
 }
 
+/* Clock of confsvc.cond. A change of the date doesn't stretch or cut 
+   the wait on the monotonic one, winpthreads only has the real time. */
+#ifdef _WIN32
+#define SYSCFG_COND_CLOCK CLOCK_REALTIME
+#else
+#define SYSCFG_COND_CLOCK CLOCK_MONOTONIC
+#endif
+
+/* Absolute time 'ms' from now, for pthread_cond_timedwait() */
+static void syscfg_deadline(struct timespec * ts, unsigned int ms)
+{
+	clock_gettime(SYSCFG_COND_CLOCK, ts);
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/* Single writer of the file. A request waits for the others arriving
+   within confsvc.save_ms, then they are all written at once. */
+static void * syscfg_write_task(void * arg)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&confsvc.mutex);
+
+	for (;;) {
+		while ((confsvc.save_ack == confsvc.save_req) && !confsvc.stop)
+			pthread_cond_wait(&confsvc.cond, &confsvc.mutex);
+
+		/* stopping, with nothing left to write */
+		if (confsvc.save_ack == confsvc.save_req)
+			break;
+
+		syscfg_deadline(&ts, confsvc.save_ms);
+		while (!confsvc.stop && !confsvc.flush && 
+			   (pthread_cond_timedwait(&confsvc.cond, &confsvc.mutex, 
+									   &ts) != ETIMEDOUT));
+
+		confsvc.flush = false;
+		syscfg_commit();
+	}
+
+	pthread_mutex_unlock(&confsvc.mutex);
+
+	return NULL;
+}
+
 int syscfg_load(void)
 {
 	int ret;
@@ -83,16 +294,111 @@ int syscfg_load(void)
 
 	pthread_mutex_lock(&confsvc.mutex);
 
+	syscfg_stamp();
 	if ((ret = conf_load(confsvc.path, conf_root)) < 0) {
 		DBG(DBG_WARNING, "conf_load() failed!");
 	}
+	syscfg_update();
 
 	pthread_mutex_unlock(&confsvc.mutex);
 	return 0;
 }
 
+/* Parse the file again if it changed, or note it for later while a 
+   save is pending: that one replaces the file with the working copy. */
+static int syscfg_reload(void)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&confsvc.mutex);
+
+	/* while we write the file, its changes are ours */
+	if (!confsvc.writing) {
+		if (confsvc.save_ack != confsvc.save_req)
+			confsvc.reload = true;
+		else if (syscfg_stamp())
+			ret = syscfg_parse();
+	}
+
+	pthread_mutex_unlock(&confsvc.mutex);
+
+	return ret;
+}
+
+static void * syscfg_watch_task(void * arg)
+{
+#ifdef __linux__
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event * ev;
+	struct pollfd pfd;
+	char dir[128];
+	char * name;
+	int n;
+
+	/* Watch the directory, editors often replace the file instead of
+	   writing to it */
+	strcpy(dir, confsvc.path);
+	if ((name = strrchr(dir, '/')) != NULL) {
+		*name++ = '\0';
+	} else {
+		name = confsvc.path;
+		strcpy(dir, ".");
+	}
+
+	pfd.events = POLLIN;
+	if ((pfd.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+		DBG(DBG_WARNING, "inotify_init1(): %s.", strerror(errno));
+	} else if (inotify_add_watch(pfd.fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO |
+								 IN_DELETE) < 0) {
+		DBG(DBG_WARNING, "inotify_add_watch(): %s.", strerror(errno));
+		close(pfd.fd);
+		pfd.fd = -1;
+	}
+
+	while (!confsvc.stop) {
+		bool changed = false;
+
+		if (pfd.fd < 0) {
+			/* no inotify, check the file periodically */
+			usleep(SYSCFG_POLL_MS * 1000);
+			syscfg_reload();
+			continue;
+		}
+
+		if (poll(&pfd, 1, SYSCFG_POLL_MS) <= 0)
+			continue;
+
+		/* let a burst of writes settle */
+		do {
+			while ((n = read(pfd.fd, buf, sizeof(buf))) > 0) {
+				for (ev = (struct inotify_event *)buf; 
+					 (char *)ev < buf + n; ev = (struct inotify_event *)
+					 ((char *)ev + sizeof(*ev) + ev->len)) {
+					if ((ev->len > 0) && (strcmp(ev->name, name) == 0))
+						changed = true;
+				}
+			}
+		} while (poll(&pfd, 1, SYSCFG_SETTLE_MS) > 0);
+
+		if (changed)
+			syscfg_reload();
+	}
+
+	if (pfd.fd >= 0)
+		close(pfd.fd);
+#else
+	while (!confsvc.stop) {
+		usleep(SYSCFG_POLL_MS * 1000);
+		syscfg_reload();
+	}
+#endif
+
+	return NULL;
+}
+
 int syscfg_save(void)
 {
+	uint32_t req;
 	int ret;
 
 	if (!confsvc.started) {
@@ -102,13 +408,51 @@ int syscfg_save(void)
 
 	pthread_mutex_lock(&confsvc.mutex);
 
-	confsvc.save_req++;
-	ret = syscfg_commit();
+	req = ++confsvc.save_req;
+	/* the working copy may have been changed directly */
+	syscfg_update();
+
+	/* have the writer skip the wait, and wait for it */
+	confsvc.flush = true;
+	pthread_cond_broadcast(&confsvc.cond);
+	while ((int32_t)(confsvc.save_ack - req) < 0)
+		pthread_cond_wait(&confsvc.cond, &confsvc.mutex);
+	ret = confsvc.save_ret;
 
 	pthread_mutex_unlock(&confsvc.mutex);
 	return ret;
 }
 
+int syscfg_save_req(void)
+{
+	if (!confsvc.started) {
+		DBG(DBG_WARNING, "Config service not started.");
+		return -1;
+	}
+
+	DBG(DBG_INFO, "scheduling save ...");
+
+	pthread_mutex_lock(&confsvc.mutex);
+
+	confsvc.save_req++;
+	syscfg_update();
+	pthread_cond_broadcast(&confsvc.cond);
+
+	pthread_mutex_unlock(&confsvc.mutex);
+	return 0;
+}
+
+void syscfg_save_delay(unsigned int ms)
+{
+	if (confsvc.started)
+		pthread_mutex_lock(&confsvc.mutex);
+
+	confsvc.save_ms = ms;
+
+	if (confsvc.started)
+		pthread_mutex_unlock(&confsvc.mutex);
+}
+
 int syscfg_delete(void)
 {
 	if (confsvc.started) {
@@ -130,8 +474,25 @@ int syscfg_delete(void)
 	return 0;
 }
 
+/* Stop the writer, once it has written the pending requests */
+static void syscfg_writer_stop(void)
+{
+	confsvc.stop = true;
+
+	pthread_mutex_lock(&confsvc.mutex);
+	pthread_cond_broadcast(&confsvc.cond);
+	pthread_mutex_unlock(&confsvc.mutex);
+
+	pthread_join(confsvc.writer, NULL);
+
+	pthread_cond_destroy(&confsvc.cond);
+	pthread_mutex_destroy(&confsvc.mutex);
+}
+
 int syscfg_start(const char * path) 
 {
+	pthread_condattr_t attr;
+
 	if (confsvc.started)
 		return 0;
 
@@ -141,11 +502,42 @@ int syscfg_start(const char * path)
 	strcpy(confsvc.path, path);
 
 	pthread_mutex_init(&confsvc.mutex, NULL);
+	pthread_condattr_init(&attr);
+#ifndef _WIN32
+	pthread_condattr_setclock(&attr, SYSCFG_COND_CLOCK);
+#endif
+	pthread_cond_init(&confsvc.cond, &attr);
+	pthread_condattr_destroy(&attr);
 
 	confsvc.save_req = 0;
 	confsvc.save_ack = 0;
+	confsvc.flush = false;
+	confsvc.reload = false;
+	confsvc.stop = false;
 
- /* Create the timer */
+	/* The watcher only reloads a file that changes after the stamp, so
+	   the one there now is loaded here. A change made after the stamp
+	   is still seen, as in syscfg_load(). */
+	pthread_mutex_lock(&confsvc.mutex);
+	syscfg_stamp();
+	if (conf_load(confsvc.path, conf_root) < 0) {
+		DBG(DBG_WARNING, "conf_load() failed!");
+	}
+	syscfg_publish();
+	pthread_mutex_unlock(&confsvc.mutex);
+
+	if (pthread_create(&confsvc.writer, NULL, syscfg_write_task, NULL) != 0) {
+		DBG(DBG_WARNING, "pthread_create() failed!");
+		pthread_cond_destroy(&confsvc.cond);
+		pthread_mutex_destroy(&confsvc.mutex);
+		return -1;
+	}
+
+	if (pthread_create(&confsvc.watcher, NULL, syscfg_watch_task, NULL) != 0) {
+		DBG(DBG_WARNING, "pthread_create() failed!");
+		syscfg_writer_stop();
+		return -1;
+	}
 
 	DBG(DBG_TRACE, "Config service started (%s).", path);
 
@@ -160,14 +552,11 @@ int syscfg_stop(void)
 	if (!confsvc.started)
 		return -1;
 
-	pthread_mutex_lock(&confsvc.mutex);
+	confsvc.stop = true;
+	pthread_join(confsvc.watcher, NULL);
 
 	/* commit any pending save request */
-	syscfg_commit();
-
-	pthread_mutex_unlock(&confsvc.mutex);
-
-	pthread_mutex_destroy(&confsvc.mutex);
+	syscfg_writer_stop();
 
 	DBG(DBG_TRACE, "Config service stopped.");
 
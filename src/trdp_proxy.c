@@ -51,6 +51,10 @@ void trdp_proxy_main(void * arg)
 {
 	char * port = serial_port;
 	struct port_entry lst[32];
+	struct syscfg cfg;
+	struct syscfg cur; /* the session in use */
+	unsigned int gen;
+	unsigned int n;
 	int cnt;
 	int i;
 
@@ -67,8 +71,20 @@ void trdp_proxy_main(void * arg)
 	}
 
 	i = 0;
-	port = syscfg.session.port;
+	gen = syscfg_get(&cur);
+	port = cur.session.port;
 	for(;;) {
+		/* a new session takes over from the port scan, other changes
+		   of the configuration leave it alone */
+		if ((n = syscfg_get(&cfg)) != gen) {
+			gen = n;
+			if (memcmp(&cfg.session, &cur.session,
+					   sizeof(cfg.session)) != 0) {
+				memcpy(&cur, &cfg, sizeof(struct syscfg));
+				port = cur.session.port;
+				i = 0;
+			}
+		}
 		
 		DBG(DBG_INFO, "win_serial_open() ...");
 		if ((ser = win_serial_open(port)) == NULL) {
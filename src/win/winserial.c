@@ -23,6 +23,8 @@
 #include "debug.h"
 
 #define SERIAL_DEV_RX_BUF_LEN 128
+/* Gather buffer for win_serial_sendv(), room for an 8K packet */
+#define SERIAL_DEV_TX_BUF_LEN (8192 + 16)
 
 /* termios serial device */
 struct win_serial_drv {
@@ -36,6 +38,9 @@ struct win_serial_drv {
 		unsigned int cnt;
 		uint8_t buf[SERIAL_DEV_RX_BUF_LEN];
 	} rx;
+	struct {
+		uint8_t buf[SERIAL_DEV_TX_BUF_LEN];
+	} tx;
 };
 
 int win_serial_send(struct win_serial_drv * drv, 
@@ -99,6 +104,39 @@ int win_serial_send(struct win_serial_drv * drv,
 	return fRes ? len : -1;
 }
 
+/* Each WriteFile() is a round trip through the driver, the segments 
+   are gathered to go out in a single one. */
+int win_serial_sendv(struct win_serial_drv * drv, 
+					 const struct serial_iov * iov, unsigned int cnt)
+{
+	unsigned int len = 0;
+	unsigned int i;
+	int sum = 0;
+	int ret;
+
+	for (i = 0; i < cnt; ++i)
+		len += iov[i].len;
+
+	if (len <= SERIAL_DEV_TX_BUF_LEN) {
+		uint8_t * dst = drv->tx.buf;
+
+		for (i = 0; i < cnt; ++i) {
+			memcpy(dst, iov[i].base, iov[i].len);
+			dst += iov[i].len;
+		}
+
+		return win_serial_send(drv, drv->tx.buf, len);
+	}
+
+	for (i = 0; i < cnt; ++i) {
+		if ((ret = win_serial_send(drv, iov[i].base, iov[i].len)) < 0)
+			return ret;
+		sum += ret;
+	}
+
+	return sum;
+}
+
 int win_serial_recv(struct win_serial_drv * drv, char * buf, 
 					unsigned int max, unsigned int tmo_msec)
 {
@@ -317,6 +355,35 @@ static int win_serial_conf_set(struct win_serial_drv * drv,
 	return 0;
 }
 
+static int win_serial_conf_get(struct win_serial_drv * drv, 
+							   struct serial_config * cfg)
+{
+	assert(drv != NULL);
+	assert(cfg != NULL);
+
+	cfg->baudrate = drv->dcb.BaudRate;
+	cfg->databits = drv->dcb.ByteSize;
+
+	switch (drv->dcb.Parity) {
+		case ODDPARITY: 
+			cfg->parity = SERIAL_PARITY_ODD;
+			break;
+		case EVENPARITY: 
+			cfg->parity = SERIAL_PARITY_EVEN;
+			break;
+		default:
+			cfg->parity = SERIAL_PARITY_NONE;
+			break;
+	}
+
+	cfg->stopbits = (drv->dcb.StopBits == TWOSTOPBITS) ? 
+		SERIAL_STOPBITS_2 : SERIAL_STOPBITS_1;
+	cfg->flowctrl = (drv->dcb.fOutxCtsFlow) ? SERIAL_FLOWCTRL_RTSCTS : 
+		(drv->dcb.fOutX) ? SERIAL_FLOWCTRL_XONXOFF : SERIAL_FLOWCTRL_NONE;
+
+	return 0;
+}
+
 int win_serial_ioctl(struct win_serial_drv * drv, int opt, 
 					 uintptr_t arg1, uintptr_t arg2)
 {
@@ -341,6 +408,9 @@ int win_serial_ioctl(struct win_serial_drv * drv, int opt,
 		win_serial_conf_set(drv, (struct serial_config *)arg1);
 		break;
 
+	case SERIAL_IOCTL_CONF_GET: 
+		return win_serial_conf_get(drv, (struct serial_config *)arg1);
+
 	default:
 		return -EINVAL;
 	}
@@ -353,7 +423,8 @@ const struct serial_op win_serial_op = {
 	.recv = (void *)win_serial_recv,
 	.drain = (void *)win_serial_drain,
 	.close = (void *)win_serial_close,
-	.ioctl = (void *)win_serial_ioctl
+	.ioctl = (void *)win_serial_ioctl,
+	.sendv = (void *)win_serial_sendv
 };
 
 struct serial_dev * win_serial_open(const char * com_port)
@@ -0,0 +1,286 @@
+/* 
+ * Copyright(C) 2012-2014 Robinson Mittmann. All Rights Reserved.
+ * 
+ * This file is part of the YARD-ICE.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You can receive a copy of the GNU Lesser General Public License from 
+ * http://www.gnu.org/
+ */
+
+/** 
+ * @file private.h
+ * @brief YARD-ICE X/YMODEM internals
+ * @author Robinson Mittmann <bobmittmann@gmail.com>
+ */
+
+#ifndef __XYMODEM_PRIVATE_H__
+#define __XYMODEM_PRIVATE_H__
+
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "xmodem.h"
+#include "crc.h"
+
+#define SOH  0x01
+#define STX  0x02
+#define EOT  0x04
+#define ACK  0x06
+#define NAK  0x15
+#define CAN  0x18
+/* Extended packet start. The sequence, its complement and the block
+   size in KB follow, then the data and a CRC32 over size and data. */
+#define XTX  0x03
+
+/* Extended mode request, followed by the largest block size in KB 
+   as an ASCII digit */
+#define XMODEM_SYNC_EXT 'X'
+
+/* Retransmission timeout bounds */
+#define XMODEM_RTO_MIN_MS 20
+#define XMODEM_RTO_MAX_MS 2000
+/* Timeout used until the first round trip is measured */
+#define XMODEM_RTO_INIT_MS 500
+
+/* Resume: the file is compared in blocks of this size */
+#define XMODEM_RESUME_BLK 1024
+/* Resume: the receiver replies to the manifest with this frame start,
+   followed by the bitmap of the blocks to send and its CRC16 */
+#define XMODEM_RESUME_MAP 'B'
+
+/* Resume: the manifest holds the CRC32 of each block, little endian,
+   padded to whole packets */
+static inline unsigned int xmodem_manifest_len(unsigned int nblk)
+{
+	return ((nblk * 4) + XMODEM_RESUME_BLK - 1) & ~(XMODEM_RESUME_BLK - 1);
+}
+
+static inline uint32_t xmodem_blk_crc32(const uint8_t * data, 
+										size_t size, unsigned int blk)
+{
+	size_t off = (size_t)blk * XMODEM_RESUME_BLK;
+	size_t len = size - off;
+
+	if (len > XMODEM_RESUME_BLK)
+		len = XMODEM_RESUME_BLK;
+
+	return ~crc32(~0UL, data + off, len);
+}
+
+/* Time to push 'len' bytes through the line, 10 bits each, in 
+   milliseconds. 0 if the rate is unknown. */
+static inline uint32_t xmodem_wire_ms(uint32_t baud, unsigned int len)
+{
+	if (baud == 0)
+		return 0;
+
+	return ((uint64_t)len * 10000 + baud - 1) / baud;
+}
+
+/* Line rate of 'dev', 0 if the driver can't tell */
+static inline uint32_t xmodem_baud_get(struct serial_dev * dev)
+{
+	struct serial_config cfg;
+
+	if (serial_config_get(dev, &cfg) < 0)
+		return 0;
+
+	return cfg.baudrate;
+}
+
+/* Largest extended block size enabled by the options, in KB. On slow
+   lines it is limited to what goes through within the largest 
+   retransmission timeout. */
+static inline unsigned int xmodem_ext_max(unsigned int opt, uint32_t baud)
+{
+	unsigned int n = 0;
+
+	if (opt & XMODEM_OPT_BLK8K)
+		n = 8;
+	else if (opt & XMODEM_OPT_BLK4K)
+		n = 4;
+
+	if (n > XMODEM_PKT_DATA_MAX / 1024)
+		n = XMODEM_PKT_DATA_MAX / 1024;
+
+	while ((n > 1) && (xmodem_wire_ms(baud, n * 1024) > XMODEM_RTO_MAX_MS))
+		n /= 2;
+
+	return n;
+}
+
+/* Monotonic clock in milliseconds */
+static inline uint32_t xmodem_clock_ms(void)
+{
+#ifdef _WIN32
+	return GetTickCount();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static inline void xmodem_rtt_init(struct xmodem_rtt * rtt, uint32_t baud)
+{
+	rtt->srtt = 0;
+	rtt->rttvar = 0;
+	rtt->rto = XMODEM_RTO_INIT_MS;
+	rtt->len = 0;
+	rtt->baud = baud;
+}
+
+/* Largest timeout. A packet takes its wire time on top of the round 
+   trip, which may exceed the bound by itself on slow lines. */
+static inline uint32_t xmodem_rtt_max(struct xmodem_rtt * rtt)
+{
+	return XMODEM_RTO_MAX_MS + xmodem_wire_ms(rtt->baud, rtt->len);
+}
+
+/* Timeout from the current estimate, without backoff */
+static inline uint32_t xmodem_rtt_base(struct xmodem_rtt * rtt)
+{
+	uint32_t rto;
+
+	if (rtt->srtt == 0)
+		return XMODEM_RTO_INIT_MS + xmodem_wire_ms(rtt->baud, rtt->len);
+
+	rto = (rtt->srtt >> 3) + rtt->rttvar;
+
+	if (rto < XMODEM_RTO_MIN_MS)
+		rto = XMODEM_RTO_MIN_MS;
+	else if (rto > xmodem_rtt_max(rtt))
+		rto = xmodem_rtt_max(rtt);
+
+	return rto;
+}
+
+/* Undo the backoff. Once a retransmitted packet gets through the line is
+   fine again, keeping the backed off value would only slow down the next 
+   recovery. */
+static inline void xmodem_rtt_restore(struct xmodem_rtt * rtt)
+{
+	if (rtt->srtt != 0)
+		rtt->rto = xmodem_rtt_base(rtt);
+}
+
+/* Feed a round trip sample, Jacobson/Karels as in TCP (RFC 6298). The 
+   smoothed RTT is kept scaled by 8 and the variance by 4. Samples from
+   retransmitted packets are ambiguous and must not be fed (Karn). */
+static inline void xmodem_rtt_update(struct xmodem_rtt * rtt, uint32_t ms)
+{
+	int32_t m = ms;
+
+	if (rtt->srtt == 0) {
+		rtt->srtt = (m << 3) | 1;
+		rtt->rttvar = m << 1;
+	} else {
+		m -= (rtt->srtt >> 3);
+		rtt->srtt += m;
+		if (m < 0)
+			m = -m;
+		m -= (rtt->rttvar >> 2);
+		rtt->rttvar += m;
+	}
+
+	xmodem_rtt_restore(rtt);
+}
+
+/* The sender's round trip includes the wire time of the packet. When 
+   the packet size changes, scale the estimate to the new size until 
+   samples of that size come in. */
+static inline void xmodem_rtt_resize(struct xmodem_rtt * rtt, 
+									 unsigned int len)
+{
+	if ((rtt->len == 0) || (rtt->srtt == 0)) {
+		rtt->len = len;
+		/* no estimate yet, the initial timeout covers the packet */
+		if ((rtt->srtt == 0) && (rtt->rto < xmodem_rtt_base(rtt)))
+			rtt->rto = xmodem_rtt_base(rtt);
+		return;
+	}
+
+	rtt->srtt = ((uint64_t)rtt->srtt * len / rtt->len) | 1;
+	rtt->rttvar = (uint64_t)rtt->rttvar * len / rtt->len;
+	rtt->len = len;
+
+	xmodem_rtt_restore(rtt);
+}
+
+/* Exponential backoff after a timeout */
+static inline void xmodem_rtt_backoff(struct xmodem_rtt * rtt)
+{
+	uint32_t max = xmodem_rtt_max(rtt);
+
+	rtt->rto = (rtt->rto < (max / 2)) ? rtt->rto * 2 : max;
+}
+
+/* Start the accounting of a new file */
+static inline void xmodem_meter_start(struct xmodem_meter * m, 
+									  unsigned int total)
+{
+	m->t0 = xmodem_clock_ms();
+	m->t_last = m->t0;
+	m->bytes = 0;
+	m->last = 0;
+	m->total = total;
+	m->retries = 0;
+}
+
+/* Account 'cnt' more bytes, report if the interval is over or at the 
+   end of the file */
+static inline void xmodem_meter_update(struct xmodem_meter * m, 
+									   const struct xmodem_rtt * rtt,
+									   unsigned int cnt, bool end)
+{
+	struct xmodem_progress p;
+	uint32_t now;
+
+	m->bytes += cnt;
+	/* the padding of the last block is not file data */
+	if ((m->total != 0) && (m->bytes > m->total))
+		m->bytes = m->total;
+
+	if (m->cb == NULL)
+		return;
+
+	now = xmodem_clock_ms();
+	if (!end && ((now - m->t_last) < m->interval))
+		return;
+
+	p.bytes = m->bytes;
+	p.total = m->total;
+	p.rate = (now == m->t_last) ? 0 : 
+		(uint64_t)(m->bytes - m->last) * 1000 / (now - m->t_last);
+	p.avg_rate = (now == m->t0) ? 0 : 
+		(uint64_t)m->bytes * 1000 / (now - m->t0);
+	p.retries = m->retries;
+	p.elapsed_ms = now - m->t0;
+	p.srtt_ms = rtt->srtt >> 3;
+	p.rto_ms = rtt->rto;
+	p.done = end;
+
+	m->t_last = now;
+	m->last = m->bytes;
+
+	m->cb(m->arg, &p);
+}
+
+#endif /* __XYMODEM_PRIVATE_H__ */
+
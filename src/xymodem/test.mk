@@ -0,0 +1,15 @@
+# X/YMODEM loopback test and benchmark, built by "make test"
+
+include ../mk/config.mk
+
+PROG = xmtest
+
+CFILES = test/xmtest.c ../loopserial.c ../fmap.c ../delta.c ../flash.c
+
+LIBDIRS = . ../libcrc
+
+LIBS = xymodem crc pthread
+
+INCPATH = ../include
+
+include ../mk/prog.mk
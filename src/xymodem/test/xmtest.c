@@ -0,0 +1,761 @@
+/*
+ * Copyright(C) 2012-2014 Robinson Mittmann. All Rights Reserved.
+ *
+ * This file is part of the YARD-ICE.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You can receive a copy of the GNU Lesser General Public License from
+ * http://www.gnu.org/
+ */
+
+/**
+ * @file xmtest.c
+ * @brief X/YMODEM transfers over the in-memory serial link
+ * @author Robinson Mittmann <bobmittmann@gmail.com>
+ *
+ * The sender and the receiver run against each other over a loopserial
+ * link, with faults injected on either direction. The first cases lose
+ * the control characters the protocol can't do without and check that
+ * the file still gets through. The uploads of delta.c and flash.c run
+ * next, against batch receivers. The benchmark then measures the goodput
+ * and the time lost per fault across block sizes and baud rates.
+ *
+ * Usage: xmtest [-q | -b]
+ *   -q  skip the benchmark
+ *   -b  run the benchmark only
+ *
+ * The files are written to the current directory. Exits with 1 if any
+ * transfer fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <time.h>
+#endif
+
+#include "xmodem.h"
+#include "loopserial.h"
+#include "delta.h"
+#include "flash.h"
+#include "fmap.h"
+
+#define STX 0x02
+#define ACK 0x06
+
+#define XMT_SRC "xmtest.src"
+#define XMT_DST "xmtest.dst"
+/* delta_upload() image cache */
+#define XMT_CACHE "xmtest.cache"
+/* flash_batch() targets */
+#define XMT_TARGETS 4
+
+struct xmt_run {
+	/* set by the caller */
+	const char * name;
+	unsigned int opt; /* options of both ends */
+	unsigned int baud; /* 0 for no wire delays */
+	unsigned int size;
+	bool xmodem; /* XMODEM transfer, no header */
+	bool x1k; /* XMODEM-1K sender */
+	bool cks; /* checksum receiver */
+	bool nosize; /* header with no file size */
+	unsigned int hdr_size; /* bogus size in the header */
+	bool fail; /* both ends must give up */
+	bool resume; /* the receiver holds a damaged copy of the file */
+	struct loop_serial_fault fwd; /* on the packets */
+	struct loop_serial_fault rev; /* on the responses */
+	/* results */
+	int status; /* 0 if the file got through */
+	uint32_t ms;
+	unsigned int blk; /* block size used */
+	unsigned int retries;
+	unsigned int faults;
+	/* private */
+	struct serial_dev * dev;
+	struct xmodem_send * sx;
+	int rx_ret;
+};
+
+static uint32_t xmt_clock_ms(void)
+{
+#ifdef _WIN32
+	return GetTickCount();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+/* Pseudo random contents, the same for the same seed */
+static void xmt_fill(uint8_t * buf, unsigned int size, uint32_t seed)
+{
+	uint32_t x = seed | 1;
+	unsigned int i;
+
+	for (i = 0; i < size; ++i) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		buf[i] = x;
+	}
+}
+
+static int xmt_file_write(const char * path, const void * buf,
+						  unsigned int size)
+{
+	FILE * f;
+	int ret;
+
+	if ((f = fopen(path, "wb")) == NULL)
+		return -1;
+
+	ret = (fwrite(buf, 1, size, f) == size) ? 0 : -1;
+	fclose(f);
+
+	return ret;
+}
+
+static void xmt_progress(void * arg, const struct xmodem_progress * p)
+{
+	struct xmt_run * r = (struct xmt_run *)arg;
+
+	if (p->done) {
+		r->retries = p->retries;
+		r->blk = r->sx->data_max;
+	}
+}
+
+static void * xmt_recv_task(void * arg)
+{
+	struct xmt_run * r = (struct xmt_run *)arg;
+	struct xmodem_recv * rx;
+
+	if ((rx = xmodem_recv_alloc()) == NULL) {
+		r->rx_ret = -1;
+		return NULL;
+	}
+
+	xmodem_recv_init(rx, r->dev, r->cks ? FCS_CKS : FCS_CRC,
+					 r->xmodem ? MODE_XMODEM : MODE_YMODEM);
+	xmodem_recv_opt_set(rx, r->opt);
+
+	/* the file, then the empty header closing the batch */
+	r->rx_ret = xmodem_recv_file(rx, XMT_DST);
+	if ((r->rx_ret >= 0) && !r->xmodem && (rx->fname[0] != '\0'))
+		r->rx_ret = -1;
+
+	xmodem_recv_free(rx);
+
+	return NULL;
+}
+
+/* The received file must match the one sent. Without a size in the
+   header, or no header at all, the padding of the last block comes
+   along. */
+static bool xmt_check(struct xmt_run * r, const uint8_t * img)
+{
+	size_t size;
+	uint8_t * ptr;
+	bool ok;
+
+	if ((ptr = fmap(XMT_DST, &size)) == NULL)
+		return false;
+
+	if (r->nosize || r->xmodem)
+		ok = (size >= r->size) && ((size % 128) == 0);
+	else
+		ok = (size == r->size);
+
+	ok = ok && (memcmp(ptr, img, r->size) == 0);
+	funmap(ptr, size);
+
+	return ok;
+}
+
+static int xmt_run(struct xmt_run * r)
+{
+	struct serial_dev * dev[2];
+	struct serial_config cfg;
+	struct serial_stat stat;
+	struct xmodem_send * sx;
+	pthread_t thread;
+	uint8_t * img;
+	uint32_t t0;
+	int ret;
+
+	if ((img = malloc(r->size)) == NULL)
+		return -1;
+
+	xmt_fill(img, r->size, r->size);
+	unlink(XMT_DST);
+	if (xmt_file_write(XMT_SRC, img, r->size) < 0) {
+		free(img);
+		return -1;
+	}
+
+	if (r->resume) {
+		unsigned int i;
+
+		/* every fourth block of the receiver's copy is stale */
+		for (i = 0; i < r->size; i += 4096)
+			img[i] ^= 0xff;
+		xmt_file_write(XMT_DST, img, r->size);
+		for (i = 0; i < r->size; i += 4096)
+			img[i] ^= 0xff;
+	}
+
+	if (loop_serial_open(dev) < 0) {
+		free(img);
+		return -1;
+	}
+
+	cfg.baudrate = r->baud;
+	cfg.databits = 8;
+	cfg.parity = SERIAL_PARITY_NONE;
+	cfg.stopbits = SERIAL_STOPBITS_1;
+	cfg.flowctrl = SERIAL_FLOWCTRL_NONE;
+	serial_config_set(dev[0], &cfg);
+	serial_config_set(dev[1], &cfg);
+
+	loop_serial_fault_set(dev[0], &r->fwd);
+	loop_serial_fault_set(dev[1], &r->rev);
+
+	sx = xmodem_send_alloc();
+	r->sx = sx;
+	r->dev = dev[1];
+	r->retries = 0;
+	r->blk = 0;
+	pthread_create(&thread, NULL, xmt_recv_task, r);
+
+	t0 = xmt_clock_ms();
+
+	xmodem_send_open(sx, dev[0], !r->xmodem ? MODE_YMODEM :
+					 r->x1k ? MODE_XMODEM_1K : MODE_XMODEM);
+	xmodem_send_opt_set(sx, r->opt);
+	xmodem_send_progress_set(sx, xmt_progress, r, 0);
+
+	if (r->nosize || (r->hdr_size != 0)) {
+		if ((ret = xmodem_send_start(sx, XMT_DST, r->hdr_size)) == 0 &&
+			(ret = xmodem_send_loop(sx, img, r->size)) == 0)
+			ret = xmodem_send_eot(sx);
+	} else
+		ret = xmodem_send_file(sx, XMT_SRC);
+
+	if (ret == 0)
+		ret = xmodem_send_close(sx);
+
+	r->ms = xmt_clock_ms() - t0;
+
+	if (ret < 0)
+		xmodem_send_cancel(sx);
+
+	pthread_join(thread, NULL);
+
+	r->faults = 0;
+	serial_stat_get(dev[0], &stat);
+	r->faults += stat.err_cnt;
+	serial_stat_get(dev[1], &stat);
+	r->faults += stat.err_cnt;
+
+	serial_close(dev[0]);
+	serial_close(dev[1]);
+	xmodem_send_free(sx);
+
+	if (r->fail) {
+		/* both ends give up, a refused header leaves no file */
+		r->status = ((ret < 0) && (r->rx_ret < 0) &&
+					 ((r->hdr_size == 0) || 
+					  (access(XMT_DST, F_OK) < 0))) ? 0 : -1;
+	} else
+		r->status = ((ret == 0) && (r->rx_ret >= 0) &&
+					 xmt_check(r, img)) ? 0 : -1;
+
+	free(img);
+	unlink(XMT_SRC);
+	unlink(XMT_DST);
+
+	return r->status;
+}
+
+static unsigned int xmt_rate(unsigned int bytes, uint32_t ms)
+{
+	return (ms == 0) ? 0 : (uint64_t)bytes * 1000 / ms;
+}
+
+/* ---------------------------------------------------------------------------
+ * Recovery cases
+ * ---------------------------------------------------------------------------
+ */
+
+static int xmt_cases(void)
+{
+	struct xmt_run lst[] = {
+		{ .name = "clean", .size = 64 * 1024 },
+		{ .name = "clean 8K", .opt = XMODEM_OPT_BLK8K, .size = 64 * 1024 },
+		{ .name = "lost header ACK", .size = 16 * 1024,
+			.rev = { .chr = ACK, .nth = 1, .burst = 1 } },
+		{ .name = "lost header ACK and 'C'", .size = 16 * 1024,
+			.rev = { .chr = ACK, .nth = 1, .burst = 2 } },
+		{ .name = "lost header ACK, 8K", .opt = XMODEM_OPT_BLK8K,
+			.size = 64 * 1024,
+			.rev = { .chr = ACK, .nth = 1, .burst = 1 } },
+		{ .name = "lost header ACK, 115200", .size = 16 * 1024,
+			.baud = 115200,
+			.rev = { .chr = ACK, .nth = 1, .burst = 1 } },
+		{ .name = "no size in header", .size = 10000, .nosize = true },
+		{ .name = "no size in header, 8K", .opt = XMODEM_OPT_BLK8K,
+			.size = 33000, .nosize = true },
+		/* "%d" of the sender: -1 */
+		{ .name = "negative size in header", .size = 10000,
+			.hdr_size = 0xffffffff, .fail = true },
+		{ .name = "huge size in header", .size = 10000,
+			.hdr_size = 0x7fffffff, .fail = true },
+		{ .name = "resume", .opt = XMODEM_OPT_RESUME, .resume = true,
+			.size = 64 * 1024 },
+		/* the receiver's second ACK comes with the bitmap */
+		{ .name = "resume, lost 'B'", .opt = XMODEM_OPT_RESUME,
+			.resume = true, .size = 64 * 1024,
+			.rev = { .chr = ACK, .nth = 2, .skip = 1, .burst = 1 } },
+		{ .name = "resume, lost ACK before 'B'", .opt = XMODEM_OPT_RESUME,
+			.resume = true, .size = 64 * 1024,
+			.rev = { .chr = ACK, .nth = 2, .burst = 1 } },
+		{ .name = "resume, lost ACK and 'B'", .opt = XMODEM_OPT_RESUME,
+			.resume = true, .size = 64 * 1024,
+			.rev = { .chr = ACK, .nth = 2, .burst = 2 } },
+		/* the first data packet stands for it */
+		{ .name = "resume, lost bitmap ACK", .opt = XMODEM_OPT_RESUME,
+			.resume = true, .size = 64 * 1024,
+			.fwd = { .chr = ACK, .nth = 1, .burst = 1 } },
+		{ .name = "resume, 115200, lost 'B'", .opt = XMODEM_OPT_RESUME,
+			.resume = true, .size = 64 * 1024, .baud = 115200,
+			.rev = { .chr = ACK, .nth = 2, .skip = 1, .burst = 1 } },
+		{ .name = "noisy line", .opt = XMODEM_OPT_BLK4K,
+			.size = 256 * 1024, .baud = 921600,
+			.fwd = { .drop = 20000, .flip = 20000, .seed = 1 },
+			.rev = { .drop = 50, .dup = 20, .seed = 2 } },
+		/* a CAN on either side aborts the transfer */
+		{ .name = "spurious CAN after header", .size = 16 * 1024,
+			.fwd = { .can = 1 }, .fail = true },
+		{ .name = "spurious CAN after 'C'", .size = 16 * 1024,
+			.rev = { .can = 1 }, .fail = true },
+		{ .name = "spurious CAN, data", .size = 64 * 1024,
+			.fwd = { .can = 20, .seed = 3 }, .fail = true },
+		{ .name = "spurious CAN, ACKs", .size = 64 * 1024,
+			.rev = { .can = 20, .seed = 4 }, .fail = true },
+		/* legacy protocols */
+		{ .name = "XMODEM", .xmodem = true, .size = 10000 },
+		{ .name = "XMODEM, lossy", .xmodem = true, .size = 32 * 1024,
+			.baud = 921600,
+			.fwd = { .drop = 8000, .flip = 8000, .seed = 5 },
+			.rev = { .drop = 50, .dup = 20, .seed = 6 } },
+		{ .name = "XMODEM-1K", .xmodem = true, .x1k = true,
+			.size = 33000 },
+		{ .name = "XMODEM-1K, lossy", .xmodem = true, .x1k = true,
+			.size = 64 * 1024, .baud = 921600,
+			.fwd = { .drop = 8000, .flip = 8000, .seed = 7 },
+			.rev = { .drop = 50, .dup = 20, .seed = 8 } },
+		/* a flipped bit may go through a checksum, lose bytes only */
+		{ .name = "XMODEM checksum", .xmodem = true, .cks = true,
+			.size = 10000 },
+		{ .name = "XMODEM checksum, lossy", .xmodem = true, .cks = true,
+			.size = 32 * 1024, .baud = 921600,
+			.fwd = { .drop = 4000, .seed = 9 },
+			.rev = { .drop = 50, .dup = 20, .seed = 10 } },
+		{ .name = "YMODEM checksum", .cks = true, .size = 33000 },
+		{ .name = "YMODEM checksum, lossy", .cks = true,
+			.size = 64 * 1024, .baud = 921600,
+			.fwd = { .drop = 4000, .seed = 11 },
+			.rev = { .drop = 50, .dup = 20, .seed = 12 } },
+		/* streaming: no retransmissions, an error cancels */
+		{ .name = "YMODEM-G", .opt = XMODEM_OPT_STREAM, .size = 64 * 1024 },
+		{ .name = "YMODEM-G, lossy", .opt = XMODEM_OPT_STREAM,
+			.size = 64 * 1024, .baud = 921600,
+			.fwd = { .chr = STX, .nth = 8, .skip = 100, .burst = 1 },
+			.fail = true }
+	};
+	unsigned int i;
+	int fail = 0;
+
+	printf("%-32s %6s %8s %8s %7s %7s\n",
+		   "case", "status", "bytes", "ms", "faults", "retries");
+
+	for (i = 0; i < sizeof(lst) / sizeof(lst[0]); ++i) {
+		struct xmt_run * r = &lst[i];
+
+		xmt_run(r);
+		printf("%-32s %6s %8u %8u %7u %7u\n", r->name,
+			   (r->status == 0) ? "OK" : "FAIL", r->size, r->ms,
+			   r->faults, r->retries);
+		fflush(stdout);
+		if (r->status != 0)
+			fail++;
+	}
+
+	return fail;
+}
+
+/* ---------------------------------------------------------------------------
+ * Uploads
+ * ---------------------------------------------------------------------------
+ */
+
+/* Batch receiver at the far end of a link */
+struct xmt_peer {
+	struct serial_dev * dev;
+	char dir[32];
+	int ret; /* files received */
+	pthread_t thread;
+};
+
+static void * xmt_peer_task(void * arg)
+{
+	struct xmt_peer * p = (struct xmt_peer *)arg;
+	struct xmodem_recv * rx;
+
+	if ((rx = xmodem_recv_alloc()) == NULL) {
+		p->ret = -1;
+		return NULL;
+	}
+
+	xmodem_recv_init(rx, p->dev, FCS_CRC, MODE_YMODEM);
+	p->ret = xmodem_recv_batch(rx, p->dir);
+	xmodem_recv_free(rx);
+
+	return NULL;
+}
+
+static int xmt_peer_start(struct xmt_peer * p, struct serial_dev * dev,
+						  const char * dir)
+{
+	p->dev = dev;
+	p->ret = -1;
+	snprintf(p->dir, sizeof(p->dir), "%s", dir);
+#ifdef _WIN32
+	mkdir(p->dir);
+#else
+	mkdir(p->dir, 0755);
+#endif
+
+	return pthread_create(&p->thread, NULL, xmt_peer_task, p);
+}
+
+/* Compare the file 'name' received by 'p' with 'buf' and remove it */
+static bool xmt_peer_check(struct xmt_peer * p, const char * name,
+						   const void * buf, size_t len)
+{
+	char path[64];
+	uint8_t * ptr;
+	size_t size;
+	bool ok;
+
+	snprintf(path, sizeof(path), "%s/%s", p->dir, name);
+
+	if ((ptr = fmap(path, &size)) == NULL)
+		return false;
+
+	ok = (size == len) && (memcmp(ptr, buf, len) == 0);
+	funmap(ptr, size);
+	unlink(path);
+
+	return ok;
+}
+
+/* Remove the directory 'dir' and the files in it */
+static void xmt_dir_remove(const char * dir)
+{
+	struct dirent * ent;
+	char path[300];
+	DIR * d;
+
+	if ((d = opendir(dir)) != NULL) {
+		while ((ent = readdir(d)) != NULL) {
+			if (ent->d_name[0] == '.')
+				continue;
+			snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+			unlink(path);
+		}
+		closedir(d);
+	}
+
+	rmdir(dir);
+}
+
+/* One delta_upload() session to the target "t1", received by 'p'. 
+   Returns the upload result, -1 if the receiver didn't get the file. */
+static int xmt_delta_run(struct xmt_peer * p, unsigned int mode)
+{
+	struct serial_dev * dev[2];
+	struct xmodem_send * sx;
+	int ret;
+
+	if (loop_serial_open(dev) < 0)
+		return -1;
+
+	sx = xmodem_send_alloc();
+	xmt_peer_start(p, dev[1], "xmtest.rcv");
+
+	xmodem_send_open(sx, dev[0], mode);
+	if ((ret = delta_upload(sx, XMT_CACHE, "t1", XMT_SRC)) == 0)
+		ret = xmodem_send_close(sx);
+	else
+		xmodem_send_cancel(sx);
+
+	pthread_join(p->thread, NULL);
+	serial_close(dev[0]);
+	serial_close(dev[1]);
+	xmodem_send_free(sx);
+
+	return ((ret == 0) && (p->ret != 1)) ? -1 : ret;
+}
+
+/* The first upload sends the whole image, the second only a patch 
+   against it. A patch needs the name YMODEM carries, XMODEM is 
+   refused. */
+static int xmt_delta(void)
+{
+	const unsigned int size = 96 * 1024;
+	struct xmt_peer peer;
+	uint8_t * base;
+	uint8_t * img;
+	uint8_t * out;
+	uint8_t * patch;
+	size_t len = 0;
+	uint32_t t0;
+	int fail = 0;
+	int ret;
+
+	base = malloc(size);
+	img = malloc(size);
+	out = malloc(size);
+	xmt_fill(base, size, 7);
+	memcpy(img, base, size);
+	/* a few scattered changes */
+	memset(img + 1000, 0x55, 100);
+	memset(img + 50000, 0xaa, 3000);
+
+	xmt_dir_remove(XMT_CACHE);
+	xmt_file_write(XMT_SRC, base, size);
+
+	t0 = xmt_clock_ms();
+	ret = xmt_delta_run(&peer, MODE_YMODEM);
+	ret = ((ret == 0) && xmt_peer_check(&peer, XMT_SRC, base, size)) ? 
+		0 : -1;
+	printf("%-32s %6s %8u %8u %7u %7u\n", "delta upload, image", 
+		   (ret == 0) ? "OK" : "FAIL", size, xmt_clock_ms() - t0, 0, 0);
+	fail += (ret != 0);
+
+	xmt_file_write(XMT_SRC, img, size);
+
+	t0 = xmt_clock_ms();
+	ret = xmt_delta_run(&peer, MODE_YMODEM);
+	if ((ret == 0) && ((patch = fmap("xmtest.rcv/" XMT_SRC DELTA_SUFFIX, 
+									 &len)) != NULL)) {
+		ret = ((len < size / 8) &&
+			   (delta_apply(base, size, patch, len, out, size) == 
+				(int)size) && (memcmp(out, img, size) == 0)) ? 0 : -1;
+		funmap(patch, len);
+		unlink("xmtest.rcv/" XMT_SRC DELTA_SUFFIX);
+	} else
+		ret = -1;
+	printf("%-32s %6s %8u %8u %7u %7u\n", "delta upload, patch", 
+		   (ret == 0) ? "OK" : "FAIL", (unsigned int)len, 
+		   xmt_clock_ms() - t0, 0, 0);
+	fail += (ret != 0);
+
+	t0 = xmt_clock_ms();
+	ret = xmt_delta_run(&peer, MODE_XMODEM);
+	printf("%-32s %6s %8u %8u %7u %7u\n", "delta upload, XMODEM refused", 
+		   (ret == -EINVAL) ? "OK" : "FAIL", 0, xmt_clock_ms() - t0, 0, 0);
+	fail += (ret != -EINVAL);
+
+	xmt_dir_remove("xmtest.rcv");
+	xmt_dir_remove(XMT_CACHE);
+	unlink(XMT_SRC);
+	free(out);
+	free(img);
+	free(base);
+
+	return fail;
+}
+
+/* The same image to several targets, two at a time. One of the lines
+   is noisy. */
+static int xmt_flash(void)
+{
+	const unsigned int size = 128 * 1024;
+	struct loop_serial_fault noise;
+	struct flash_target tgt[XMT_TARGETS];
+	struct xmt_peer peer[XMT_TARGETS];
+	struct serial_dev * dev[XMT_TARGETS][2];
+	struct serial_stat stat;
+	char name[XMT_TARGETS][16];
+	unsigned int faults = 0;
+	uint8_t * img;
+	uint32_t t0;
+	int fail = 0;
+	int ret;
+	int i;
+
+	img = malloc(size);
+	xmt_fill(img, size, 11);
+	xmt_file_write(XMT_SRC, img, size);
+
+	memset(&noise, 0, sizeof(noise));
+	noise.drop = 20000;
+	noise.flip = 20000;
+	noise.seed = 3;
+
+	for (i = 0; i < XMT_TARGETS; ++i) {
+		loop_serial_open(dev[i]);
+		if (i == XMT_TARGETS - 1)
+			loop_serial_fault_set(dev[i][0], &noise);
+		snprintf(name[i], sizeof(name[i]), "xmtest.t%d", i);
+		xmt_peer_start(&peer[i], dev[i][1], name[i]);
+		tgt[i].dev = dev[i][0];
+		tgt[i].name = name[i];
+	}
+
+	t0 = xmt_clock_ms();
+	ret = flash_batch(XMT_SRC, tgt, XMT_TARGETS, 2, NULL);
+
+	for (i = 0; i < XMT_TARGETS; ++i) {
+		pthread_join(peer[i].thread, NULL);
+		serial_stat_get(dev[i][0], &stat);
+		faults += stat.err_cnt;
+		if ((tgt[i].status != 0) || (peer[i].ret != 1) ||
+			!xmt_peer_check(&peer[i], XMT_SRC, img, size))
+			ret = -1;
+		xmt_dir_remove(name[i]);
+		serial_close(dev[i][0]);
+		serial_close(dev[i][1]);
+	}
+
+	printf("%-32s %6s %8u %8u %7u %7u\n", "flash batch, 4 targets", 
+		   (ret == 0) ? "OK" : "FAIL", size * XMT_TARGETS, 
+		   xmt_clock_ms() - t0, faults, 0);
+	fail += (ret != 0);
+
+	unlink(XMT_SRC);
+	free(img);
+
+	return fail;
+}
+
+/* ---------------------------------------------------------------------------
+ * Benchmark
+ * ---------------------------------------------------------------------------
+ */
+
+static int xmt_bench(void)
+{
+	const unsigned int baud[] = { 38400, 115200, 460800 };
+	const unsigned int opt[] = { 0, XMODEM_OPT_BLK4K, XMODEM_OPT_BLK8K };
+	unsigned int i;
+	unsigned int j;
+	int fail = 0;
+
+	printf("\n%7s %5s %7s %8s %5s %8s %7s %7s %9s\n", "baud", "blk",
+		   "bytes", "B/s", "eff%", "lossy", "faults", "retries",
+		   "ms/fault");
+
+	for (i = 0; i < sizeof(baud) / sizeof(baud[0]); ++i) {
+		/* about four seconds of wire time */
+		unsigned int size = ((baud[i] * 2 / 5) + 8191) & ~8191;
+
+		for (j = 0; j < sizeof(opt) / sizeof(opt[0]); ++j) {
+			struct xmt_run clean;
+			struct xmt_run lossy;
+			unsigned int rate;
+			unsigned int lost = 0;
+
+			memset(&clean, 0, sizeof(clean));
+			clean.name = "clean";
+			clean.opt = opt[j];
+			clean.baud = baud[i];
+			clean.size = size;
+
+			/* The same error rate for all block sizes: a byte in 32K 
+			   is lost or corrupted, and one response in 200. */
+			lossy = clean;
+			lossy.name = "lossy";
+			lossy.fwd.drop = 65536;
+			lossy.fwd.flip = 65536;
+			lossy.fwd.seed = baud[i] + j;
+			lossy.rev.drop = 200;
+			lossy.rev.seed = baud[i] - j;
+
+			if ((xmt_run(&clean) < 0) || (xmt_run(&lossy) < 0)) {
+				printf("%7u %4uK %7u %s failed!\n", baud[i],
+					   clean.blk / 1024, size,
+					   (clean.status != 0) ? clean.name : lossy.name);
+				fail++;
+				continue;
+			}
+
+			rate = xmt_rate(size, clean.ms);
+			if ((lossy.faults > 0) && (lossy.ms > clean.ms))
+				lost = (lossy.ms - clean.ms) / lossy.faults;
+
+			printf("%7u %4uK %7u %8u %5u %8u %7u %7u %9u\n", baud[i],
+				   clean.blk / 1024, size, rate,
+				   (unsigned int)((uint64_t)rate * 1000 / baud[i]),
+				   xmt_rate(size, lossy.ms), lossy.faults, lossy.retries,
+				   lost);
+			fflush(stdout);
+		}
+	}
+
+	return fail;
+}
+
+int main(int argc, char * argv[])
+{
+	bool cases = true;
+	bool bench = true;
+	int fail = 0;
+
+	if ((argc > 1) && (strcmp(argv[1], "-q") == 0))
+		bench = false;
+	if ((argc > 1) && (strcmp(argv[1], "-b") == 0))
+		cases = false;
+
+	if (cases) {
+		fail += xmt_cases();
+		fail += xmt_delta();
+		fail += xmt_flash();
+	}
+
+	if (bench)
+		fail += xmt_bench();
+
+	if (fail) {
+		printf("\n%d failed\n", fail);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,299 @@
+/*
+ * Copyright(C) 2012-2014 Robinson Mittmann. All Rights Reserved.
+ *
+ * This file is part of the YARD-ICE.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You can receive a copy of the GNU Lesser General Public License from
+ * http://www.gnu.org/
+ */
+
+/**
+ * @file xmodem_batch.c
+ * @brief YARD-ICE
+ * @author Robinson Mittmann <bobmittmann@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <io.h>
+#endif
+
+#include "private.h"
+#include "debug.h"
+
+/* Data received and not yet on disk, the serial side only waits for
+   the writer when all the buffers are full */
+#define XMODEM_BATCH_BUF_CNT 4
+#define XMODEM_BATCH_BUF_SIZE (64 * 1024)
+#define XMODEM_BATCH_PATH_MAX 512
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* Queue of buffers between the receiver and the writer thread */
+struct xmodem_wrq {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned int head; /* next buffer to fill */
+	unsigned int tail; /* next buffer to write */
+	bool done;
+	int err;
+	struct {
+		int fd;
+		int len;
+		bool last; /* close the file after writing */
+		unsigned char * buf;
+	} slot[XMODEM_BATCH_BUF_CNT];
+};
+
+static void * xmodem_batch_writer(void * arg)
+{
+	struct xmodem_wrq * q = (struct xmodem_wrq *)arg;
+
+	pthread_mutex_lock(&q->mutex);
+
+	for (;;) {
+		unsigned int i;
+		int ret;
+		int fd;
+
+		while ((q->tail == q->head) && !q->done)
+			pthread_cond_wait(&q->cond, &q->mutex);
+
+		if (q->tail == q->head)
+			break;
+
+		i = q->tail % XMODEM_BATCH_BUF_CNT;
+		fd = q->slot[i].fd;
+		pthread_mutex_unlock(&q->mutex);
+
+		/* After an error the remaining buffers are only released */
+		ret = 0;
+		if ((q->slot[i].len > 0) && (q->err == 0) &&
+			(write(fd, q->slot[i].buf, q->slot[i].len) != q->slot[i].len)) {
+			DBG(DBG_WARNING, "write(): %s.", strerror(errno));
+			ret = -EIO;
+		}
+
+		if (q->slot[i].last && (close(fd) < 0) && (ret == 0)) {
+			DBG(DBG_WARNING, "close(): %s.", strerror(errno));
+			ret = -EIO;
+		}
+
+		pthread_mutex_lock(&q->mutex);
+		if ((ret < 0) && (q->err == 0))
+			q->err = ret;
+		q->tail++;
+		pthread_cond_broadcast(&q->cond);
+	}
+
+	pthread_mutex_unlock(&q->mutex);
+
+	return NULL;
+}
+
+/* Get an empty buffer, waiting for the writer if needed */
+static int xmodem_wrq_get(struct xmodem_wrq * q)
+{
+	int i;
+
+	pthread_mutex_lock(&q->mutex);
+	while ((q->head - q->tail) == XMODEM_BATCH_BUF_CNT)
+		pthread_cond_wait(&q->cond, &q->mutex);
+	i = q->head % XMODEM_BATCH_BUF_CNT;
+	pthread_mutex_unlock(&q->mutex);
+
+	return i;
+}
+
+/* Hand the buffer filled to the writer. Returns the writer error, if
+   any. */
+static int xmodem_wrq_put(struct xmodem_wrq * q, int i, int fd,
+						  int len, bool last)
+{
+	int err;
+
+	q->slot[i].fd = fd;
+	q->slot[i].len = len;
+	q->slot[i].last = last;
+
+	pthread_mutex_lock(&q->mutex);
+	q->head++;
+	err = q->err;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->mutex);
+
+	return err;
+}
+
+/* Create the file and reserve its space on disk */
+static int xmodem_batch_open(const char * dir, const char * fname,
+							 unsigned int fsize)
+{
+	char path[XMODEM_BATCH_PATH_MAX];
+	const char * name;
+	const char * cp;
+	int fd;
+
+	/* never write outside the destination directory */
+	name = fname;
+	for (cp = fname; *cp != '\0'; ++cp) {
+		if ((*cp == '/') || (*cp == '\\'))
+			name = cp + 1;
+	}
+
+	if ((*name == '\0') || (strcmp(name, ".") == 0) ||
+		(strcmp(name, "..") == 0)) {
+		DBG(DBG_WARNING, "invalid file name \"%s\"", fname);
+		return -EINVAL;
+	}
+
+	if (snprintf(path, sizeof(path), "%s/%s", dir, name) >=
+		(int)sizeof(path))
+		return -ENAMETOOLONG;
+
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY,
+				   0644)) < 0) {
+		DBG(DBG_WARNING, "open(\"%s\"): %s.", path, strerror(errno));
+		return -errno;
+	}
+
+	if (fsize > 0) {
+		/* Allocating the blocks now keeps the file contiguous and the
+		   writes from having to extend it. Not all file systems support
+		   it, which is not an error. */
+#ifdef _WIN32
+		_chsize(fd, fsize);
+#else
+		int ret;
+
+		if ((ret = posix_fallocate(fd, 0, fsize)) != 0)
+			DBG(DBG_INFO, "posix_fallocate(): %s.", strerror(ret));
+#endif
+	}
+
+	DBG(DBG_INFO, "\"%s\" %d bytes", path, fsize);
+
+	return fd;
+}
+
+int xmodem_recv_batch(struct xmodem_recv * rx, const char * dir)
+{
+	struct xmodem_wrq q;
+	unsigned char * mem;
+	pthread_t writer;
+	unsigned int fsize;
+	int cnt = 0;
+	int ret = 0;
+	int i;
+
+	if ((rx == NULL) || (dir == NULL) || (rx->xfr_mode != MODE_YMODEM))
+		return -EINVAL;
+
+	mem = malloc(XMODEM_BATCH_BUF_CNT * XMODEM_BATCH_BUF_SIZE);
+	if (mem == NULL)
+		return -ENOMEM;
+
+	memset(&q, 0, sizeof(q));
+	pthread_mutex_init(&q.mutex, NULL);
+	pthread_cond_init(&q.cond, NULL);
+	for (i = 0; i < XMODEM_BATCH_BUF_CNT; ++i)
+		q.slot[i].buf = mem + i * XMODEM_BATCH_BUF_SIZE;
+
+	if (pthread_create(&writer, NULL, xmodem_batch_writer, &q) != 0) {
+		DBG(DBG_WARNING, "pthread_create() failed!");
+		ret = -1;
+		goto done;
+	}
+
+	for (;;) {
+		int fd;
+		int n;
+
+		/* file header */
+		if ((rx->pktno == 0) &&
+			((ret = xmodem_recv_loop(rx, rx->pkt.data, 1)) < 0))
+			break;
+
+		/* an empty name ends the batch */
+		if (rx->fname[0] == '\0') {
+			ret = 0;
+			break;
+		}
+
+		fsize = rx->fsize;
+		if ((fd = xmodem_batch_open(dir, rx->fname, fsize)) < 0) {
+			xmodem_recv_cancel(rx);
+			ret = fd;
+			break;
+		}
+
+		do {
+			i = xmodem_wrq_get(&q);
+			if ((n = xmodem_recv_buf(rx, q.slot[i].buf,
+									 XMODEM_BATCH_BUF_SIZE)) < 0) {
+				/* close the file */
+				xmodem_wrq_put(&q, i, fd, 0, true);
+				ret = n;
+				goto stop;
+			}
+			/* a short read means the end of the file */
+			if ((ret = xmodem_wrq_put(&q, i, fd, n,
+									  n < XMODEM_BATCH_BUF_SIZE)) < 0) {
+				if (n == XMODEM_BATCH_BUF_SIZE) {
+					i = xmodem_wrq_get(&q);
+					xmodem_wrq_put(&q, i, fd, 0, true);
+				}
+				xmodem_recv_cancel(rx);
+				goto stop;
+			}
+		} while (n == XMODEM_BATCH_BUF_SIZE);
+
+		cnt++;
+
+		/* Consume the EOT. This also receives the header of the next
+		   file, or the empty one closing the batch. Without a size
+		   in the header both came with the data already. */
+		if ((fsize != 0) && 
+			((ret = xmodem_recv_loop(rx, rx->pkt.data, 1)) < 0))
+			break;
+	}
+
+stop:
+	pthread_mutex_lock(&q.mutex);
+	q.done = true;
+	pthread_cond_broadcast(&q.cond);
+	pthread_mutex_unlock(&q.mutex);
+
+	pthread_join(writer, NULL);
+
+	/* the last files may have failed to write */
+	if ((ret == 0) && (q.err < 0))
+		ret = q.err;
+
+done:
+	pthread_cond_destroy(&q.cond);
+	pthread_mutex_destroy(&q.mutex);
+	free(mem);
+
+	return (ret < 0) ? ret : cnt;
+}
+
@@ -26,40 +26,105 @@
 
 #include <sys/param.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-#include "xmodem.h"
+#include "private.h"
 #include "crc.h"
+#include "fmap.h"
 #include "debug.h"
 
-#define SOH  0x01
-#define STX  0x02
-#define EOT  0x04
-#define ACK  0x06
-#define NAK  0x15
-#define CAN  0x18
-
+/* Wait for the sender to start the transfer */
 #define XMODEM_RCV_TMOUT_MS 2000
 #define XMODEM_FILE_SIZE_MAX (64 * 1024 * 1024)
+/* Write buffer for files of unknown size */
+#define XMODEM_FILE_BUF_SIZE (64 * 1024)
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
 
 #ifndef MIN
 #define MIN(a,b)    (((a)<(b))?(a):(b))
 #endif
 
+/* Synchronization character to start a transfer */
+static inline unsigned char xmodem_recv_sync(struct xmodem_recv * rx)
+{
+	if (rx->opt & XMODEM_OPT_STREAM)
+		return 'G';
+
+	if (xmodem_ext_max(rx->opt, rx->rtt.baud) > 0)
+		return XMODEM_SYNC_EXT;
+
+	return (rx->fcs_mode == FCS_CRC) ? 'C' : NAK;
+}
 
-static int xmodem_recv_pkt(struct xmodem_recv * rx)
+/* Receive exactly 'len' bytes. Returns 'len', 0 on timeout, or 
+   a negative value on error. */
+static int xmodem_recv_all(struct xmodem_recv * rx, unsigned char * buf,
+						   int len, unsigned int tmo)
+{
+	int rem = len;
+	int ret;
+
+	while (rem) {
+		ret = serial_recv(rx->dev, buf, rem, tmo);
+
+		if (ret <= 0) {
+			if (ret == 0)
+				DBG(DBG_TRACE, "serial_recv() timeout!");
+			else
+				DBG(DBG_WARNING, "serial_recv() failed!");
+			return ret;
+		}
+
+		rem -= ret;
+		buf += ret;
+	}
+
+	return len;
+}
+
+/* Receive the next packet. The payload of data packets is read straight 
+   into 'dst' when it has room for a whole block (max >= block size), 
+   in which case 'direct' is set. Otherwise it goes to rx->pkt.data. */
+static int xmodem_recv_pkt(struct xmodem_recv * rx, 
+						   unsigned char * dst, int max, bool * direct)
 {
 	unsigned char * pkt = rx->pkt.hdr;
-	unsigned char * cp;
+	unsigned char * data;
+	unsigned char * fcs = rx->pkt.fcs;
+	bool resend = false;
+	bool running;
+	bool ext = false;
+	uint32_t tmo;
+	uint32_t t0;
 	int ret = 0;
 	int cnt = 0;
 	int nseq;
 	int seq;
-	int rem;
+
+	*direct = false;
 
 	for (;;) {
+		t0 = xmodem_clock_ms();
 
-		if ((ret = serial_send(rx->dev, &rx->sync, 1)) < 0) {
+		if (rx->sync == XMODEM_SYNC_EXT) {
+			/* offer extended packets, with our largest block in KB */
+			pkt[0] = XMODEM_SYNC_EXT;
+			pkt[1] = '0' + xmodem_ext_max(rx->opt, rx->rtt.baud);
+			if ((ret = serial_send(rx->dev, pkt, 2)) < 0) {
+				DBG(DBG_WARNING, "serial_send() failed!");
+				return ret;
+			}
+		} else if ((rx->sync != 0) && 
+				   (ret = serial_send(rx->dev, &rx->sync, 1)) < 0) {
+			/* In streaming mode nothing is sent between data packets */
 			DBG(DBG_WARNING, "serial_send() failed!");
 			return ret;
 		}
@@ -70,14 +135,26 @@ static int xmodem_recv_pkt(struct xmodem_recv * rx)
 			DBG(DBG_TRACE, "--> ACK");
 		else if (rx->sync == 'C')
 			DBG(DBG_TRACE, "--> 'C'");
-		else
+		else if (rx->sync == 'G')
+			DBG(DBG_TRACE, "--> 'G'");
+		else if (rx->sync == XMODEM_SYNC_EXT)
+			DBG(DBG_TRACE, "--> 'X' %c", pkt[1]);
+		else if (rx->sync != 0)
 			DBG(DBG_WARNING, "--> 0x%02x", rx->sync);
 
+		/* Once the transfer is running, the next packet is due one round
+		   trip after the response. Wait twice as long, so that a sender 
+		   missing our response retransmits before we do. */
+		running = (rx->pktno > 1) || ((rx->pktno == 1) && (rx->count > 0));
+		if (running)
+			tmo = MIN(2 * rx->rtt.rto, XMODEM_RCV_TMOUT_MS);
+		else
+			tmo = XMODEM_RCV_TMOUT_MS;
+
 		for (;;) {
 			int c;
 
-			ret = serial_recv(rx->dev, pkt, 
-									1, XMODEM_RCV_TMOUT_MS);
+			ret = serial_recv(rx->dev, pkt, 1, tmo);
 
 			if (ret == 0) {
 				DBG(DBG_TRACE, "serial_send() timeout!");
@@ -91,60 +168,89 @@ static int xmodem_recv_pkt(struct xmodem_recv * rx)
 
 			c = pkt[0];
 
+			if (c == XTX) {
+				/* the block size comes with the header */
+				DBG(DBG_TRACE, "<-- XTX");
+				ext = true;
+				break;
+			}
+
 			if (c == STX) {
 				DBG(DBG_TRACE, "<-- STX");
+				ext = false;
 				cnt = 1024;
 				break;
 			}
 
 			if (c == SOH) {
 				DBG(DBG_TRACE, "<-- SOH");
+				ext = false;
 				cnt = 128;
 				break;
 			}
 
 			if (c == CAN) {
+				/* Answer with CAN, the sender may not be the one who
+				   cancelled and would retry until it gives up. */
 				DBG(DBG_WARNING, "<-- CAN");
-				return -1;
+				goto abort;
 			}
 
 			if (c == EOT) {
 				DBG(DBG_TRACE, "<-- EOT");
 				/* end of transmission */
 				rx->pktno = (rx->xfr_mode == MODE_YMODEM) ? 0 : 1;
-				rx->sync = (rx->fcs_mode == FCS_CRC) ? 'C' : NAK;
+				rx->sync = xmodem_recv_sync(rx);
 				pkt[0] = ACK;
 				if ((ret = serial_send(rx->dev, pkt, 1)) < 0)
 					return ret;
 
 				DBG(DBG_TRACE, "--> ACK");
 
+				xmodem_meter_update(&rx->meter, &rx->rtt, 0, true);
+				xmodem_meter_start(&rx->meter, 0);
+
 				return 0;
 			}
 		}
 
-		rem = cnt + ((rx->fcs_mode == FCS_CRC) ? 4 : 3);
-		cp = pkt + 1;
-
-		/* receive the packet */
-		while (rem) {
-//			ret = serial_recv(rx->dev, cp, rem > 8 ? 8 : rem, 500);
-			ret = serial_recv(rx->dev, cp, rem, 500);
+		/* Karn's rule: skip the sample if our response was resent */
+		if (!resend && running)
+			xmodem_rtt_update(&rx->rtt, xmodem_clock_ms() - t0);
+		tmo = rx->rtt.rto;
 
-			if (ret == 0) {
-				DBG(DBG_TRACE, "serial_recv() timeout!");
+		if ((ret = xmodem_recv_all(rx, &pkt[1], ext ? 3 : 2, tmo)) <= 0) {
+			if (ret == 0)
 				goto timeout;
-			}
+			return ret;
+		}
 
-			if (ret < 0) {
-				DBG(DBG_WARNING, "serial_recv() failed!");
-				return ret;
+		if (ext) {
+			if ((pkt[3] == 0) || (pkt[3] > XMODEM_PKT_DATA_MAX / 1024)) {
+				DBG(DBG_WARNING, "invalid block size %dKB!", pkt[3]);
+				goto error;
 			}
+			cnt = pkt[3] * 1024;
+		}
 
-//			DBG_DUMP(DBG_TRACE, cp, ret);
+		/* the rest of the packet takes its wire time to come in */
+		tmo += xmodem_wire_ms(rx->rtt.baud, cnt);
 
-			rem -= ret;
-			cp += ret;
+		/* The YMODEM header always goes to the packet buffer. Data 
+		   landing in 'dst' is not accounted for until validated. */
+		if ((dst != NULL) && (max >= cnt) && (rx->pktno != 0))
+			data = dst;
+		else
+			data = rx->pkt.data;
+
+		/* receive the packet */
+		if ((ret = xmodem_recv_all(rx, data, cnt, tmo)) <= 0 ||
+			(ret = xmodem_recv_all(rx, fcs, ext ? 4 : 
+								   (rx->fcs_mode == FCS_CRC) ? 2 : 1, 
+								   tmo)) <= 0) {
+			if (ret == 0)
+				goto timeout;
+			return ret;
 		}
 
 		/* sequence */
@@ -159,17 +265,25 @@ static int xmodem_recv_pkt(struct xmodem_recv * rx)
 			goto error;
 		}
 
-		cp = &pkt[3];
+		if (ext) {
+			uint32_t crc;
+			uint32_t cmp;
 
-		if (rx->fcs_mode == FCS_CRC) {
-			unsigned short crc = 0;
-			unsigned short cmp;
-			int i;
+			/* the size byte is covered as well */
+			crc = ~crc32(crc32(~0UL, &pkt[3], 1), data, cnt);
+			cmp = (uint32_t)fcs[0] << 24 | (uint32_t)fcs[1] << 16 | 
+				(uint32_t)fcs[2] << 8 | fcs[3];
 
-			for (i = 0; i < cnt; ++i)
-				crc = CRC16CCITT(crc, cp[i]);
+			if (cmp != crc) {
+				DBG(DBG_WARNING, "CRC32 error %08x!=%08x!", cmp, crc);
+				goto error;
+			}
+		} else if (rx->fcs_mode == FCS_CRC) {
+			unsigned short crc;
+			unsigned short cmp;
 
-			cmp = (unsigned short)cp[i] << 8 | cp[i + 1];
+			crc = crc16ccitt(0, data, cnt);
+			cmp = (unsigned short)fcs[0] << 8 | fcs[1];
 
 			if (cmp != crc) {
 				DBG(DBG_WARNING, "CRC error %04x!=%04x!", cmp, crc);
@@ -181,9 +295,9 @@ static int xmodem_recv_pkt(struct xmodem_recv * rx)
 			int i;
 
 			for (i = 0; i < cnt; ++i)
-				cks += cp[i];
+				cks += data[i];
 
-			if (cp[i] != cks) {
+			if (fcs[0] != cks) {
 				DBG(DBG_WARNING, "Checksum error!");
 				goto error;
 			}
@@ -192,7 +306,17 @@ static int xmodem_recv_pkt(struct xmodem_recv * rx)
 
 		if (seq == ((rx->pktno - 1) & 0xff)) {
 			/* retransmission */
-			rx->sync = ACK;
+			if ((rx->pktno == 1) && (rx->xfr_mode == MODE_YMODEM)) {
+				/* The header again, our ACK was lost. Acknowledge it
+				   and keep the start request, the sender waits for it
+				   before the first data packet. */
+				pkt[0] = ACK;
+				if ((ret = serial_send(rx->dev, pkt, 1)) < 0)
+					return ret;
+				DBG(DBG_TRACE, "--> ACK");
+			} else
+				rx->sync = (rx->opt & XMODEM_OPT_STREAM) ? 0 : ACK;
+			resend = true;
 			continue;
 		}
 
@@ -205,7 +329,7 @@ static int xmodem_recv_pkt(struct xmodem_recv * rx)
 			} else {
 				/* wrong sequence */
 				DBG(DBG_WARNING, "wrong sequence!");
-				goto error;
+				goto abort;
 			}
 		}
 
@@ -214,11 +338,17 @@ static int xmodem_recv_pkt(struct xmodem_recv * rx)
 			pkt[0] = ACK;
 			serial_send(rx->dev, pkt, 1);
 		} else {
+			if (resend)
+				xmodem_rtt_restore(&rx->rtt);
 			rx->retry = 10;
-			rx->sync = ACK;
-			if ((rx->count + cnt) > rx->fsize)
+			rx->sync = (rx->opt & XMODEM_OPT_STREAM) ? 0 : ACK;
+			/* the padding of the last block is not file data, unless
+			   the size is unknown */
+			if ((rx->fsize != 0) && ((rx->count + cnt) > rx->fsize))
 				cnt = rx->fsize - rx->count;
 			rx->count += cnt;
+			*direct = (data == dst);
+			xmodem_meter_update(&rx->meter, &rx->rtt, cnt, false);
 		}
 
 
@@ -226,13 +356,47 @@ static int xmodem_recv_pkt(struct xmodem_recv * rx)
 
 		return cnt;
 
-error:
-		/* flush */
-		while (serial_recv(rx->dev, rx->pkt.data, 1024, 200) > 0); 
+abort:
+		/* flush, the line is quiet after a round trip without data */
+		while (serial_recv(rx->dev, rx->pkt.data, sizeof(rx->pkt.data), 
+						   xmodem_rtt_base(&rx->rtt)) > 0); 
 		ret = -1;
 		break;
 
+error:
+		/* Corrupted packet. Streaming can't recover, otherwise ask
+		   for a retransmission once the line is quiet. The backed off
+		   timeout could match the sender's retransmission period and 
+		   never see a quiet line, wait for the base one. */
+		if (rx->opt & XMODEM_OPT_STREAM)
+			goto abort;
+		while (serial_recv(rx->dev, rx->pkt.data, sizeof(rx->pkt.data), 
+						   xmodem_rtt_base(&rx->rtt)) > 0); 
+		/* counted below once running */
+		if (!running)
+			rx->meter.retries++;
+
 timeout:
+		xmodem_rtt_backoff(&rx->rtt);
+		resend = true;
+		if (running)
+			rx->meter.retries++;
+
+		/* Once data is flowing NAK asks for the packet again. Repeating 
+		   the ACK would acknowledge a packet we never got. */
+		if (running && (rx->sync == ACK))
+			rx->sync = NAK;
+
+		/* A sender not knowing the extended packets ignores the offer,
+		   alternate with the plain request until someone answers. */
+		if (!running && (xmodem_recv_sync(rx) == XMODEM_SYNC_EXT)) {
+			unsigned char c = (rx->fcs_mode == FCS_CRC) ? 'C' : NAK;
+
+			if (rx->sync == XMODEM_SYNC_EXT)
+				rx->sync = c;
+			else if (rx->sync == c)
+				rx->sync = XMODEM_SYNC_EXT;
+		}
 
 		if ((--rx->retry) == 0) {
 			/* too many errors */
@@ -249,8 +413,65 @@ timeout:
 	return ret;
 }
 
+/* The empty header closes the batch. If our ACK gets lost there is no 
+   one left to repeat it: acknowledge the retransmissions until the line
+   stays quiet for longer than the sender's timeout. */
+static void xmodem_recv_linger(struct xmodem_recv * rx)
+{
+	unsigned char ack = ACK;
+	uint32_t tmo;
+	int retry;
+
+	tmo = 2 * xmodem_rtt_base(&rx->rtt) + 
+		xmodem_wire_ms(rx->rtt.baud, XMODEM_PKT_DATA_MAX);
+
+	for (retry = 0; retry < 10; ++retry) {
+		bool rcvd = false;
+
+		while (serial_recv(rx->dev, rx->pkt.data, sizeof(rx->pkt.data), 
+						   tmo) > 0)
+			rcvd = true;
+
+		if (!rcvd)
+			break;
+
+		DBG(DBG_TRACE, "--> ACK");
+		if (serial_send(rx->dev, &ack, 1) < 0)
+			break;
+	}
+}
+
+/* File size field of the YModem header. An empty field stands for an
+   unknown size (0). Anything but a plain decimal number up to
+   XMODEM_FILE_SIZE_MAX is refused, the size is used to map the file.
+   Other senders put the time stamp after a space. */
+static int xmodem_hdr_size(const char * s, unsigned int * size)
+{
+	unsigned long val;
+	char * end;
+
+	if (*s == '\0') {
+		*size = 0;
+		return 0;
+	}
+
+	/* strtoul() would take a sign or white space */
+	if ((*s < '0') || (*s > '9'))
+		return -1;
+
+	errno = 0;
+	val = strtoul(s, &end, 10);
+	if ((errno != 0) || ((*end != '\0') && (*end != ' ')) ||
+		(val > XMODEM_FILE_SIZE_MAX))
+		return -1;
+
+	*size = val;
+	return 0;
+}
+
 int xmodem_recv_loop(struct xmodem_recv * rx, void * data, int len)
 {
+	bool direct;
 	int ret;
 
 	if ((data == NULL) || (len <= 0)) {
@@ -264,23 +485,16 @@ int xmodem_recv_loop(struct xmodem_recv * rx, void * data, int len)
 		int rem;
 
 		if ((rem = (rx->data_len - rx->data_pos)) > 0) {
-			unsigned char * dst = (unsigned char *)data;
-			unsigned char * src;
 			int n;
-			int i;
 
 			n = MIN(rem, len);
-			src = &rx->pkt.data[rx->data_pos];
-
-			for (i = 0; i < n; ++i)
-				dst[i] = src[i];
-
+			memcpy(data, &rx->pkt.data[rx->data_pos], n);
 			rx->data_pos += n;
 
 			return n;
 		}
 
-		ret = xmodem_recv_pkt(rx);
+		ret = xmodem_recv_pkt(rx, data, len, &direct);
 		DBG(DBG_INFO, "xmodem_recv_pkt()=%d.", ret);
 
 		if (ret < 0) {
@@ -295,26 +509,44 @@ int xmodem_recv_loop(struct xmodem_recv * rx, void * data, int len)
 		if (rx->pktno == 1) {
 			char * src;
 			char * dst;
-			int fsize;
 
 			DBG(DBG_TRACE, "YModem");
 
 			src = (char *)rx->pkt.data;
 			dst = (char *)rx->fname;
-			while (*src != '\0')
+			while ((*src != '\0') && 
+				   (dst < &rx->fname[XMODEM_FNAME_MAX]))
 				*dst++ = *src++;
 			*dst = '\0';
+			src += strlen(src);
 			/* skip null */
 			src++;
-			fsize = atoi(src);
-			rx->fsize = fsize;
+			if (xmodem_hdr_size(src, &rx->fsize) < 0) {
+				DBG(DBG_WARNING, "invalid file size: '%.16s'", src);
+				xmodem_recv_cancel(rx);
+				ret = -EINVAL;
+				break;
+			}
+			/* skip the size and the time stamp */
+			src += strlen(src) + 1;
+			src += strlen(src) + 1;
+			rx->peer_opt = (strchr(src, 'R') != NULL) ? 
+				XMODEM_OPT_RESUME : 0;
+
+			DBG(DBG_TRACE, "fname='%s' fsize=%u", rx->fname, rx->fsize);
 
-			DBG(DBG_TRACE, "fname='%s' fsize=%d", rx->fname, rx->fsize);
+			if (rx->fname[0] == '\0')
+				xmodem_recv_linger(rx);
 
 			rx->count = 0;
+			xmodem_meter_start(&rx->meter, rx->fsize);
 			ret = 0;
 			break;
 		} 
+
+		/* validated payload already at the destination */
+		if (direct)
+			break;
 		
 		rx->data_len = cnt;
 		rx->data_pos = 0;
@@ -323,6 +555,356 @@ int xmodem_recv_loop(struct xmodem_recv * rx, void * data, int len)
 	return ret;
 }
 
+int xmodem_recv_buf(struct xmodem_recv * rx, void * buf, int size)
+{
+	unsigned char * dst = (unsigned char *)buf;
+	int cnt = 0;
+	int ret;
+
+	if ((rx == NULL) || (buf == NULL) || (size < 0))
+		return -EINVAL;
+
+	/* get the YMODEM header first */
+	if ((rx->xfr_mode == MODE_YMODEM) && (rx->pktno == 0)) {
+		if ((ret = xmodem_recv_loop(rx, dst, size)) < 0)
+			return ret;
+	}
+
+	/* an empty name in the header ends the batch */
+	if ((rx->xfr_mode == MODE_YMODEM) && (rx->fname[0] == '\0'))
+		return 0;
+
+	while (cnt < size) {
+		/* All announced data received, the EOT is left for the 
+		   next call. Files of unknown size (0 in the YMODEM header)
+		   go on until the EOT, which is consumed here along with the
+		   header of the next file. */
+		if ((rx->fsize != 0) && (rx->count == rx->fsize) && 
+			(rx->data_pos == rx->data_len))
+			break;
+
+		if ((ret = xmodem_recv_loop(rx, dst + cnt, size - cnt)) < 0)
+			return ret;
+
+		if (ret == 0)
+			break;
+
+		cnt += ret;
+	}
+
+	return cnt;
+}
+
+/* Resume: acknowledge the last manifest packet and send the bitmap of 
+   the blocks we need. The sender asks for the bitmap again with a NAK,
+   it comes then without the ACK. A data packet, or the EOT, in place of
+   the sender's ACK means the bitmap was taken: it is dropped and NAKed
+   to have it sent again. */
+static int xmodem_recv_map_send(struct xmodem_recv * rx, 
+								const unsigned char * map, int len)
+{
+	unsigned char * pkt = rx->pkt.hdr;
+	struct serial_iov iov[3];
+	unsigned char hdr[2];
+	unsigned char fcs[2];
+	unsigned short crc;
+	bool resend = true;
+	int retry = 0;
+	int ret;
+	int c;
+
+	hdr[0] = ACK;
+	hdr[1] = XMODEM_RESUME_MAP;
+	crc = crc16ccitt(0, map, len);
+	fcs[0] = crc >> 8;
+	fcs[1] = crc & 0xff;
+
+	iov[0].base = hdr;
+	iov[0].len = 2;
+	iov[1].base = map;
+	iov[1].len = len;
+	iov[2].base = fcs;
+	iov[2].len = 2;
+
+	for (;;) {
+		if (resend) {
+			DBG(DBG_TRACE, "--> %sbitmap", (iov[0].len == 2) ? "ACK, " : "");
+
+			if ((ret = serial_sendv(rx->dev, iov, 3)) < 0)
+				return ret;
+
+			/* the manifest is acknowledged once */
+			iov[0].base = &hdr[1];
+			iov[0].len = 1;
+			resend = false;
+		}
+
+		/* The sender NAKs a missing bitmap after its own timeout, 
+		   wait longer than that. */
+		if ((ret = serial_recv(rx->dev, pkt, 1, 
+							   2 * XMODEM_RCV_TMOUT_MS)) < 0)
+			return ret;
+
+		if (ret == 0) {
+			DBG(DBG_TRACE, "serial_recv() timeout!");
+			if (++retry == 10)
+				return -1;
+			continue;
+		}
+
+		c = pkt[0];
+
+		if (c == ACK) {
+			DBG(DBG_TRACE, "<-- ACK");
+			/* the sender starts right away */
+			rx->sync = 0;
+			return 0;
+		}
+
+		if (c == CAN) {
+			DBG(DBG_WARNING, "<-- CAN");
+			return -1;
+		}
+
+		if (c == NAK) {
+			DBG(DBG_TRACE, "<-- NAK");
+			if (++retry == 10)
+				return -1;
+			resend = true;
+			continue;
+		}
+
+		if (c == EOT) {
+			/* no blocks to send, the ACK was lost */
+			DBG(DBG_TRACE, "<-- EOT");
+			rx->sync = NAK;
+			return 0;
+		}
+
+		if ((c == SOH) || (c == STX) || (c == XTX)) {
+			int cnt;
+			int seq;
+
+			if ((ret = xmodem_recv_all(rx, &pkt[1], (c == XTX) ? 3 : 2,
+									   rx->rtt.rto)) < 0)
+				return ret;
+
+			seq = pkt[1];
+			if (c == XTX)
+				cnt = ((ret > 0) && (pkt[3] > 0) && 
+					   (pkt[3] <= XMODEM_PKT_DATA_MAX / 1024)) ? 
+					pkt[3] * 1024 : 0;
+			else
+				cnt = (c == STX) ? 1024 : 128;
+
+			/* skip the rest of the packet */
+			if ((ret > 0) && (seq == ((~pkt[2]) & 0xff)) && (cnt > 0)) {
+				if ((ret = xmodem_recv_all(rx, rx->pkt.data, cnt, 
+										   rx->rtt.rto)) > 0)
+					ret = xmodem_recv_all(rx, rx->pkt.fcs, (c == XTX) ? 4 :
+										  (rx->fcs_mode == FCS_CRC) ? 2 : 1,
+										  rx->rtt.rto);
+				if (ret < 0)
+					return ret;
+
+				if ((ret > 0) && (seq == (rx->pktno & 0xff))) {
+					DBG(DBG_TRACE, "<-- data %d, bitmap taken", seq);
+					rx->sync = NAK;
+					return 0;
+				}
+
+				/* the last manifest packet again, the NAK that had it
+				   resent crossed our bitmap */
+				if ((ret > 0) && (seq == ((rx->pktno - 1) & 0xff)))
+					continue;
+			}
+		}
+
+		/* Noise, wait for the line to settle. A garbled ACK is 
+		   followed by data, a garbled NAK by another one. */
+		DBG(DBG_WARNING, "invalid response: 0x%02x", c);
+		while (serial_recv(rx->dev, rx->pkt.data, sizeof(rx->pkt.data), 
+						   xmodem_rtt_base(&rx->rtt)) > 0);
+		if (++retry == 10)
+			return -1;
+	}
+}
+
+/* Resume: receive the sender's manifest, compare it with the blocks 
+   already in 'buf' and get the ones that differ. */
+static int xmodem_recv_resume(struct xmodem_recv * rx, 
+							  unsigned char * buf, size_t size)
+{
+	unsigned int nblk = (size + XMODEM_RESUME_BLK - 1) / XMODEM_RESUME_BLK;
+	unsigned int mlen = xmodem_manifest_len(nblk);
+	unsigned int blen = (nblk + 7) / 8;
+	unsigned char * manifest;
+	unsigned char * map;
+	unsigned int fsize = rx->fsize;
+	unsigned int total = 0;
+	unsigned int i;
+	int ret;
+
+	if ((manifest = calloc(1, mlen + blen)) == NULL) {
+		xmodem_recv_cancel(rx);
+		return -ENOMEM;
+	}
+	map = manifest + mlen;
+
+	/* the manifest is transferred as the file data */
+	rx->sync = 'R';
+	rx->fsize = mlen;
+	rx->count = 0;
+	if ((ret = xmodem_recv_buf(rx, manifest, mlen)) != (int)mlen) {
+		if (ret >= 0)
+			ret = -1;
+		goto done;
+	}
+
+	for (i = 0; i < nblk; ++i) {
+		const unsigned char * cp = &manifest[i * 4];
+		uint32_t crc = cp[0] | (cp[1] << 8) | (cp[2] << 16) | 
+			((uint32_t)cp[3] << 24);
+
+		if (xmodem_blk_crc32(buf, size, i) != crc) {
+			map[i / 8] |= 1 << (i % 8);
+			total += MIN(size - (size_t)i * XMODEM_RESUME_BLK, 
+						 XMODEM_RESUME_BLK);
+		}
+	}
+
+	DBG(DBG_INFO, "%d of %d bytes to receive", total, fsize);
+
+	if ((ret = xmodem_recv_map_send(rx, map, blen)) < 0)
+		goto done;
+
+	/* the blocks follow in ascending order */
+	rx->fsize = total;
+	rx->count = 0;
+
+	for (i = 0; i < nblk; ++i) {
+		size_t off = (size_t)i * XMODEM_RESUME_BLK;
+		int len = MIN(size - off, XMODEM_RESUME_BLK);
+
+		if ((map[i / 8] & (1 << (i % 8))) == 0)
+			continue;
+
+		if ((ret = xmodem_recv_buf(rx, buf + off, len)) != len) {
+			if (ret >= 0)
+				ret = -1;
+			goto done;
+		}
+	}
+
+	ret = 0;
+
+done:
+	rx->fsize = fsize;
+	rx->count = (ret == 0) ? fsize : 0;
+	free(manifest);
+
+	return ret;
+}
+
+int xmodem_recv_file(struct xmodem_recv * rx, const char * path)
+{
+	struct stat st;
+	unsigned char * buf;
+	const char * cp;
+	bool eot = false;
+	size_t size;
+	int cnt = 0;
+	int ret;
+	int fd;
+
+	if ((rx == NULL) || ((path == NULL) && (rx->xfr_mode != MODE_YMODEM)))
+		return -EINVAL;
+
+	if ((rx->xfr_mode == MODE_YMODEM) && (rx->pktno == 0)) {
+		if ((ret = xmodem_recv_loop(rx, rx->pkt.data, 1)) < 0)
+			return ret;
+	}
+
+	if (path == NULL) {
+		/* end of batch */
+		if (rx->fname[0] == '\0')
+			return 0;
+		/* never write outside the current directory */
+		path = rx->fname;
+		for (cp = rx->fname; *cp != '\0'; ++cp) {
+			if ((*cp == '/') || (*cp == '\\'))
+				path = cp + 1;
+		}
+	}
+
+	if ((rx->xfr_mode == MODE_YMODEM) && (rx->fsize > 0)) {
+		/* A copy of the file left by an interrupted transfer is 
+		   reused if both ends agree on resuming. */
+		bool resume = (rx->opt & XMODEM_OPT_RESUME) && 
+			(rx->peer_opt & XMODEM_OPT_RESUME) &&
+			(stat(path, &st) == 0) && S_ISREG(st.st_mode) && 
+			(st.st_size > 0);
+
+		/* The size is known upfront: receive straight into a mapping
+		   of the output file. */
+		size = rx->fsize;
+		if ((buf = fmap_create(path, size)) == NULL) {
+			xmodem_recv_cancel(rx);
+			return -1;
+		}
+
+		if (resume)
+			ret = xmodem_recv_resume(rx, buf, size);
+		else
+			ret = xmodem_recv_buf(rx, buf, size);
+		funmap(buf, size);
+	} else {
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 
+					   0644)) < 0) {
+			DBG(DBG_WARNING, "open(\"%s\"): %s.", path, strerror(errno));
+			return -1;
+		}
+
+		size = XMODEM_FILE_BUF_SIZE;
+		if ((buf = malloc(size)) == NULL) {
+			close(fd);
+			return -ENOMEM;
+		}
+
+		/* no size in the YMODEM header: written up to the EOT */
+		eot = (rx->xfr_mode == MODE_YMODEM);
+
+		while ((ret = xmodem_recv_buf(rx, buf, size)) > 0) {
+			if (write(fd, buf, ret) != ret) {
+				DBG(DBG_WARNING, "write(): %s.", strerror(errno));
+				xmodem_recv_cancel(rx);
+				ret = -1;
+				break;
+			}
+			cnt += ret;
+			/* a short read means the EOT was received */
+			if (ret < size)
+				break;
+		}
+
+		free(buf);
+		close(fd);
+	}
+
+	if (ret < 0)
+		return ret;
+
+	if ((rx->xfr_mode == MODE_YMODEM) && !eot) {
+		cnt = rx->count;
+		/* Consume the EOT. This also receives the header of the next
+		   file, or the empty one closing the batch. */
+		if ((ret = xmodem_recv_loop(rx, rx->pkt.data, 1)) < 0)
+			return ret;
+	}
+
+	return cnt;
+}
+
 int xmodem_recv_init(struct xmodem_recv * rx, const struct serial_dev * dev, 
 					int fcs_mode, int xfr_mode)
 {
@@ -333,9 +915,14 @@ int xmodem_recv_init(struct xmodem_recv * rx, const struct serial_dev * dev,
 
 	rx->fcs_mode = fcs_mode;
 	rx->xfr_mode = xfr_mode;
+	rx->opt = 0;
+	rx->peer_opt = 0;
 	rx->pktno = (rx->xfr_mode == MODE_YMODEM) ? 0 : 1;
-	rx->sync = (rx->fcs_mode == FCS_CRC) ? 'C' : NAK;
+	xmodem_rtt_init(&rx->rtt, xmodem_baud_get(rx->dev));
+	rx->sync = xmodem_recv_sync(rx);
 	rx->retry = 30;
+	rx->meter.cb = NULL;
+	xmodem_meter_start(&rx->meter, 0);
 	rx->data_len = 0;
 	rx->data_pos = 0;
 	rx->fsize = (rx->xfr_mode == MODE_YMODEM) ? 0 : XMODEM_FILE_SIZE_MAX;
@@ -345,6 +932,37 @@ int xmodem_recv_init(struct xmodem_recv * rx, const struct serial_dev * dev,
 	return 0;
 }
 
+int xmodem_recv_opt_set(struct xmodem_recv * rx, unsigned int opt)
+{
+	if (rx == NULL)
+		return -EINVAL;
+
+	rx->opt = opt;
+
+	/* streaming requires CRC */
+	if (rx->opt & XMODEM_OPT_STREAM)
+		rx->fcs_mode = FCS_CRC;
+
+	if (rx->pktno <= 1)
+		rx->sync = xmodem_recv_sync(rx);
+
+	return 0;
+}
+
+int xmodem_recv_progress_set(struct xmodem_recv * rx, 
+							 xmodem_progress_cb_t cb, void * arg,
+							 unsigned int interval_ms)
+{
+	if (rx == NULL)
+		return -EINVAL;
+
+	rx->meter.cb = cb;
+	rx->meter.arg = arg;
+	rx->meter.interval = interval_ms;
+
+	return 0;
+}
+
 int xmodem_recv_cancel(struct xmodem_recv * rx)
 {
 	unsigned char * pkt = rx->pkt.hdr;
@@ -26,21 +26,19 @@
 
 #include <sys/param.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <errno.h>
 
-#include "xmodem.h"
+#include "private.h"
 #include "crc.h"
+#include "fmap.h"
 #include "debug.h"
 
-#define SOH  0x01
-#define STX  0x02
-#define EOT  0x04
-#define ACK  0x06
-#define NAK  0x15
-#define CAN  0x18
-
+/* Wait for the receiver to start the transfer */
 #define XMODEM_SEND_TMOUT_MS 2000
 
 #ifndef MIN
@@ -50,107 +48,239 @@
 enum {
 	XMODEM_SEND_IDLE = 0,
 	XMODEM_SEND_CRC = 1,
-	XMODEM_SEND_CKS = 2
+	XMODEM_SEND_CKS = 2,
+	XMODEM_SEND_STREAM = 3,
+	XMODEM_SEND_EXT = 4,
+	/* CRC mode, the receiver asked to resume the file */
+	XMODEM_SEND_RESUME = 5
 };
 
-static int xmodem_send_pkt(struct xmodem_send * sx, int data_len)
+/* Check 'c' for a start request from the receiver and set the transfer
+   mode accordingly. Returns the start character, 0 if 'c' is not one,
+   or a negative value on error. */
+static int xmodem_send_sync_chr(struct xmodem_send * sx, int c)
 {
-	unsigned char * pkt = sx->pkt.hdr; 
-	unsigned char * cp;
-	int retry = 0;
-	int pkt_len;
+	unsigned char buf[1];
+	unsigned int max;
 	int ret;
-	int c;
 
+	if (c == CAN) {
+		DBG(DBG_WARNING, "<-- CAN");
+		return -1;
+	}
 
-	if (sx->state == XMODEM_SEND_IDLE) {
+	/* a previous request may have set extended blocks */
+	if (c == 'C') {
+		DBG(DBG_INFO, "<-- 'C' (CRC mode)");
+		sx->state = XMODEM_SEND_CRC;
+		sx->data_max = (sx->mode != MODE_XMODEM) ? 1024 : 128;
+		return c;
+	}
 
-		for (;;) {
-
-			// Wait for NAK or 'C'
-			if ((ret = serial_recv(sx->dev, pkt, 
-								   1, XMODEM_SEND_TMOUT_MS)) <= 0) {
-				if (ret == 0) {
-					DBG(DBG_INFO, "serial_recv() timed out!");
-					if (++retry < 20) 
-						continue;
-				
-					DBG(DBG_WARNING, "too many retries!");
-					return -1;
-				} 
-
-				DBG(DBG_WARNING, "serial_recv() failed 1!");
-				return ret;
-			}
-			c = *pkt;
+	if (c == NAK) {
+		DBG(DBG_INFO, "<-- NAK (Checksum mode)");
+		sx->state = XMODEM_SEND_CKS;
+		sx->data_max = (sx->mode != MODE_XMODEM) ? 1024 : 128;
+		return c;
+	}
 
-			if (c == CAN) {
-				DBG(DBG_WARNING, "<-- CAN");
-				return -1;
-			}
+	if (c == 'G') {
+		DBG(DBG_INFO, "<-- 'G' (Streaming mode)");
+		sx->state = XMODEM_SEND_STREAM;
+		sx->data_max = (sx->mode != MODE_XMODEM) ? 1024 : 128;
+		return c;
+	}
 
-			if (c == 'C') {
-				DBG(DBG_INFO, "<-- 'C' (CRC mode)");
-				sx->state = XMODEM_SEND_CRC;
-				break;
-			}
+	if ((c == XMODEM_SYNC_EXT) && 
+		((max = xmodem_ext_max(sx->opt, sx->rtt.baud)) > 0)) {
+		unsigned int n;
 
-			if (c == NAK) {
-				DBG(DBG_INFO, "<-- NAK (Checksum mode)");
-				sx->state = XMODEM_SEND_CKS;
-				break;
-			}
+		/* the receiver's largest block size follows */
+		if ((ret = serial_recv(sx->dev, buf, 1, sx->rtt.rto)) < 0)
+			return ret;
+		n = buf[0] - '0';
+		if ((ret == 0) || (n < 1) || (n > 8))
+			return 0;
+
+		if (n > max)
+			n = max;
+
+		DBG(DBG_INFO, "<-- 'X' (Extended mode, %dKB)", n);
+		sx->state = XMODEM_SEND_EXT;
+		sx->data_max = n * 1024;
+		return c;
+	}
+
+	if (c == 'R') {
+		DBG(DBG_INFO, "<-- 'R' (Resume)");
+		/* the blocks to resume are 1KB, no extended packets */
+		sx->state = XMODEM_SEND_RESUME;
+		sx->data_max = 1024;
+		return c;
+	}
 
+	return 0;
+}
+
+/* Wait for the receiver to start the transfer. Returns the start 
+   character. */
+static int xmodem_send_sync(struct xmodem_send * sx)
+{
+	unsigned char buf[1];
+	int retry = 0;
+	int ret;
+
+	for (;;) {
+
+		// Wait for NAK or 'C'
+		if ((ret = serial_recv(sx->dev, buf, 
+							   1, XMODEM_SEND_TMOUT_MS)) <= 0) {
+			if (ret == 0) {
+				DBG(DBG_INFO, "serial_recv() timed out!");
+				if (++retry < 20) 
+					continue;
+			
+				DBG(DBG_WARNING, "too many retries!");
+				return -1;
+			} 
+
+			DBG(DBG_WARNING, "serial_recv() failed 1!");
+			return ret;
 		}
+
+		if ((ret = xmodem_send_sync_chr(sx, buf[0])) != 0)
+			return ret;
 	}
+}
+
+/* Frame a packet with sequence 'seq' for the payload pointed by 'data'. 
+   A zero 'data_len' frames an EOT. */
+static int xmodem_frm_build(struct xmodem_send * sx, struct xmodem_frm * frm,
+							const unsigned char * data, int data_len, 
+							unsigned char seq)
+{
+	unsigned char * hdr = frm->hdr;
+	unsigned char * fcs = frm->fcs;
 
+	if (data_len && (sx->state == XMODEM_SEND_EXT)) {
+		uint32_t crc;
 
-	if (data_len) {
-		unsigned char * fcs;
+		if ((data_len % 1024) || (data_len > XMODEM_PKT_DATA_MAX))
+			return -1;
 
+		hdr[0] = XTX;
+		hdr[1] = seq;
+		hdr[2] = ~seq;
+		hdr[3] = data_len / 1024;
+		frm->hlen = 4;
+
+		crc = ~crc32(crc32(~0UL, &hdr[3], 1), data, data_len);
+		fcs[0] = crc >> 24;
+		fcs[1] = crc >> 16;
+		fcs[2] = crc >> 8;
+		fcs[3] = crc;
+		frm->flen = 4;
+	} else if (data_len) {
 		if (data_len == 1024)
-			pkt[0] = STX;
+			hdr[0] = STX;
 		else if (data_len == 128)
-			pkt[0] = SOH;
+			hdr[0] = SOH;
 		else
 			return -1;
 
-		pkt[1] = sx->seq;
-		pkt[2] = ~sx->seq;
-		cp = &pkt[3];
-		fcs = &pkt[3 + data_len];
-
-		if (sx->state == XMODEM_SEND_CRC) {
-			unsigned short crc = 0;
-			int i;
+		hdr[1] = seq;
+		hdr[2] = ~seq;
+		frm->hlen = 3;
 
-			for (i = 0; i < data_len; ++i)
-				crc = CRC16CCITT(crc, cp[i]);
+		if (sx->state != XMODEM_SEND_CKS) {
+			unsigned short crc;
 
+			crc = crc16ccitt(0, data, data_len);
 			fcs[0] = crc >> 8;
 			fcs[1] = crc & 0xff;
-			pkt_len = 3 + data_len + 2;
+			frm->flen = 2;
 		} else {
 			unsigned char cks = 0;
 			int i;
 
 			for (i = 0; i < data_len; ++i)
-				cks += cp[i];
+				cks += data[i];
 
 			fcs[0] = cks;
-			pkt_len = 3 + data_len + 1;
+			frm->flen = 1;
 		}
 	} else {
-		pkt[0] = EOT;
-		pkt_len = 1;
+		hdr[0] = EOT;
+		frm->hlen = 1;
+		frm->flen = 0;
 	}
 
+	frm->data = data;
+	frm->len = data_len;
+	frm->seq = seq;
+
+	return 0;
+}
+
+/* Send a data packet with the payload pointed by 'data', which does not
+   need to be in sx->pkt. A zero 'data_len' sends an EOT. 
+   If the payload of the following packet is known, 'next', it is framed
+   while this one is on the wire. It must have the same length and stay 
+   in place until sent. */
+static int xmodem_send_pkt(struct xmodem_send * sx, 
+						   const unsigned char * data, int data_len,
+						   const unsigned char * next)
+{
+	struct xmodem_frm * frm;
+	struct serial_iov iov[3];
+	unsigned char * pkt;
+	bool start;
+	int iov_cnt;
+	int retry = 0;
+	int sync = 0;
+	int ret;
+	int c;
+
+	if (sx->state == XMODEM_SEND_IDLE) {
+		if ((ret = xmodem_send_sync(sx)) < 0)
+			return ret;
+	}
+
+	frm = &sx->frm[sx->frm_idx];
+	pkt = frm->hdr;
+
+	/* framed already by the previous call? */
+	if ((data_len == 0) || (frm->data != data) || 
+		(frm->len != data_len) || (frm->seq != sx->seq)) {
+		if (xmodem_frm_build(sx, frm, data, data_len, sx->seq) < 0)
+			return -1;
+	}
+
+	iov[0].base = frm->hdr;
+	iov[0].len = frm->hlen;
+	iov[1].base = data;
+	iov[1].len = data_len;
+	iov[2].base = frm->fcs;
+	iov[2].len = frm->flen;
+	iov_cnt = (data_len) ? 3 : 1;
+
+	if ((data_len != 0) && (data_len != sx->rtt.len))
+		xmodem_rtt_resize(&sx->rtt, data_len);
+
+	/* the receiver follows the header and the EOT with a start request */
+	start = sx->hdr || (data_len == 0);
+
+	retry = 0;
+
 	for (;;) {
 		unsigned char buf[1];
+		uint32_t t0;
 
 //		DBG_DUMP(DBG_INFO, pkt, data_len + 3);
 
-		if (pkt[0] == STX) {
+		if (pkt[0] == XTX) {
+			DBG(DBG_INFO, "--> XTX %3d %dKB", pkt[1], pkt[3]);
+		} else if (pkt[0] == STX) {
 			DBG(DBG_INFO, "--> STX %3d", pkt[1]);
 		} else if (pkt[0] == SOH) {
 			DBG(DBG_INFO, "--> SOH %3d", pkt[1]);
@@ -159,19 +289,41 @@ static int xmodem_send_pkt(struct xmodem_send * sx, int data_len)
 		} 
 
 		// Send packet
-		if ((ret = serial_send(sx->dev, pkt, pkt_len)) < 0) {
-			DBG(DBG_WARNING, "serial_send() failed!");
-			return ret;
+		if ((ret = serial_sendv(sx->dev, iov, iov_cnt)) < 0) {
+			DBG(DBG_WARNING, "serial_sendv() failed!");
+			goto error;
+		}
+
+		if ((next != NULL) && (retry == 0)) {
+			/* Frame the next packet in the meantime. The serial layer
+			   has the data and is busy pushing it out. */
+			xmodem_frm_build(sx, &sx->frm[sx->frm_idx ^ 1], next, 
+							 data_len, sx->seq + 1);
+		}
+
+		if ((sx->state == XMODEM_SEND_STREAM) && (pkt[0] != EOT)) {
+			/* Streaming: data packets are not acknowledged, the receiver
+			   cancels the transfer on errors. Check for a CAN without 
+			   blocking. */
+			if ((serial_recv(sx->dev, buf, 1, 0) > 0) && (buf[0] == CAN)) {
+				DBG(DBG_WARNING, "<-- CAN");
+				ret = -2;
+				goto error;
+			}
+			break;
 		}
 		
+		t0 = xmodem_clock_ms();
+
 		// Wait for ACK
-		if ((ret = serial_recv(sx->dev, buf, 1, 500)) <= 0) {
+		if ((ret = serial_recv(sx->dev, buf, 1, sx->rtt.rto)) <= 0) {
 			if (ret == 0) {
 				DBG(DBG_INFO, "serial_recv() timed out 2!");
-				if (++retry == 10) {
-					DBG(DBG_WARNING, "too many retries");
+				xmodem_rtt_backoff(&sx->rtt);
+				sx->meter.retries++;
+				if (++retry < 10)
 					continue;
-				}
+				DBG(DBG_WARNING, "too many retries");
 			} else
 				DBG(DBG_WARNING, "serial_recv() failed 2!");
 
@@ -183,6 +335,42 @@ static int xmodem_send_pkt(struct xmodem_send * sx, int data_len)
 
 		if (c == ACK) {
 			DBG(DBG_INFO, "<-- ACK");
+			/* Karn's rule: the ACK of a retransmitted packet can't be
+			   matched to a transmission, don't sample it. */
+			if (retry == 0) {
+				xmodem_rtt_update(&sx->rtt, xmodem_clock_ms() - t0);
+				/* Between data packets nothing else is due, a 
+				   duplicated ACK would acknowledge the next one. Drop
+				   what came along, without waiting. The header and the
+				   EOT are followed by a start request. */
+				while (!sx->hdr && (data_len != 0) && 
+					   (serial_recv(sx->dev, buf, 1, 0) > 0)) {
+					if (buf[0] == CAN) {
+						DBG(DBG_WARNING, "<-- CAN");
+						ret = -2;
+						goto error;
+					}
+				}
+				break;
+			}
+			xmodem_rtt_restore(&sx->rtt);
+			/* The receiver may acknowledge both copies of the packet, 
+			   drop the extra ACK before it is taken for the next one. 
+			   After the header it also repeats the start request, the
+			   last one is kept. A NAK means it waits for the next packet
+			   already, everything it sent before is in. */
+			while (serial_recv(sx->dev, buf, 1, sx->rtt.rto) > 0) {
+				if (buf[0] == CAN) {
+					DBG(DBG_WARNING, "<-- CAN");
+					ret = -2;
+					goto error;
+				}
+				if (!start && (buf[0] == NAK))
+					break;
+				if (start && (buf[0] != ACK) &&
+					((ret = xmodem_send_sync_chr(sx, buf[0])) > 0))
+					sync = ret;
+			}
 			break;
 		}
 
@@ -192,6 +380,26 @@ static int xmodem_send_pkt(struct xmodem_send * sx, int data_len)
 			goto error;
 		}
 
+		if ((pkt[0] == EOT) && (sx->mode == MODE_YMODEM) && (c != NAK) &&
+			((ret = xmodem_send_sync_chr(sx, c)) > 0)) {
+			/* The ACK was lost, the receiver asks for the next header
+			   already. */
+			DBG(DBG_INFO, "<-- '%c' for the EOT", c);
+			sync = ret;
+			break;
+		}
+
+		if ((sx->hdr || (sx->seq == 1)) && 
+			((c == 'C') || (c == 'G') || (c == XMODEM_SYNC_EXT))) {
+			/* The receiver didn't get the header, or the first data
+			   packet, and repeats the start request, which stands for 
+			   a NAK. */
+			DBG(DBG_INFO, "<-- '%c'", c);
+			if (c == XMODEM_SYNC_EXT)
+				serial_recv(sx->dev, buf, 1, sx->rtt.rto);
+			c = NAK;
+		}
+
 		if (c != NAK) {
 			DBG(DBG_WARNING, "invalid response: 0x%02x '%c'", c, c);
 			ret = -3;
@@ -199,6 +407,7 @@ static int xmodem_send_pkt(struct xmodem_send * sx, int data_len)
 		}
 
 		DBG(DBG_INFO, "<-- NAK");
+		sx->meter.retries++;
 
 		if (++retry == 10) {
 			DBG(DBG_WARNING, "too many retries");
@@ -207,14 +416,32 @@ static int xmodem_send_pkt(struct xmodem_send * sx, int data_len)
 		}
 	}
 
+	xmodem_meter_update(&sx->meter, &sx->rtt, data_len, false);
+
+	/* the framing of a payload in sx->pkt won't hold for the next one */
+	frm->data = NULL;
+	sx->frm_idx ^= 1;
 	sx->seq++;
+
+	if (start) {
+		/* the receiver sends a start request next, unless it did 
+		   already */
+		if (sync == 0)
+			sx->state = XMODEM_SEND_IDLE;
+		sx->hdr = 0;
+	}
 	
 	return 0;
 
 error:
-	/* flush */
+	sx->frm[0].data = NULL;
+	sx->frm[1].data = NULL;
+	sx->hdr = 0;
+
+	/* flush, the line is quiet after a round trip without data */
 	retry = 0;
-	while (serial_recv(sx->dev, sx->pkt.data, 1024, 200) > 0) {
+	while (serial_recv(sx->dev, sx->pkt.data, sizeof(sx->pkt.data), 
+					   sx->rtt.rto) > 0) {
 		if (++retry == 10)
 			break;
 	}
@@ -230,18 +457,28 @@ int xmodem_send_open(struct xmodem_send * sx,
 
 	sx->dev = (struct serial_dev *)dev;
 	sx->mode = mode;
+	sx->opt = 0;
 	sx->data_max = (sx->mode != MODE_XMODEM) ? 1024 : 128;
 	sx->data_len = 0;
-	sx->seq = (sx->mode != MODE_YMODEM) ? 0 : 1;
+	sx->seq = 1;
 	sx->state = XMODEM_SEND_IDLE;
+	sx->hdr = 0;
+	sx->frm_idx = 0;
+	sx->frm[0].data = NULL;
+	sx->frm[1].data = NULL;
+	xmodem_rtt_init(&sx->rtt, xmodem_baud_get(sx->dev));
+	sx->meter.cb = NULL;
+	xmodem_meter_start(&sx->meter, 0);
 
 	serial_drain(sx->dev);
 	
 	return 0;
 }
 
-int xmodem_send_start(struct xmodem_send * sx, const char * fname, 
-					  unsigned int fsize)
+/* YMODEM header block: name, size, time stamp and the transfer options 
+   as a string of flag letters, all NUL terminated. */
+static int xmodem_send_hdr(struct xmodem_send * sx, const char * fname, 
+						   unsigned int fsize, const char * flags)
 {
 	unsigned int timestamp = 0;
 	unsigned char * data; 
@@ -250,34 +487,44 @@ int xmodem_send_start(struct xmodem_send * sx, const char * fname,
 	int i;
 	int len;
 
-
-	if (sx->mode == MODE_YMODEM) {
-		data = sx->pkt.data;
-		data += sprintf((char *)data, "%s", fname);
-		data++;
-		data += sprintf((char *)data, "%d", fsize);
-		data++;
-		data += sprintf((char *)data, "%d", timestamp);
-		data++;
-		len = data - sx->pkt.data;
+	data = sx->pkt.data;
+	data += sprintf((char *)data, "%s", fname);
+	data++;
+	data += sprintf((char *)data, "%d", fsize);
+	data++;
+	data += sprintf((char *)data, "%d", timestamp);
+	data++;
+	data += sprintf((char *)data, "%s", flags);
+	data++;
+	len = data - sx->pkt.data;
 #if 1
-		max = 1024;
+	max = 1024;
 #else
-		max =  (sx->data_len < 128) ? 128 : sx->data_max;
+	max =  (sx->data_len < 128) ? 128 : sx->data_max;
 #endif
-		DBG(DBG_INFO, "fname='%s' fsize=%d", fname, fsize);
+	DBG(DBG_INFO, "fname='%s' fsize=%d", fname, fsize);
 
-		/* padding */
-		for (i = 0; i < (max - len); ++i)
-			data[i] = '\0';
+	/* padding */
+	for (i = 0; i < (max - len); ++i)
+		data[i] = '\0';
 
-		sx->seq = 0;
-		if ((ret = xmodem_send_pkt(sx, max)) < 0)
-			return ret;
+	sx->seq = 0;
+	sx->hdr = 1;
+	if ((ret = xmodem_send_pkt(sx, sx->pkt.data, max, NULL)) < 0)
+		return ret;
 
-		sx->state = XMODEM_SEND_IDLE;
-		sx->data_len = 0;
-	}
+	xmodem_meter_start(&sx->meter, fsize);
+
+	sx->data_len = 0;
+
+	return 0;
+}
+
+int xmodem_send_start(struct xmodem_send * sx, const char * fname, 
+					  unsigned int fsize)
+{
+	if (sx->mode == MODE_YMODEM)
+		return xmodem_send_hdr(sx, fname, fsize, "");
 
 	return 0;
 }
@@ -292,24 +539,38 @@ int xmodem_send_loop(struct xmodem_send * sx, const void * data, int len)
 	DBG(DBG_INFO, "len=%d!", len);
 
 	do {
-		unsigned char * dst;
 		int ret;
 		int rem;
 		int n;
-		int i;
 
-		dst = &sx->pkt.data[sx->data_len];
+		if ((sx->data_len == 0) && (len >= sx->data_max)) {
+			const unsigned char * next = NULL;
+
+			if (len >= 2 * sx->data_max)
+				next = src + sx->data_max;
+
+			/* Whole blocks are sent straight from the caller's buffer */
+			if ((ret = xmodem_send_pkt(sx, src, sx->data_max, next)) < 0) {
+				DBG(DBG_WARNING, "xmodem_send_pkt() failed!");
+				return ret;
+			}
+
+			src += sx->data_max;
+			len -= sx->data_max;
+			continue;
+		}
+
 		rem = sx->data_max - sx->data_len;
 		n = MIN(len, rem);
 
-		for (i = 0; i < n; ++i)
-			dst[i] = src[i];
+		memcpy(&sx->pkt.data[sx->data_len], src, n);
 
 		sx->data_len += n;
 
 		if (sx->data_len == sx->data_max) {
 
-			if ((ret = xmodem_send_pkt(sx, sx->data_len)) < 0) {
+			if ((ret = xmodem_send_pkt(sx, sx->pkt.data, 
+									   sx->data_len, NULL)) < 0) {
 				DBG(DBG_WARNING, "xmodem_send_pkt() failed!");
 				return ret;
 			}
@@ -339,6 +600,9 @@ int xmodem_send_eot(struct xmodem_send * sx)
 	if (sx->mode == MODE_YMODEM)
 		data_max = sx->data_max;
 #endif
+	/* extended packets come in 1KB steps, don't pad more than needed */
+	if (sx->state == XMODEM_SEND_EXT)
+		data_max = (data_len + 1023) & ~1023;
 
 	data = sx->pkt.data;
 
@@ -353,7 +617,7 @@ int xmodem_send_eot(struct xmodem_send * sx)
 			data[i] = '\0';
 
 
-		if ((ret = xmodem_send_pkt(sx, data_max)) < 0) {
+		if ((ret = xmodem_send_pkt(sx, data, data_max, NULL)) < 0) {
 			return ret;
 		}
 
@@ -362,16 +626,298 @@ int xmodem_send_eot(struct xmodem_send * sx)
 	}
 
 	/* Send EOT */
-	ret = xmodem_send_pkt(sx, 0);
+	if ((ret = xmodem_send_pkt(sx, NULL, 0, NULL)) == 0)
+		xmodem_meter_update(&sx->meter, &sx->rtt, 0, true);
+	xmodem_meter_start(&sx->meter, 0);
 
-	sx->data_max = (sx->mode != MODE_XMODEM) ? 1024 : 128;
+	/* the next file may have been requested along with the ACK */
+	if (ret < 0)
+		sx->state = XMODEM_SEND_IDLE;
+	if (sx->state != XMODEM_SEND_EXT)
+		sx->data_max = (sx->mode != MODE_XMODEM) ? 1024 : 128;
 	sx->data_len = 0;
-	sx->seq = (sx->mode != MODE_YMODEM) ? 0 : 1;
-	sx->state = XMODEM_SEND_IDLE;
+	sx->seq = 1;
 
 	return ret;
 }
 
+/* Resume: send the last manifest packet, 'data', and receive the bitmap
+   of the blocks to send. The receiver acknowledges the packet with the
+   bitmap frame, but the ACK may be lost and resent frames come without
+   it: anything before the frame start is skipped. A missing or damaged
+   frame is asked for again with a NAK. */
+static int xmodem_send_map_recv(struct xmodem_send * sx, 
+								const unsigned char * data,
+								unsigned char * map, int len)
+{
+	struct xmodem_frm * frm = &sx->frm[sx->frm_idx];
+	struct serial_iov iov[3];
+	unsigned char buf[2];
+	bool resend = true;
+	int retry;
+	int ret;
+
+	if (xmodem_frm_build(sx, frm, data, XMODEM_RESUME_BLK, sx->seq) < 0)
+		return -1;
+
+	iov[0].base = frm->hdr;
+	iov[0].len = frm->hlen;
+	iov[1].base = data;
+	iov[1].len = XMODEM_RESUME_BLK;
+	iov[2].base = frm->fcs;
+	iov[2].len = frm->flen;
+
+	for (retry = 0; retry < 10; ++retry) {
+		unsigned char * cp;
+		int rem;
+
+		if (resend) {
+			DBG(DBG_INFO, "--> STX %3d", frm->hdr[1]);
+			if ((ret = serial_sendv(sx->dev, iov, 3)) < 0)
+				return ret;
+			resend = false;
+		}
+
+		/* The receiver compares its copy of the file first */
+		do {
+			ret = serial_recv(sx->dev, buf, 1, XMODEM_SEND_TMOUT_MS);
+		} while ((ret > 0) && (buf[0] != XMODEM_RESUME_MAP) && 
+				 (buf[0] != NAK) && (buf[0] != CAN));
+
+		if (ret < 0)
+			return ret;
+
+		if (ret == 0) {
+			/* Either the packet or the bitmap was lost. The receiver
+			   NAKs the former itself, ask for the latter. */
+			DBG(DBG_INFO, "serial_recv() timed out, --> NAK");
+			sx->meter.retries++;
+			buf[0] = NAK;
+			if ((ret = serial_send(sx->dev, buf, 1)) < 0)
+				return ret;
+			continue;
+		}
+
+		if (buf[0] == CAN) {
+			DBG(DBG_WARNING, "<-- CAN");
+			return -2;
+		}
+
+		if (buf[0] == NAK) {
+			DBG(DBG_INFO, "<-- NAK");
+			sx->meter.retries++;
+			resend = true;
+			continue;
+		}
+
+		for (cp = map, rem = len + 2; rem > 0; ) {
+			/* the CRC goes after the bitmap */
+			unsigned char * dst = (rem > 2) ? cp : &buf[2 - rem];
+			int n = (rem > 2) ? rem - 2 : rem;
+
+			if ((ret = serial_recv(sx->dev, dst, n, sx->rtt.rto)) <= 0)
+				break;
+
+			if (rem > 2)
+				cp += ret;
+			rem -= ret;
+		}
+
+		if (ret < 0)
+			return ret;
+
+		if ((rem == 0) && 
+			(crc16ccitt(0, map, len) == ((buf[0] << 8) | buf[1]))) {
+			DBG(DBG_INFO, "<-- bitmap, --> ACK");
+			buf[0] = ACK;
+			if ((ret = serial_send(sx->dev, buf, 1)) < 0)
+				return ret;
+
+			xmodem_meter_update(&sx->meter, &sx->rtt, 
+								XMODEM_RESUME_BLK, false);
+			frm->data = NULL;
+			sx->frm_idx ^= 1;
+			sx->seq++;
+			return 0;
+		}
+
+		DBG(DBG_WARNING, "invalid bitmap, --> NAK");
+		sx->meter.retries++;
+		while (serial_recv(sx->dev, sx->pkt.data, sizeof(sx->pkt.data), 
+					   sx->rtt.rto) > 0);
+		buf[0] = NAK;
+		if ((ret = serial_send(sx->dev, buf, 1)) < 0)
+			return ret;
+	}
+
+	DBG(DBG_WARNING, "too many retries!");
+
+	return -1;
+}
+
+/* Resume: send the per-block CRC32 manifest of the image, get back the
+   bitmap of the blocks the receiver is missing and send only those, in 
+   ascending order. */
+static int xmodem_send_resume(struct xmodem_send * sx, 
+							  const unsigned char * data, size_t size)
+{
+	unsigned int nblk = (size + XMODEM_RESUME_BLK - 1) / XMODEM_RESUME_BLK;
+	unsigned int mlen = xmodem_manifest_len(nblk);
+	unsigned int blen = (nblk + 7) / 8;
+	unsigned char * manifest;
+	unsigned char * map;
+	unsigned int cnt = 0;
+	unsigned int i;
+	int ret;
+
+	if ((manifest = calloc(1, mlen + blen)) == NULL)
+		return -ENOMEM;
+	map = manifest + mlen;
+
+	for (i = 0; i < nblk; ++i) {
+		uint32_t crc = xmodem_blk_crc32(data, size, i);
+
+		manifest[i * 4] = crc;
+		manifest[i * 4 + 1] = crc >> 8;
+		manifest[i * 4 + 2] = crc >> 16;
+		manifest[i * 4 + 3] = crc >> 24;
+	}
+
+	/* the reply to the last packet is the bitmap */
+	sx->data_len = 0;
+	if ((mlen > XMODEM_RESUME_BLK) && 
+		((ret = xmodem_send_loop(sx, manifest, 
+								 mlen - XMODEM_RESUME_BLK)) < 0))
+		goto done;
+
+	if ((ret = xmodem_send_map_recv(sx, manifest + mlen - XMODEM_RESUME_BLK,
+									map, blen)) < 0)
+		goto done;
+
+	for (i = 0; i < nblk; ++i) {
+		size_t off = (size_t)i * XMODEM_RESUME_BLK;
+		size_t len = MIN(size - off, XMODEM_RESUME_BLK);
+
+		if ((map[i / 8] & (1 << (i % 8))) == 0)
+			continue;
+
+		if (len < XMODEM_RESUME_BLK) {
+			/* the last block is padded by xmodem_send_eot() */
+			memcpy(sx->pkt.data, data + off, len);
+			sx->data_len = len;
+		} else {
+			const unsigned char * next = NULL;
+			unsigned int j;
+
+			/* the next block to send, if a whole one */
+			for (j = i + 1; j < nblk; ++j) {
+				if (map[j / 8] & (1 << (j % 8))) {
+					if ((size_t)(j + 1) * XMODEM_RESUME_BLK <= size)
+						next = data + (size_t)j * XMODEM_RESUME_BLK;
+					break;
+				}
+			}
+
+			if ((ret = xmodem_send_pkt(sx, data + off, len, next)) < 0)
+				goto done;
+		}
+		cnt++;
+	}
+
+	DBG(DBG_INFO, "%d of %d blocks sent", cnt, nblk);
+
+	ret = xmodem_send_eot(sx);
+
+done:
+	free(manifest);
+
+	return ret;
+}
+
+int xmodem_send_file(struct xmodem_send * sx, const char * path)
+{
+	const char * fname;
+	const char * cp;
+	size_t size;
+	void * ptr;
+	int ret;
+
+	if ((sx == NULL) || (path == NULL))
+		return -EINVAL;
+
+	/* The image is sent straight from the page cache, the only
+	   copy is the padded last block. */
+	if ((ptr = fmap(path, &size)) == NULL) {
+		DBG(DBG_WARNING, "fmap(\"%s\") failed!", path);
+		return -1;
+	}
+
+	if (size > INT_MAX) {
+		funmap(ptr, size);
+		return -EFBIG;
+	}
+
+	/* strip the directory part */
+	fname = path;
+	for (cp = path; *cp != '\0'; ++cp) {
+		if ((*cp == '/') || (*cp == '\\'))
+			fname = cp + 1;
+	}
+
+	if ((sx->mode == MODE_YMODEM) && (sx->opt & XMODEM_OPT_RESUME)) {
+		if ((ret = xmodem_send_hdr(sx, fname, size, "R")) < 0)
+			goto done;
+
+		/* A receiver holding a copy of the file answers with 'R' */
+		if ((sx->state == XMODEM_SEND_IDLE) && 
+			((ret = xmodem_send_sync(sx)) < 0))
+			goto done;
+
+		if (sx->state == XMODEM_SEND_RESUME) {
+			ret = xmodem_send_resume(sx, ptr, size);
+			goto done;
+		}
+
+		ret = 0;
+	} else {
+		ret = xmodem_send_start(sx, fname, size);
+	}
+
+	if (ret == 0) {
+		if ((ret = xmodem_send_loop(sx, ptr, size)) == 0)
+			ret = xmodem_send_eot(sx);
+	}
+
+done:
+	funmap(ptr, size);
+
+	return ret;
+}
+
+int xmodem_send_opt_set(struct xmodem_send * sx, unsigned int opt)
+{
+	if (sx == NULL)
+		return -EINVAL;
+
+	sx->opt = opt;
+
+	return 0;
+}
+
+int xmodem_send_progress_set(struct xmodem_send * sx, 
+							 xmodem_progress_cb_t cb, void * arg,
+							 unsigned int interval_ms)
+{
+	if (sx == NULL)
+		return -EINVAL;
+
+	sx->meter.cb = cb;
+	sx->meter.arg = arg;
+	sx->meter.interval = interval_ms;
+
+	return 0;
+}
+
 int xmodem_send_close(struct xmodem_send * sx)
 {
 	int ret = 0;
@@ -390,7 +936,8 @@ int xmodem_send_close(struct xmodem_send * sx)
 			sx->pkt.data[i] = '\0';
 
 		sx->seq = 0;
-		ret = xmodem_send_pkt(sx, data_max);
+		sx->hdr = 1;
+		ret = xmodem_send_pkt(sx, sx->pkt.data, data_max, NULL);
 
 		sx->data_max = 1024;
 		sx->data_len = 0;